@@ -0,0 +1,109 @@
+#pragma once
+
+#include "../src/lexer.h"
+#include "../src/parse.h"
+#include "../src/runtime.h"
+#include "../src/statement.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class BenchmarkRunner {
+public:
+	BenchmarkRunner() = default;
+
+	// Understands --filter=<substring of benchmark names> and --repetitions=<count>
+	BenchmarkRunner(int argc, const char** argv) {
+		for (int i = 1; i < argc; ++i) {
+			const std::string option = argv[i];
+			if (option.rfind("--filter=", 0) == 0) {
+				filter_ = option.substr(9);
+			} else if (option.rfind("--repetitions=", 0) == 0) {
+				repetitions_ = std::max(1, std::stoi(option.substr(14)));
+			} else {
+				throw std::invalid_argument("Unknown option " + option
+											+ ", expected --filter=<name part> or --repetitions=<count>");
+			}
+		}
+	}
+
+	// Repeats func until at least min_time has passed and reports the mean time of one run. With
+	// several repetitions the median of their means is reported along with the spread. When a run
+	// processes bytes_per_run bytes of input, the throughput is reported too
+	template <class BenchFunc>
+	void RunBenchmark(BenchFunc func, const std::string& bench_name, size_t bytes_per_run = 0) {
+		using Clock = std::chrono::steady_clock;
+		if (bench_name.find(filter_) == std::string::npos) {
+			return;
+		}
+		try {
+			std::vector<double> means;
+			size_t iterations = 0;
+			for (int repetition = 0; repetition < repetitions_; ++repetition) {
+				iterations = 0;
+				const auto start = Clock::now();
+				auto elapsed = Clock::duration::zero();
+				do {
+					func();
+					++iterations;
+					elapsed = Clock::now() - start;
+				} while (elapsed < min_time_);
+				means.push_back(std::chrono::duration<double, std::nano>(elapsed).count() / iterations);
+			}
+			std::sort(means.begin(), means.end());
+			const double ns_per_run = means[means.size() / 2];
+			std::cerr << std::left << std::setw(48) << bench_name << std::right << std::setw(16)
+					  << std::fixed << std::setprecision(0) << ns_per_run << " ns" << std::setw(10)
+					  << iterations << " runs";
+			if (bytes_per_run > 0) {
+				std::cerr << std::setw(10) << std::setprecision(1)
+						  << bytes_per_run / ns_per_run * 1e9 / (1 << 20) << " MiB/s";
+			}
+			if (means.size() > 1) {
+				std::cerr << "  spread " << std::setprecision(1)
+						  << (means.back() - means.front()) / ns_per_run * 100 << "%";
+			}
+			std::cerr << std::endl;
+		} catch (std::exception& e) {
+			++fail_count_;
+			std::cerr << bench_name << " fail: " << e.what() << std::endl;
+		}
+	}
+
+	~BenchmarkRunner() {
+		if (fail_count_ > 0) {
+			std::cerr << fail_count_ << " benchmarks failed" << std::endl;
+			exit(1);
+		}
+	}
+
+private:
+	std::chrono::milliseconds min_time_{500};
+	std::string filter_;
+	int repetitions_ = 1;
+	int fail_count_ = 0;
+};
+
+#define RUN_BENCHMARK(br, func) br.RunBenchmark(func, #func)
+#define RUN_THROUGHPUT_BENCHMARK(br, func, bytes_per_run) br.RunBenchmark(func, #func, bytes_per_run)
+
+// Parses and executes a Mython program, discarding everything it prints
+inline void RunMythonSource(const std::string& source, runtime::Engine engine = runtime::Engine::Bytecode,
+							runtime::MemoCache* memoization = nullptr) {
+	std::istringstream input(source);
+	parse::Lexer lexer(input);
+	auto program = ParseProgram(lexer);
+
+	std::ostringstream output;
+	runtime::SimpleContext context{output};
+	context.SetEngine(engine);
+	context.SetMemoization(memoization);
+	runtime::Closure closure;
+	program->Execute(closure, context);
+}
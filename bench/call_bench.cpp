@@ -0,0 +1,146 @@
+#include "bench_runner.h"
+
+#include "../src/memo.h"
+#include "../src/profiler.h"
+
+using namespace std;
+
+namespace {
+
+const string FIBONACCI = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+fib = Fib()
+print fib.calc(16)
+)";
+
+void BenchRecursiveFibonacci() {
+	RunMythonSource(FIBONACCI);
+}
+
+// The same program with the methods walking their syntax trees
+void BenchRecursiveFibonacciTree() {
+	RunMythonSource(FIBONACCI, runtime::Engine::Tree);
+}
+
+// The same program with the pure method memoized, each run starts with an empty cache
+void BenchRecursiveFibonacciMemoized() {
+	runtime::MemoCache cache;
+	RunMythonSource(FIBONACCI, runtime::Engine::Bytecode, &cache);
+}
+
+// The same program under the sampling profiler at ten times its default rate
+void BenchRecursiveFibonacciSampled() {
+	static runtime::ShadowStack shadow_stack;
+	static runtime::SamplingProfiler sampler(chrono::milliseconds(1));
+	runtime::ShadowStack::Activation activation(shadow_stack);
+	sampler.Start();
+	BenchRecursiveFibonacci();
+	sampler.Stop();
+}
+
+void BenchArgumentPassing() {
+	RunMythonSource(R"(
+class Chain:
+  def pass_down(depth, a, b, c, d):
+    if depth == 0:
+      return a + b + c + d
+    return self.pass_down(depth - 1, b, c, d, a)
+
+chain = Chain()
+print chain.pass_down(500, 1, 2, 3, 4), chain.pass_down(500, 5, 6, 7, 8)
+)");
+}
+
+void BenchObjectsInArguments() {
+	RunMythonSource(R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def shift(other):
+    self.x = self.x + other.x
+    self.y = self.y + other.y
+    return self
+
+class Walker:
+  def walk(steps, position, delta):
+    if steps == 0:
+      return position
+    return self.walk(steps - 1, position.shift(delta), delta)
+
+walker = Walker()
+end = walker.walk(500, Point(0, 0), Point(1, 2))
+print end.x, end.y
+)");
+}
+
+const string TAIL_RECURSION = R"(
+class Counter:
+  def count(n, acc):
+    if n == 0:
+      return acc
+    return self.count(n - 1, acc + n)
+
+counter = Counter()
+print counter.count(10000, 0)
+)";
+
+void BenchTailRecursion() {
+	RunMythonSource(TAIL_RECURSION);
+}
+
+void BenchTailRecursionTree() {
+	RunMythonSource(TAIL_RECURSION, runtime::Engine::Tree);
+}
+
+// Loops, field updates and calls inside methods, where the bytecode runs
+const string METHOD_LOOPS = R"(
+class Accumulator:
+  def __init__():
+    self.total = 0
+    self.count = 0
+
+  def add(x):
+    self.total = self.total + x
+    self.count = self.count + 1
+
+  def run(n):
+    i = 0
+    while i < n:
+      if i / 3 * 3 == i or i < 10:
+        self.add(i)
+      i = i + 1
+    return self.total
+
+accumulator = Accumulator()
+print accumulator.run(5000), accumulator.count
+)";
+
+void BenchMethodLoops() {
+	RunMythonSource(METHOD_LOOPS);
+}
+
+void BenchMethodLoopsTree() {
+	RunMythonSource(METHOD_LOOPS, runtime::Engine::Tree);
+}
+
+}  // namespace
+
+void RunCallBenchmarks(BenchmarkRunner& br) {
+	RUN_BENCHMARK(br, BenchRecursiveFibonacci);
+	RUN_BENCHMARK(br, BenchRecursiveFibonacciTree);
+	RUN_BENCHMARK(br, BenchRecursiveFibonacciMemoized);
+	RUN_BENCHMARK(br, BenchRecursiveFibonacciSampled);
+	RUN_BENCHMARK(br, BenchArgumentPassing);
+	RUN_BENCHMARK(br, BenchObjectsInArguments);
+	RUN_BENCHMARK(br, BenchTailRecursion);
+	RUN_BENCHMARK(br, BenchTailRecursionTree);
+	RUN_BENCHMARK(br, BenchMethodLoops);
+	RUN_BENCHMARK(br, BenchMethodLoopsTree);
+}
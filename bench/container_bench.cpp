@@ -0,0 +1,77 @@
+#include "bench_runner.h"
+
+using namespace std;
+
+namespace {
+
+// Both benchmarks look up 400 keys in a table of 100 entries
+
+void BenchDictLookup() {
+	RunMythonSource(R"(
+table = {}
+i = 0
+while i < 100:
+  table['key' + str(i)] = i
+  i = i + 1
+keys = ['key7', 'key42', 'key99', 'key0']
+hits = 0
+n = 0
+while n < 100:
+  for key in keys:
+    hits = hits + table[key]
+  n = n + 1
+print hits
+)");
+}
+
+void BenchInstanceChainLookup() {
+	RunMythonSource(R"(
+class Entry:
+  def __init__(key, value, next):
+    self.key = key
+    self.value = value
+    self.next = next
+
+  def find(key):
+    if self.key == key:
+      return self.value
+    return self.next.find(key)
+
+table = None
+i = 0
+while i < 100:
+  table = Entry(i, i, table)
+  i = i + 1
+keys = [7, 42, 99, 0]
+hits = 0
+n = 0
+while n < 100:
+  for key in keys:
+    hits = hits + table.find(key)
+  n = n + 1
+print hits
+)");
+}
+
+void BenchDictUpdate() {
+	RunMythonSource(R"(
+counts = {}
+i = 0
+while i < 5000:
+  key = i - i / 64 * 64
+  if key in counts:
+    counts[key] = counts[key] + 1
+  else:
+    counts[key] = 1
+  i = i + 1
+print len(counts)
+)");
+}
+
+}  // namespace
+
+void RunContainerBenchmarks(BenchmarkRunner& br) {
+	RUN_BENCHMARK(br, BenchDictLookup);
+	RUN_BENCHMARK(br, BenchInstanceChainLookup);
+	RUN_BENCHMARK(br, BenchDictUpdate);
+}
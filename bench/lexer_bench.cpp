@@ -0,0 +1,39 @@
+#include "bench_runner.h"
+
+using namespace std;
+
+namespace {
+
+// A generated data file: 2000 rows of ten numbers of various lengths
+const string& NumericTableSource() {
+	static const string source = [] {
+		ostringstream out;
+		out << "table = [\n"s;
+		uint64_t seed = 12345;
+		for (int row = 0; row < 2000; ++row) {
+			out << "  ["s;
+			for (int column = 0; column < 10; ++column) {
+				seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+				out << (column == 0 ? ""s : ", "s) << (seed >> (column * 5 + 14));
+			}
+			out << "],\n"s;
+		}
+		out << "]\n"s;
+		return out.str();
+	}();
+	return source;
+}
+
+void BenchLexNumericTable() {
+	istringstream input(NumericTableSource());
+	parse::Lexer lexer(input);
+	if (!lexer.CurrentToken().Is<parse::token_type::Id>()) {
+		throw runtime_error("Unexpected first token"s);
+	}
+}
+
+}  // namespace
+
+void RunLexerBenchmarks(BenchmarkRunner& br) {
+	RUN_THROUGHPUT_BENCHMARK(br, BenchLexNumericTable, NumericTableSource().size());
+}
@@ -0,0 +1,55 @@
+#include "bench_runner.h"
+
+using namespace std;
+
+namespace {
+
+// Both benchmarks sum the numbers from 1 to 10000
+
+void BenchWhileLoopSum() {
+	RunMythonSource(R"(
+n = 10000
+sum = 0
+while n > 0:
+  sum = sum + n
+  n = n - 1
+print sum
+)");
+}
+
+void BenchRecursiveSum() {
+	RunMythonSource(R"(
+class Summator:
+  def sum(n, acc):
+    if n > 0:
+      return self.sum(n - 1, acc + n)
+    return acc
+
+summator = Summator()
+print summator.sum(10000, 0)
+)");
+}
+
+void BenchNestedLoopsWithBreak() {
+	RunMythonSource(R"(
+i = 0
+count = 0
+while i < 100:
+  j = 0
+  while True:
+    j = j + 1
+    if j > i:
+      break
+    count = count + 1
+  i = i + 1
+print count
+)");
+}
+
+}  // namespace
+
+void RunLoopBenchmarks(BenchmarkRunner& br) {
+	RUN_BENCHMARK(br, BenchWhileLoopSum);
+	RUN_BENCHMARK(br, BenchRecursiveSum);
+	RUN_BENCHMARK(br, BenchNestedLoopsWithBreak);
+}
@@ -0,0 +1,26 @@
+#include "bench_runner.h"
+
+void RunLexerBenchmarks(BenchmarkRunner& br);
+void RunParseBenchmarks(BenchmarkRunner& br);
+void RunOperationBenchmarks(BenchmarkRunner& br);
+void RunCallBenchmarks(BenchmarkRunner& br);
+void RunLoopBenchmarks(BenchmarkRunner& br);
+void RunContainerBenchmarks(BenchmarkRunner& br);
+void RunStringBenchmarks(BenchmarkRunner& br);
+
+int main(int argc, const char** argv) {
+	try {
+		BenchmarkRunner br(argc, argv);
+		RunLexerBenchmarks(br);
+		RunParseBenchmarks(br);
+		RunCallBenchmarks(br);
+		RunLoopBenchmarks(br);
+		RunContainerBenchmarks(br);
+		RunStringBenchmarks(br);
+		RunOperationBenchmarks(br);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include "bench_runner.h"
+
+using namespace std;
+
+namespace {
+
+void BenchArithmetic() {
+	RunMythonSource(R"(
+i = 0
+x = 7
+while i < 5000:
+  x = (x * 3 + i) / 4 - i / 8 + 1
+  i = i + 1
+print x
+)");
+}
+
+void BenchComparisons() {
+	RunMythonSource(R"(
+i = 0
+hits = 0
+while i < 3000:
+  if i < 1500 and i != 700 or i == 2999:
+    hits = hits + 1
+  if 'abc' < 'abd' and not i >= 3000 and True != False:
+    hits = hits + 1
+  i = i + 1
+print hits
+)");
+}
+
+// A chain of depth classes; the method called is defined in the root only
+string DispatchProgram(int depth) {
+	ostringstream out;
+	out << "class Level0:\n  def value(x):\n    return x + 1\n\n"s;
+	for (int level = 1; level < depth; ++level) {
+		out << "class Level"s << level << "(Level"s << level - 1 << "):\n"s
+			<< "  def other"s << level << "():\n    return "s << level << "\n\n"s;
+	}
+	out << "leaf = Level"s << depth - 1 << "()\n"s
+		<< "i = 0\nsum = 0\nwhile i < 2000:\n  sum = sum + leaf.value(i)\n  i = i + 1\nprint sum\n"s;
+	return out.str();
+}
+
+void BenchDispatchDepth1() {
+	static const string source = DispatchProgram(1);
+	RunMythonSource(source);
+}
+
+void BenchDispatchDepth8() {
+	static const string source = DispatchProgram(8);
+	RunMythonSource(source);
+}
+
+void BenchFieldAccess() {
+	RunMythonSource(R"(
+class Vector:
+  def __init__():
+    self.x = 0
+    self.y = 0
+    self.z = 0
+
+v = Vector()
+i = 0
+while i < 3000:
+  v.x = v.x + 1
+  v.y = v.y + v.x
+  v.z = v.z + v.y - v.x
+  i = i + 1
+print v.x, v.y, v.z
+)");
+}
+
+void BenchObjectCreation() {
+	RunMythonSource(R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+i = 0
+last = None
+while i < 3000:
+  last = Point(i, i + 1)
+  i = i + 1
+print last.x
+)");
+}
+
+void BenchPrint() {
+	RunMythonSource(R"(
+i = 0
+while i < 2000:
+  print 'row', i, True, None
+  i = i + 1
+)");
+}
+
+void BenchDeepRecursion() {
+	RunMythonSource(R"(
+class Deep:
+  def depth(n):
+    if n == 0:
+      return 0
+    return 1 + self.depth(n - 1)
+
+d = Deep()
+print d.depth(3000)
+)");
+}
+
+}  // namespace
+
+void RunOperationBenchmarks(BenchmarkRunner& br) {
+	RUN_BENCHMARK(br, BenchArithmetic);
+	RUN_BENCHMARK(br, BenchComparisons);
+	RUN_BENCHMARK(br, BenchDispatchDepth1);
+	RUN_BENCHMARK(br, BenchDispatchDepth8);
+	RUN_BENCHMARK(br, BenchFieldAccess);
+	RUN_BENCHMARK(br, BenchObjectCreation);
+	RUN_BENCHMARK(br, BenchPrint);
+	RUN_BENCHMARK(br, BenchDeepRecursion);
+}
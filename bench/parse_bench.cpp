@@ -0,0 +1,62 @@
+#include "bench_runner.h"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+namespace {
+
+// test.my repeated 200 times, each copy with its own class
+const string& ScaledTestProgram() {
+	static const string source = [] {
+		const auto path = filesystem::path(__FILE__).parent_path().parent_path() / "test.my";
+		ifstream file(path);
+		if (!file) {
+			throw runtime_error("Cannot open "s + path.string());
+		}
+		const string original{istreambuf_iterator<char>(file), istreambuf_iterator<char>()};
+		string result;
+		for (int copy = 0; copy < 200; ++copy) {
+			const string class_name = "GCD"s + to_string(copy);
+			for (size_t pos = 0;;) {
+				const size_t found = original.find("GCD"s, pos);
+				result.append(original, pos, found - pos);
+				if (found == string::npos) {
+					break;
+				}
+				result += class_name;
+				pos = found + 3;
+			}
+			result += '\n';
+		}
+		return result;
+	}();
+	return source;
+}
+
+void BenchLexTestProgram() {
+	istringstream input(ScaledTestProgram());
+	parse::Lexer lexer(input);
+	if (!lexer.CurrentToken().Is<parse::token_type::Class>()) {
+		throw runtime_error("Unexpected first token"s);
+	}
+}
+
+void BenchParseTestProgram() {
+	istringstream input(ScaledTestProgram());
+	parse::Lexer lexer(input);
+	auto program = ParseProgram(lexer);
+}
+
+void BenchRunTestProgram() {
+	RunMythonSource(ScaledTestProgram());
+}
+
+}  // namespace
+
+void RunParseBenchmarks(BenchmarkRunner& br) {
+	RUN_THROUGHPUT_BENCHMARK(br, BenchLexTestProgram, ScaledTestProgram().size());
+	RUN_THROUGHPUT_BENCHMARK(br, BenchParseTestProgram, ScaledTestProgram().size());
+	RUN_BENCHMARK(br, BenchRunTestProgram);
+}
@@ -0,0 +1,51 @@
+#include "bench_runner.h"
+
+using namespace std;
+
+namespace {
+
+// The two string building benchmarks make a 1 MB string out of 16 byte pieces
+
+void BenchStringBuildingLoop() {
+	RunMythonSource(R"(
+piece = 'abcdefghijklmnop'
+text = ''
+n = 0
+while n < 65536:
+  text = text + piece
+  n = n + 1
+print len(text)
+)");
+}
+
+void BenchStringBuildingAccumulator() {
+	RunMythonSource(R"(
+class Report:
+  def build(n, acc):
+    if n > 0:
+      return self.build(n - 1, acc + 'abcdefghijklmnop')
+    return acc
+
+report = Report()
+print len(report.build(65536, ''))
+)");
+}
+
+void BenchNumberToString() {
+	RunMythonSource(R"(
+n = 0
+length = 0
+while n < 10000:
+  length = length + len(str(n)) + len(str(n > 5000))
+  n = n + 1
+print length
+)");
+}
+
+}  // namespace
+
+void RunStringBenchmarks(BenchmarkRunner& br) {
+	RUN_BENCHMARK(br, BenchStringBuildingLoop);
+	RUN_BENCHMARK(br, BenchStringBuildingAccumulator);
+	RUN_BENCHMARK(br, BenchNumberToString);
+}
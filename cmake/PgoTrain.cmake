@@ -0,0 +1,26 @@
+# Runs the interpreter built with MYTHON_PGO=GENERATE over the training corpus.
+# Expects MYTHON, PROFILE_DIR, COMPILER_ID and CORPUS (a list of scripts).
+
+foreach(script IN LISTS CORPUS)
+	message(STATUS "Training on ${script}")
+	execute_process(
+		COMMAND ${MYTHON} ${script}
+		OUTPUT_QUIET
+		RESULT_VARIABLE result
+	)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${script} failed: ${result}")
+	endif()
+endforeach()
+
+if(COMPILER_ID MATCHES "Clang")
+	find_program(LLVM_PROFDATA NAMES llvm-profdata REQUIRED)
+	file(GLOB raw_profiles ${PROFILE_DIR}/*.profraw)
+	execute_process(
+		COMMAND ${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/mython.profdata ${raw_profiles}
+		RESULT_VARIABLE result
+	)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "Cannot merge the profiles: ${result}")
+	endif()
+endif()
@@ -0,0 +1,205 @@
+#include "bigint.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace runtime {
+
+BigInt::BigInt(int64_t value)
+	: negative_(value < 0) {
+	// The magnitude of the minimal value does not fit into int64_t, so it is taken unsigned
+	uint64_t magnitude = negative_ ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+	while (magnitude != 0) {
+		digits_.push_back(static_cast<uint32_t>(magnitude % BASE));
+		magnitude /= BASE;
+	}
+}
+
+BigInt::BigInt(bool negative, Digits digits)
+	: negative_(negative), digits_(std::move(digits)) {
+	Trim(digits_);
+	if (digits_.empty()) {
+		negative_ = false;
+	}
+}
+
+bool BigInt::IsZero() const {
+	return digits_.empty();
+}
+
+bool BigInt::IsNegative() const {
+	return negative_;
+}
+
+optional<int64_t> BigInt::ToInt64() const {
+	uint64_t magnitude = 0;
+	for (auto it = digits_.rbegin(); it != digits_.rend(); ++it) {
+		if (__builtin_mul_overflow(magnitude, BASE, &magnitude)
+			|| __builtin_add_overflow(magnitude, *it, &magnitude)) {
+			return nullopt;
+		}
+	}
+	const uint64_t max_positive = numeric_limits<int64_t>::max();
+	if (!negative_) {
+		return magnitude <= max_positive ? optional<int64_t>(static_cast<int64_t>(magnitude)) : nullopt;
+	}
+	if (magnitude > max_positive + 1) {
+		return nullopt;
+	}
+	return magnitude == max_positive + 1 ? numeric_limits<int64_t>::min() : -static_cast<int64_t>(magnitude);
+}
+
+string BigInt::ToString() const {
+	if (digits_.empty()) {
+		return "0"s;
+	}
+	string result = negative_ ? "-"s : ""s;
+	result += to_string(digits_.back());
+	for (auto it = digits_.rbegin() + 1; it != digits_.rend(); ++it) {
+		const string digit = to_string(*it);
+		result.append(9 - digit.size(), '0').append(digit);
+	}
+	return result;
+}
+
+size_t BigInt::Hash() const {
+	size_t result = negative_ ? 1 : 0;
+	for (uint32_t digit : digits_) {
+		result = result * 1'000'003 + hash<uint32_t>{}(digit);
+	}
+	return result;
+}
+
+BigInt operator+(const BigInt& lhs, const BigInt& rhs) {
+	if (lhs.negative_ == rhs.negative_) {
+		return {lhs.negative_, BigInt::AddAbs(lhs.digits_, rhs.digits_)};
+	}
+	if (BigInt::CompareAbs(lhs.digits_, rhs.digits_) >= 0) {
+		return {lhs.negative_, BigInt::SubAbs(lhs.digits_, rhs.digits_)};
+	}
+	return {rhs.negative_, BigInt::SubAbs(rhs.digits_, lhs.digits_)};
+}
+
+BigInt operator-(const BigInt& lhs, const BigInt& rhs) {
+	return lhs + BigInt(!rhs.negative_, rhs.digits_);
+}
+
+BigInt operator*(const BigInt& lhs, const BigInt& rhs) {
+	return {lhs.negative_ != rhs.negative_, BigInt::MulAbs(lhs.digits_, rhs.digits_)};
+}
+
+BigInt operator/(const BigInt& lhs, const BigInt& rhs) {
+	if (rhs.IsZero()) {
+		throw runtime_error("Division by zero"s);
+	}
+	return {lhs.negative_ != rhs.negative_, BigInt::DivAbs(lhs.digits_, rhs.digits_)};
+}
+
+bool operator==(const BigInt& lhs, const BigInt& rhs) {
+	return lhs.negative_ == rhs.negative_ && lhs.digits_ == rhs.digits_;
+}
+
+bool operator<(const BigInt& lhs, const BigInt& rhs) {
+	if (lhs.negative_ != rhs.negative_) {
+		return lhs.negative_;
+	}
+	const int abs_order = BigInt::CompareAbs(lhs.digits_, rhs.digits_);
+	return lhs.negative_ ? abs_order > 0 : abs_order < 0;
+}
+
+ostream& operator<<(ostream& os, const BigInt& value) {
+	return os << value.ToString();
+}
+
+int BigInt::CompareAbs(const Digits& lhs, const Digits& rhs) {
+	if (lhs.size() != rhs.size()) {
+		return lhs.size() < rhs.size() ? -1 : 1;
+	}
+	for (size_t i = lhs.size(); i-- > 0;) {
+		if (lhs[i] != rhs[i]) {
+			return lhs[i] < rhs[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+BigInt::Digits BigInt::AddAbs(const Digits& lhs, const Digits& rhs) {
+	Digits result;
+	result.reserve(max(lhs.size(), rhs.size()) + 1);
+	uint32_t carry = 0;
+	for (size_t i = 0; i < max(lhs.size(), rhs.size()) || carry != 0; ++i) {
+		uint32_t sum = carry;
+		sum += i < lhs.size() ? lhs[i] : 0;
+		sum += i < rhs.size() ? rhs[i] : 0;
+		carry = sum >= BASE ? 1 : 0;
+		result.push_back(sum - carry * BASE);
+	}
+	return result;
+}
+
+BigInt::Digits BigInt::SubAbs(const Digits& lhs, const Digits& rhs) {
+	Digits result;
+	result.reserve(lhs.size());
+	int64_t borrow = 0;
+	for (size_t i = 0; i < lhs.size(); ++i) {
+		int64_t difference = static_cast<int64_t>(lhs[i]) - borrow - (i < rhs.size() ? rhs[i] : 0);
+		borrow = difference < 0 ? 1 : 0;
+		result.push_back(static_cast<uint32_t>(difference + borrow * BASE));
+	}
+	Trim(result);
+	return result;
+}
+
+BigInt::Digits BigInt::MulAbs(const Digits& lhs, const Digits& rhs) {
+	if (lhs.empty() || rhs.empty()) {
+		return {};
+	}
+	vector<uint64_t> wide(lhs.size() + rhs.size(), 0);
+	for (size_t i = 0; i < lhs.size(); ++i) {
+		uint64_t carry = 0;
+		for (size_t j = 0; j < rhs.size() || carry != 0; ++j) {
+			uint64_t current = wide[i + j] + carry + (j < rhs.size() ? uint64_t{lhs[i]} * rhs[j] : 0);
+			wide[i + j] = current % BASE;
+			carry = current / BASE;
+		}
+	}
+	Digits result(wide.begin(), wide.end());
+	Trim(result);
+	return result;
+}
+
+BigInt::Digits BigInt::DivAbs(const Digits& lhs, const Digits& rhs) {
+	// Schoolbook long division, every digit of the quotient is found by a binary search
+	Digits quotient(lhs.size(), 0);
+	Digits remainder;
+	for (size_t i = lhs.size(); i-- > 0;) {
+		remainder.insert(remainder.begin(), lhs[i]);
+		Trim(remainder);
+		uint32_t low = 0;
+		uint32_t high = BASE - 1;
+		while (low < high) {
+			const uint32_t middle = low + (high - low + 1) / 2;
+			if (CompareAbs(MulAbs(rhs, {middle}), remainder) <= 0) {
+				low = middle;
+			} else {
+				high = middle - 1;
+			}
+		}
+		quotient[i] = low;
+		remainder = SubAbs(remainder, MulAbs(rhs, {low}));
+	}
+	Trim(quotient);
+	return quotient;
+}
+
+void BigInt::Trim(Digits& digits) {
+	while (!digits.empty() && digits.back() == 0) {
+		digits.pop_back();
+	}
+}
+
+}  // namespace runtime
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace runtime {
+
+// Arbitrary precision integer: the sign and the magnitude in base 10^9 digits, the lowest first.
+// Numbers take this form only after a 64-bit operation overflows, so the operations favour
+// simplicity over asymptotic speed
+class BigInt {
+public:
+	BigInt() = default;
+	BigInt(int64_t value);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+
+	[[nodiscard]] bool IsZero() const;
+	[[nodiscard]] bool IsNegative() const;
+	// Gives the value if it fits into 64 bits
+	[[nodiscard]] std::optional<int64_t> ToInt64() const;
+	[[nodiscard]] std::string ToString() const;
+	[[nodiscard]] size_t Hash() const;
+
+	friend BigInt operator+(const BigInt& lhs, const BigInt& rhs);
+	friend BigInt operator-(const BigInt& lhs, const BigInt& rhs);
+	friend BigInt operator*(const BigInt& lhs, const BigInt& rhs);
+	// Rounds toward zero like the 64-bit division; throws when rhs is zero
+	friend BigInt operator/(const BigInt& lhs, const BigInt& rhs);
+
+	friend bool operator==(const BigInt& lhs, const BigInt& rhs);
+	friend bool operator<(const BigInt& lhs, const BigInt& rhs);
+
+private:
+	using Digits = std::vector<uint32_t>;
+	static constexpr uint32_t BASE = 1'000'000'000;
+
+	BigInt(bool negative, Digits digits);
+
+	static int CompareAbs(const Digits& lhs, const Digits& rhs);
+	static Digits AddAbs(const Digits& lhs, const Digits& rhs);
+	// lhs must not be less than rhs
+	static Digits SubAbs(const Digits& lhs, const Digits& rhs);
+	static Digits MulAbs(const Digits& lhs, const Digits& rhs);
+	static Digits DivAbs(const Digits& lhs, const Digits& rhs);
+	static void Trim(Digits& digits);
+
+	bool negative_ = false;
+	Digits digits_;  // no leading zeroes, empty for zero
+};
+
+inline bool operator!=(const BigInt& lhs, const BigInt& rhs) {
+	return !(lhs == rhs);
+}
+
+std::ostream& operator<<(std::ostream& os, const BigInt& value);
+
+}  // namespace runtime
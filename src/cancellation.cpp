@@ -0,0 +1,62 @@
+#include "cancellation.h"
+
+namespace runtime {
+
+CancellationToken::~CancellationToken() {
+	{
+		std::lock_guard lock(mutex_);
+		stopping_ = true;
+	}
+	deadline_changed_.notify_one();
+	if (timer_.joinable()) {
+		timer_.join();
+	}
+}
+
+void CancellationToken::Cancel() {
+	Fire(CancelReason::Cancelled);
+}
+
+void CancellationToken::SetDeadline(Clock::time_point deadline) {
+	{
+		std::lock_guard lock(mutex_);
+		deadline_ = deadline;
+		if (!timer_.joinable()) {
+			timer_ = std::thread([this] {
+				WaitForDeadline();
+			});
+		}
+	}
+	deadline_changed_.notify_one();
+}
+
+std::optional<CancellationToken::Clock::time_point> CancellationToken::GetDeadline() const {
+	std::lock_guard lock(mutex_);
+	return deadline_;
+}
+
+const CancellationToken& CancellationToken::Never() {
+	static const CancellationToken never;
+	return never;
+}
+
+void CancellationToken::Fire(CancelReason reason) {
+	// The first reason wins; the flag the interpreter polls is raised after it is known
+	CancelReason none = CancelReason::None;
+	reason_.compare_exchange_strong(none, reason, std::memory_order_release);
+	cancelled_.store(true, std::memory_order_release);
+}
+
+void CancellationToken::WaitForDeadline() {
+	std::unique_lock lock(mutex_);
+	while (!stopping_) {
+		const Clock::time_point deadline = *deadline_;
+		if (deadline_changed_.wait_until(lock, deadline) == std::cv_status::timeout
+			&& deadline_ == deadline) {
+			Fire(CancelReason::Deadline);
+			return;
+		}
+	}
+}
+
+}  // namespace runtime
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace runtime {
+
+// Why a CancellationToken fired
+enum class CancelReason : uint8_t {
+	None,
+	Cancelled,  // Cancel was called
+	Deadline,   // the deadline passed
+};
+
+// Stops a running program from another thread. A context checks its token at method entries
+// and at every loop iteration with one relaxed load and throws Cancelled once it fires; the
+// program unwinds like on any runtime error. A token fires once and stays cancelled
+class CancellationToken {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	CancellationToken() = default;
+	CancellationToken(const CancellationToken&) = delete;
+	CancellationToken& operator=(const CancellationToken&) = delete;
+	~CancellationToken();
+
+	// Safe to call from any thread and from signal handlers
+	void Cancel();
+	// Fires the token at the deadline from a timer thread; a later call moves the deadline
+	void SetDeadline(Clock::time_point deadline);
+	void CancelAfter(Clock::duration timeout) {
+		SetDeadline(Clock::now() + timeout);
+	}
+	[[nodiscard]] std::optional<Clock::time_point> GetDeadline() const;
+
+	[[nodiscard]] bool IsCancelled() const {
+		return cancelled_.load(std::memory_order_relaxed);
+	}
+	[[nodiscard]] CancelReason GetReason() const {
+		return reason_.load(std::memory_order_acquire);
+	}
+
+	// A token nobody can cancel, the one of contexts without their own
+	static const CancellationToken& Never();
+
+private:
+	void Fire(CancelReason reason);
+	void WaitForDeadline();
+
+	std::atomic<bool> cancelled_{false};
+	std::atomic<CancelReason> reason_{CancelReason::None};
+
+	mutable std::mutex mutex_;
+	std::condition_variable deadline_changed_;
+	std::optional<Clock::time_point> deadline_;
+	bool stopping_ = false;
+	std::thread timer_;
+};
+
+}  // namespace runtime
@@ -0,0 +1,590 @@
+#include "compiler.h"
+
+#include "statement.h"
+#include "vm.h"
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+
+using namespace std;
+
+namespace vm {
+
+namespace {
+
+// The body holds something the bytecode does not support
+struct Unsupported {};
+
+using Register = uint16_t;
+using Statement = ast::Statement;
+using ComparatorFunction = bool (*)(const runtime::ObjectHolder&, const runtime::ObjectHolder&,
+									runtime::Context&);
+
+const string INIT_METHOD = "__init__"s;
+
+template <typename T>
+const T* As(const Statement& node) {
+	return dynamic_cast<const T*>(&node);
+}
+
+uint16_t CheckedIndex(size_t index) {
+	if (index >= numeric_limits<uint16_t>::max()) {
+		throw Unsupported{};
+	}
+	return static_cast<uint16_t>(index);
+}
+
+}  // namespace
+
+// Walks the tree of a method body once. Variables are resolved to registers while compiling:
+// self and the parameters come first, then every name the body assigns to. A local read where
+// it may still be unassigned is checked at run time, so the errors stay those of the tree walker
+class Compiler {
+public:
+	Compiler(const ast::MethodBody& body, const vector<string>& formal_params)
+		: body_(body), code_(make_unique<Code>()) {
+		code_->name = body.name_;
+		locals_.emplace("self"s, 0);
+		Register next = 1;
+		for (const string& param : formal_params) {
+			auto [it, inserted] = locals_.emplace(param, next);
+			if (inserted) {
+				next = CheckedIndex(next + 1U);
+			}
+			code_->parameters.push_back(it->second);
+		}
+		code_->first_local = next;
+		CollectLocals(*body.body_, next);
+		code_->first_temporary = next;
+		code_->register_count = next;
+		next_temporary_ = next;
+		bound_.assign(next, false);
+		fill(bound_.begin(), bound_.begin() + code_->first_local, true);
+	}
+
+	unique_ptr<Code> Compile() {
+		try {
+			CompileStatement(*body_.body_);
+			Emit({Opcode::ReturnNone});
+		} catch (const Unsupported&) {
+			return nullptr;
+		}
+		return std::move(code_);
+	}
+
+private:
+	struct Loop {
+		size_t continue_target;
+		vector<size_t> breaks;
+	};
+
+	void CollectLocals(const Statement& node, Register& next) {
+		auto add = [this, &next](const string& name) {
+			if (locals_.emplace(name, next).second) {
+				next = CheckedIndex(next + 1U);
+			}
+		};
+		if (const auto* compound = As<ast::Compound>(node)) {
+			for (const auto& statement : compound->compounds_) {
+				CollectLocals(*statement, next);
+			}
+		} else if (const auto* assignment = As<ast::Assignment>(node)) {
+			add(assignment->var_);
+		} else if (const auto* loop = As<ast::While>(node)) {
+			CollectLocals(*loop->body_, next);
+		} else if (const auto* loop = As<ast::ForEach>(node)) {
+			add(loop->var_);
+			CollectLocals(*loop->body_, next);
+		} else if (const auto* if_else = As<ast::IfElse>(node)) {
+			CollectLocals(*if_else->if_body_, next);
+			if (if_else->else_body_) {
+				CollectLocals(*if_else->else_body_, next);
+			}
+		}
+	}
+
+	// ------------ emitting
+
+	size_t Emit(Instruction instruction) {
+		code_->instructions.push_back(instruction);
+		code_->statements.push_back(current_statement_);
+		return code_->instructions.size() - 1;
+	}
+
+	[[nodiscard]] uint32_t Here() const {
+		return static_cast<uint32_t>(code_->instructions.size());
+	}
+
+	void Patch(const vector<size_t>& jumps) {
+		for (size_t jump : jumps) {
+			code_->instructions[jump].d = Here();
+		}
+	}
+
+	Register Temporary() {
+		const Register result = next_temporary_;
+		next_temporary_ = CheckedIndex(next_temporary_ + 1U);
+		code_->register_count = max(code_->register_count, next_temporary_);
+		return result;
+	}
+
+	uint16_t Constant(runtime::ObjectHolder value) {
+		code_->constants.push_back(std::move(value));
+		return CheckedIndex(code_->constants.size() - 1);
+	}
+
+	uint16_t BoolConstant(bool value) {
+		optional<uint16_t>& index = value ? true_constant_ : false_constant_;
+		if (!index) {
+			index = Constant(runtime::ObjectHolder::Own(runtime::Bool(value)));
+		}
+		return *index;
+	}
+
+	uint16_t Name(const string& name) {
+		auto [it, inserted] = names_.emplace(name, 0);
+		if (inserted) {
+			code_->names.push_back(name);
+			it->second = CheckedIndex(code_->names.size() - 1);
+		}
+		return it->second;
+	}
+
+	uint16_t BoundCall(const ast::MethodCall& call) {
+		code_->calls.push_back(&call);
+		return CheckedIndex(code_->calls.size() - 1);
+	}
+
+	uint32_t Operands(const vector<Register>& registers) {
+		const auto offset = static_cast<uint32_t>(code_->operands.size());
+		code_->operands.insert(code_->operands.end(), registers.begin(), registers.end());
+		return offset;
+	}
+
+	// ------------ expressions
+
+	static optional<runtime::ObjectHolder> ConstantOf(const Statement& node) {
+		if (const auto* number = As<ast::NumericConst>(node)) {
+			return number->value_;
+		}
+		if (const auto* str = As<ast::StringConst>(node)) {
+			return str->value_;
+		}
+		if (const auto* boolean = As<ast::BoolConst>(node)) {
+			return boolean->value_;
+		}
+		return nullopt;
+	}
+
+	static Comparison ComparisonOf(const ast::Comparison& node) {
+		const auto* function = node.cmp_.target<ComparatorFunction>();
+		if (function == nullptr) {
+			throw Unsupported{};
+		}
+		const pair<ComparatorFunction, Comparison> comparisons[] = {
+			{runtime::Equal, Comparison::Equal},
+			{runtime::NotEqual, Comparison::NotEqual},
+			{runtime::Less, Comparison::Less},
+			{runtime::Greater, Comparison::Greater},
+			{runtime::LessOrEqual, Comparison::LessOrEqual},
+			{runtime::GreaterOrEqual, Comparison::GreaterOrEqual},
+		};
+		for (const auto& [comparator, comparison] : comparisons) {
+			if (*function == comparator) {
+				return comparison;
+			}
+		}
+		throw Unsupported{};
+	}
+
+	// Whether evaluating the node may call methods of the program
+	static bool MayRunCode(const Statement& node) {
+		if (ConstantOf(node) || As<ast::None>(node) != nullptr || As<ast::VariableValue>(node) != nullptr) {
+			return false;
+		}
+		if (As<ast::Sub>(node) != nullptr || As<ast::Mult>(node) != nullptr || As<ast::Div>(node) != nullptr) {
+			const auto& operation = static_cast<const ast::BinaryOperation&>(node);
+			return MayRunCode(*operation.lhs_) || MayRunCode(*operation.rhs_);
+		}
+		if (const auto* length = As<ast::Length>(node)) {
+			return MayRunCode(*length->argument_);
+		}
+		if (const auto* list = As<ast::NewList>(node)) {
+			return any_of(list->items_.begin(), list->items_.end(), [](const auto& item) {
+				return MayRunCode(*item);
+			});
+		}
+		return true;
+	}
+
+	// The register of a local, or nullopt if the method never assigns the name. A read where
+	// the local may be unassigned throws message
+	optional<Register> ReadLocal(const string& name, const string& message) {
+		const auto it = locals_.find(name);
+		if (it == locals_.end()) {
+			return nullopt;
+		}
+		const Register local = it->second;
+		if (!bound_[local]) {
+			Emit({Opcode::CheckBound, 0, local, Name(message)});
+			bound_[local] = true;
+		}
+		return local;
+	}
+
+	// The register holding the value of node: a local read directly or a new temporary
+	Register Operand(const Statement& node) {
+		if (const auto* variable = As<ast::VariableValue>(node); variable != nullptr && variable->ids_chain_.size() == 1) {
+			const string& name = variable->ids_chain_.front();
+			if (auto local = ReadLocal(name, "Name "s + name + " not found in the scope"s)) {
+				return *local;
+			}
+		}
+		const Register result = Temporary();
+		CompileInto(node, result);
+		return result;
+	}
+
+	void CompileInto(const Statement& node, Register target) {
+		if (auto constant = ConstantOf(node)) {
+			Emit({Opcode::LoadConst, 0, target, Constant(std::move(*constant))});
+		} else if (As<ast::None>(node) != nullptr) {
+			Emit({Opcode::LoadNone, 0, target});
+		} else if (const auto* variable = As<ast::VariableValue>(node)) {
+			CompileVariable(*variable, target);
+		} else if (const auto* add = As<ast::Add>(node)) {
+			CompileArithmetic(*add, Opcode::Add, Opcode::AddConst, target);
+		} else if (const auto* sub = As<ast::Sub>(node)) {
+			CompileArithmetic(*sub, Opcode::Sub, Opcode::SubConst, target);
+		} else if (const auto* mult = As<ast::Mult>(node)) {
+			CompileArithmetic(*mult, Opcode::Mult, Opcode::Mult, target);
+		} else if (const auto* div = As<ast::Div>(node)) {
+			CompileArithmetic(*div, Opcode::Div, Opcode::Div, target);
+		} else if (const auto* comparison = As<ast::Comparison>(node)) {
+			const auto flags = static_cast<uint8_t>(ComparisonOf(*comparison));
+			const Register lhs = Operand(*comparison->lhs_);
+			if (auto constant = ConstantOf(*comparison->rhs_)) {
+				Emit({Opcode::CompareConst, flags, target, lhs, Constant(std::move(*constant))});
+			} else {
+				Emit({Opcode::Compare, flags, target, lhs, Operand(*comparison->rhs_)});
+			}
+		} else if (const auto* negation = As<ast::Not>(node)) {
+			Emit({Opcode::Not, 0, target, Operand(*negation->argument_)});
+		} else if (As<ast::And>(node) != nullptr || As<ast::Or>(node) != nullptr) {
+			vector<size_t> to_false;
+			Branch(node, false, to_false);
+			Emit({Opcode::LoadConst, 0, target, BoolConstant(true)});
+			const size_t to_end = Emit({Opcode::Jump});
+			Patch(to_false);
+			Emit({Opcode::LoadConst, 0, target, BoolConstant(false)});
+			Patch({to_end});
+		} else if (const auto* stringify = As<ast::Stringify>(node)) {
+			Emit({Opcode::Stringify, 0, target, Operand(*stringify->argument_)});
+		} else if (const auto* length = As<ast::Length>(node)) {
+			Emit({Opcode::Length, 0, target, Operand(*length->argument_)});
+		} else if (const auto* call = As<ast::MethodCall>(node)) {
+			const auto [argument_count, operands] = CallOperands(*call);
+			if (call->IsBound()) {
+				Emit({Opcode::CallDirect, 0, target, BoundCall(*call), argument_count, operands});
+			} else {
+				Emit({Opcode::Call, 0, target, Name(call->method_), argument_count, operands});
+			}
+		} else if (const auto* new_instance = As<ast::NewInstance>(node)) {
+			CompileNewInstance(*new_instance, target);
+		} else if (const auto* list = As<ast::NewList>(node)) {
+			vector<Register> items;
+			for (const auto& item : list->items_) {
+				items.push_back(Operand(*item));
+			}
+			Emit({Opcode::NewList, 0, target, 0, CheckedIndex(items.size()), Operands(items)});
+		} else if (const auto* dict = As<ast::NewDict>(node)) {
+			// The items may read the local being assigned the dictionary
+			const Register result = target < code_->first_temporary ? Temporary() : target;
+			Emit({Opcode::NewDict, 0, result});
+			for (const auto& [key, value] : dict->items_) {
+				const Register key_register = Operand(*key);
+				Emit({Opcode::DictInsert, 0, result, key_register, Operand(*value)});
+			}
+			if (result != target) {
+				Emit({Opcode::Move, 0, target, result});
+			}
+		} else if (const auto* subscript = As<ast::Subscript>(node)) {
+			const Register object = Operand(*subscript->object_);
+			Emit({Opcode::GetItem, 0, target, object, Operand(*subscript->index_)});
+		} else {
+			throw Unsupported{};
+		}
+	}
+
+	void CompileVariable(const ast::VariableValue& variable, Register target) {
+		const auto& ids = variable.ids_chain_;
+		if (ids.size() == 1) {
+			const string message = "Name "s + ids.front() + " not found in the scope"s;
+			if (auto local = ReadLocal(ids.front(), message)) {
+				if (*local != target) {
+					Emit({Opcode::Move, 0, target, *local});
+				}
+			} else {
+				Emit({Opcode::Throw, 0, 0, Name(message)});
+			}
+			return;
+		}
+		const string message = "Name not found in the scope"s;
+		auto object = ReadLocal(ids.front(), message);
+		if (!object) {
+			Emit({Opcode::Throw, 0, 0, Name(message)});
+			return;
+		}
+		Register current = *object;
+		for (size_t i = 1; i < ids.size(); ++i) {
+			const bool last = i + 1 == ids.size();
+			const Register next = last ? target : (i == 1 ? Temporary() : current);
+			Emit({Opcode::GetField, last ? LAST_FIELD : uint8_t{0}, next, current, Name(ids[i])});
+			current = next;
+		}
+	}
+
+	void CompileArithmetic(const ast::BinaryOperation& operation, Opcode op, Opcode const_op, Register target) {
+		const Register lhs = Operand(*operation.lhs_);
+		if (const_op != op) {
+			if (auto constant = ConstantOf(*operation.rhs_)) {
+				Emit({const_op, 0, target, lhs, Constant(std::move(*constant))});
+				return;
+			}
+		}
+		Emit({op, 0, target, lhs, Operand(*operation.rhs_)});
+	}
+
+	// The argument count and the operands: the receiver, then the arguments
+	pair<uint16_t, uint32_t> CallOperands(const ast::MethodCall& call) {
+		vector<Register> operands{Operand(*call.object_)};
+		for (const auto& argument : call.args_) {
+			operands.push_back(Operand(*argument));
+		}
+		return {CheckedIndex(call.args_.size()), Operands(operands)};
+	}
+
+	void CompileNewInstance(const ast::NewInstance& node, Register target) {
+		vector<Register> arguments;
+		// Without __init__ the arguments are not evaluated
+		if (node.class__.GetMethod(INIT_METHOD) != nullptr) {
+			for (const auto& argument : node.args_) {
+				arguments.push_back(Operand(*argument));
+			}
+		}
+		code_->classes.push_back(&node.class__);
+		Emit({Opcode::NewInstance, 0, target, CheckedIndex(code_->classes.size() - 1),
+			  CheckedIndex(arguments.size()), Operands(arguments)});
+	}
+
+	// ------------ conditions
+
+	// Emits the evaluation of node and the jumps to be patched, taken when node is true in the
+	// sense of runtime::IsTrue exactly if jump_when is; otherwise the code falls through
+	void Branch(const Statement& node, bool jump_when, vector<size_t>& jumps) {
+		if (const auto* comparison = As<ast::Comparison>(node)) {
+			const uint8_t flags = static_cast<uint8_t>(ComparisonOf(*comparison)) | (jump_when ? JUMP_WHEN_TRUE : 0);
+			const Register lhs = Operand(*comparison->lhs_);
+			if (auto constant = ConstantOf(*comparison->rhs_)) {
+				jumps.push_back(Emit({Opcode::JumpCompareConst, flags, lhs, Constant(std::move(*constant))}));
+			} else {
+				jumps.push_back(Emit({Opcode::JumpCompare, flags, lhs, Operand(*comparison->rhs_)}));
+			}
+		} else if (const auto* negation = As<ast::Not>(node)) {
+			Branch(*negation->argument_, !jump_when, jumps);
+		} else if (const auto* conjunction = As<ast::And>(node)) {
+			if (jump_when) {
+				vector<size_t> to_skip;
+				Branch(*conjunction->lhs_, false, to_skip);
+				Branch(*conjunction->rhs_, true, jumps);
+				Patch(to_skip);
+			} else {
+				Branch(*conjunction->lhs_, false, jumps);
+				Branch(*conjunction->rhs_, false, jumps);
+			}
+		} else if (const auto* disjunction = As<ast::Or>(node)) {
+			if (jump_when) {
+				Branch(*disjunction->lhs_, true, jumps);
+				Branch(*disjunction->rhs_, true, jumps);
+			} else {
+				vector<size_t> to_skip;
+				Branch(*disjunction->lhs_, true, to_skip);
+				Branch(*disjunction->rhs_, false, jumps);
+				Patch(to_skip);
+			}
+		} else {
+			const Register value = Operand(node);
+			jumps.push_back(Emit({jump_when ? Opcode::JumpIfTrue : Opcode::JumpIfFalse, 0, value}));
+		}
+	}
+
+	// ------------ statements
+
+	void CompileStatement(const Statement& node) {
+		if (const auto* compound = As<ast::Compound>(node)) {
+			for (const auto& statement : compound->compounds_) {
+				const Register temporaries = next_temporary_;
+				const Statement* enclosing = exchange(current_statement_, statement.get());
+				Emit({Opcode::Step});
+				CompileStatement(*statement);
+				current_statement_ = enclosing;
+				next_temporary_ = temporaries;
+			}
+		} else if (const auto* assignment = As<ast::Assignment>(node)) {
+			const Register local = locals_.at(assignment->var_);
+			CompileInto(*assignment->rv_, local);
+			bound_[local] = true;
+		} else if (const auto* field_assignment = As<ast::FieldAssignment>(node)) {
+			CompileFieldAssignment(*field_assignment);
+		} else if (const auto* subscript_assignment = As<ast::SubscriptAssignment>(node)) {
+			const Register object = Operand(*subscript_assignment->object_);
+			const Register index = Operand(*subscript_assignment->index_);
+			Emit({Opcode::SetItem, 0, object, index, Operand(*subscript_assignment->rv_)});
+		} else if (const auto* print = As<ast::Print>(node)) {
+			vector<Register> arguments;
+			for (const auto& argument : print->args_) {
+				arguments.push_back(Operand(*argument));
+			}
+			Emit({Opcode::Print, 0, 0, 0, CheckedIndex(arguments.size()), Operands(arguments)});
+		} else if (const auto* if_else = As<ast::IfElse>(node)) {
+			CompileIfElse(*if_else);
+		} else if (const auto* loop = As<ast::While>(node)) {
+			CompileWhile(*loop);
+		} else if (const auto* loop = As<ast::ForEach>(node)) {
+			CompileForEach(*loop);
+		} else if (As<ast::Break>(node) != nullptr) {
+			if (loops_.empty()) {
+				throw Unsupported{};
+			}
+			loops_.back().breaks.push_back(Emit({Opcode::Jump}));
+		} else if (As<ast::Continue>(node) != nullptr) {
+			if (loops_.empty()) {
+				throw Unsupported{};
+			}
+			Emit({Opcode::Jump, 0, 0, 0, 0, static_cast<uint32_t>(loops_.back().continue_target)});
+		} else if (const auto* return_statement = As<ast::Return>(node)) {
+			CompileReturn(*return_statement);
+		} else {
+			CompileInto(node, Temporary());
+		}
+	}
+
+	void CompileFieldAssignment(const ast::FieldAssignment& node) {
+		const auto& object = node.object_.ids_chain_;
+		// object.field = object.field + constant
+		const auto* add = As<ast::Add>(*node.rv_);
+		const auto* field = add != nullptr ? As<ast::VariableValue>(*add->lhs_) : nullptr;
+		if (object.size() == 1 && field != nullptr && field->ids_chain_.size() == 2
+			&& field->ids_chain_[0] == object[0] && field->ids_chain_[1] == node.field_name_) {
+			if (auto constant = ConstantOf(*add->rhs_)) {
+				if (auto local = ReadLocal(object[0], "Name "s + object[0] + " not found in the scope"s)) {
+					Emit({Opcode::FieldAddConst, 0, *local, Name(node.field_name_), Constant(std::move(*constant))});
+					return;
+				}
+			}
+		}
+		const Register target = Operand(node.object_);
+		// The tree walker checks the object before evaluating the value
+		if (MayRunCode(*node.rv_)) {
+			Emit({Opcode::CheckFieldTarget, 0, target});
+		}
+		Emit({Opcode::SetField, 0, target, Name(node.field_name_), Operand(*node.rv_)});
+	}
+
+	void CompileIfElse(const ast::IfElse& node) {
+		vector<size_t> to_else;
+		Branch(*node.condition_, false, to_else);
+		const vector<bool> before = bound_;
+		CompileStatement(*node.if_body_);
+		if (node.else_body_) {
+			const size_t to_end = Emit({Opcode::Jump});
+			const vector<bool> after_if = exchange(bound_, before);
+			Patch(to_else);
+			CompileStatement(*node.else_body_);
+			Patch({to_end});
+			Intersect(after_if);
+		} else {
+			Patch(to_else);
+			Intersect(before);
+		}
+	}
+
+	void CompileWhile(const ast::While& node) {
+		const uint32_t start = Here();
+		vector<size_t> to_exit;
+		Branch(*node.condition_, false, to_exit);
+		const vector<bool> before = bound_;
+		Emit({Opcode::CheckCancelled});
+		loops_.push_back({start, {}});
+		CompileStatement(*node.body_);
+		Emit({Opcode::Jump, 0, 0, 0, 0, start});
+		Patch(to_exit);
+		Patch(loops_.back().breaks);
+		loops_.pop_back();
+		bound_ = before;
+	}
+
+	void CompileForEach(const ast::ForEach& node) {
+		const Register list = Temporary();
+		CompileInto(*node.iterable_, list);
+		const uint16_t counter = code_->counter_count;
+		code_->counter_count = CheckedIndex(counter + 1U);
+		Emit({Opcode::ForPrepare, 0, list, counter});
+		const vector<bool> before = bound_;
+		const Register var = locals_.at(node.var_);
+		const size_t next = Emit({Opcode::ForNext, 0, list, counter, var});
+		bound_[var] = true;
+		Emit({Opcode::CheckCancelled});
+		loops_.push_back({next, {}});
+		CompileStatement(*node.body_);
+		Emit({Opcode::Jump, 0, 0, 0, 0, static_cast<uint32_t>(next)});
+		Patch({next});
+		Patch(loops_.back().breaks);
+		loops_.pop_back();
+		// The loop may run no iteration, which leaves the variable as it was before
+		bound_ = before;
+	}
+
+	void CompileReturn(const ast::Return& node) {
+		// Errors of the returned expression are reported at its position, as by MethodBody
+		const Statement* enclosing = exchange(current_statement_, node.statement_.get());
+		if (const auto* call = As<ast::MethodCall>(*node.statement_)) {
+			const auto [argument_count, operands] = CallOperands(*call);
+			if (call->IsBound()) {
+				Emit({Opcode::TailCallDirect, 0, 0, BoundCall(*call), argument_count, operands});
+			} else {
+				Emit({Opcode::TailCall, 0, 0, Name(call->method_), argument_count, operands});
+			}
+		} else {
+			Emit({Opcode::Return, 0, Operand(*node.statement_)});
+		}
+		current_statement_ = enclosing;
+	}
+
+	// Locals stay assigned after a branch only if both ways assign them
+	void Intersect(const vector<bool>& other) {
+		for (size_t i = 0; i < bound_.size(); ++i) {
+			bound_[i] = bound_[i] && other[i];
+		}
+	}
+
+	const ast::MethodBody& body_;
+	unique_ptr<Code> code_;
+	unordered_map<string, Register> locals_;
+	unordered_map<string, uint16_t> names_;
+	// Whether each local is assigned on every path reaching the code being compiled
+	vector<bool> bound_;
+	Register next_temporary_ = 0;
+	vector<Loop> loops_;
+	const Statement* current_statement_ = nullptr;
+	optional<uint16_t> true_constant_;
+	optional<uint16_t> false_constant_;
+};
+
+unique_ptr<Code> Compile(const ast::MethodBody& body, const vector<string>& formal_params) {
+	return Compiler(body, formal_params).Compile();
+}
+
+}  // namespace vm
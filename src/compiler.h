@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ast {
+class MethodBody;
+}
+
+namespace vm {
+
+struct Code;
+
+// Compiles the body of a method taking formal_params to register bytecode. Returns nullptr when
+// the body holds statements the bytecode does not support; such methods keep walking their trees
+std::unique_ptr<Code> Compile(const ast::MethodBody& body, const std::vector<std::string>& formal_params);
+
+}  // namespace vm
@@ -0,0 +1,60 @@
+#include "frame_stack.h"
+
+#include <algorithm>
+
+namespace runtime {
+
+FrameStack& FrameStack::Current() {
+	thread_local FrameStack stack;
+	return stack;
+}
+
+size_t FrameStack::GetCapacity() const {
+	size_t capacity = 0;
+	for (const Block& block : blocks_) {
+		capacity += block.size;
+	}
+	return capacity;
+}
+
+bool FrameStack::IsEmpty() const {
+	return block_ == 0 && top_ == 0;
+}
+
+ObjectHolder* FrameStack::AllocateInNextBlock(size_t size) {
+	size_t next = 0;
+	if (!blocks_.empty()) {
+		blocks_[block_].used = top_;
+		next = block_ + 1;
+	}
+	if (next == blocks_.size()) {
+		blocks_.emplace_back();
+	}
+	// The blocks above the top are empty, a small one is replaced
+	Block& block = blocks_[next];
+	if (block.size < size) {
+		block.size = std::max(size, BLOCK_SIZE);
+		block.slots = std::make_unique<ObjectHolder[]>(block.size);
+	}
+	block_ = next;
+	top_ = size;
+	return block.slots.get();
+}
+
+void FrameStack::Release(size_t block, size_t top) noexcept {
+	while (block_ != block || top_ != top) {
+		ObjectHolder* slots = blocks_[block_].slots.get();
+		const size_t begin = block_ == block ? top : 0;
+		for (size_t i = begin; i < top_; ++i) {
+			slots[i] = ObjectHolder();
+		}
+		if (block_ == block) {
+			top_ = top;
+		} else {
+			--block_;
+			top_ = blocks_[block_].used;
+		}
+	}
+}
+
+}  // namespace runtime
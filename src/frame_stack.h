@@ -0,0 +1,73 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace runtime {
+
+// The registers and the arguments of the method calls of the current thread. Slots are carved
+// out of large blocks and released in the reverse order; the blocks stay for the next calls, so
+// once the stack has grown to the depth of the program a call allocates nothing
+class FrameStack {
+public:
+	static FrameStack& Current();
+
+	// Everything allocated while a scope lives is released with it, the slots become None again
+	class Scope {
+	public:
+		explicit Scope(FrameStack& stack) noexcept
+			: stack_(stack), block_(stack.block_), top_(stack.top_) {
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		~Scope() {
+			stack_.Release(block_, top_);
+		}
+
+	private:
+		FrameStack& stack_;
+		size_t block_;
+		size_t top_;
+	};
+
+	FrameStack() = default;
+	FrameStack(const FrameStack&) = delete;
+	FrameStack& operator=(const FrameStack&) = delete;
+
+	// Returns size contiguous slots holding None, valid until the innermost scope ends
+	[[nodiscard]] ObjectHolder* Allocate(size_t size) {
+		if (block_ < blocks_.size() && top_ + size <= blocks_[block_].size) {
+			ObjectHolder* slots = blocks_[block_].slots.get() + top_;
+			top_ += size;
+			return slots;
+		}
+		return AllocateInNextBlock(size);
+	}
+
+	// The slots in all blocks, grows with the deepest recursion only
+	[[nodiscard]] size_t GetCapacity() const;
+	[[nodiscard]] bool IsEmpty() const;
+
+private:
+	static constexpr size_t BLOCK_SIZE = 4096;
+
+	struct Block {
+		std::unique_ptr<ObjectHolder[]> slots;
+		size_t size = 0;
+		// The top of the block when a frame too large for the rest went to the next one
+		size_t used = 0;
+	};
+
+	ObjectHolder* AllocateInNextBlock(size_t size);
+	void Release(size_t block, size_t top) noexcept;
+
+	std::vector<Block> blocks_;
+	// The first free slot is blocks_[block_].slots[top_]
+	size_t block_ = 0;
+	size_t top_ = 0;
+};
+
+}  // namespace runtime
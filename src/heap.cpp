@@ -0,0 +1,285 @@
+#include "heap.h"
+
+#include "runtime.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+template <typename Func>
+class ReferenceLambdaVisitor : public ReferenceVisitor {
+public:
+	explicit ReferenceLambdaVisitor(Func func)
+		: func_(std::move(func)) {
+	}
+
+	void Visit(const ObjectHolder& reference) override {
+		// None and Numbers refer to no object
+		if (Object* object = reference.Get()) {
+			func_(object);
+		}
+	}
+
+private:
+	Func func_;
+};
+
+}  // namespace
+
+// Objects that can not take part in a cycle are skipped: they are released in the usual way
+// together with their owners
+template <typename Func>
+void Heap::ForEachCollectableChild(Object& object, Func func) {
+	ReferenceLambdaVisitor visitor([&func](Object* child) {
+		if (child->cycle_tracked_ && child->heap_allocated_) {
+			func(child);
+		}
+	});
+	object.VisitReferences(visitor);
+}
+
+Heap& Heap::Current() {
+	thread_local Heap heap;
+	return heap;
+}
+
+Heap::~Heap() {
+	Collect();
+}
+
+const HeapStats& Heap::GetStats() const {
+	return stats_;
+}
+
+const CollectorOptions& Heap::GetOptions() const {
+	return options_;
+}
+
+void Heap::SetOptions(const CollectorOptions& options) {
+	options_ = options;
+}
+
+void Heap::Collect() {
+	Collect(roots_.size());
+}
+
+void Heap::CollectStep() {
+	Collect(options_.max_roots_per_step == 0 ? roots_.size() : options_.max_roots_per_step);
+}
+
+void Heap::SetByteLimit(size_t limit) {
+	byte_limit_ = limit;
+}
+
+size_t Heap::GetByteLimit() const {
+	return byte_limit_;
+}
+
+void Heap::OnAllocate(size_t bytes) {
+	if (byte_limit_ != 0 && stats_.live_bytes + bytes > byte_limit_) {
+		OnByteLimit(bytes);
+	}
+	++stats_.live_objects;
+	++stats_.total_allocations;
+	stats_.live_bytes += bytes;
+}
+
+void Heap::OnDeallocate(size_t bytes) {
+	--stats_.live_objects;
+	stats_.live_bytes -= bytes;
+}
+
+void Heap::OnExternalAllocate(size_t bytes) {
+	if (byte_limit_ != 0 && stats_.live_bytes + bytes > byte_limit_) {
+		OnByteLimit(bytes);
+	}
+	stats_.live_bytes += bytes;
+}
+
+void Heap::OnExternalDeallocate(size_t bytes) {
+	stats_.live_bytes -= bytes;
+}
+
+void Heap::OnByteLimit(size_t bytes) {
+	throw LimitExceeded("Heap limit exceeded: "s + to_string(stats_.live_bytes) + " live bytes, "s
+						+ to_string(bytes) + " more requested, at most "s + to_string(byte_limit_) + " allowed"s);
+}
+
+void Heap::AddPossibleRoot(Object* object) {
+	if (object->gc_color_ == GcColor::Garbage) {
+		return;
+	}
+	object->gc_color_ = GcColor::Purple;
+	if (!object->gc_buffered_) {
+		object->gc_buffered_ = true;
+		roots_.push_back(object);
+	}
+}
+
+void Heap::ReleaseLast(Object* object) {
+	object->gc_color_ = GcColor::Black;
+	if (!object->gc_buffered_) {
+		delete object;
+		return;
+	}
+	// The buffer still points to the object, so only its references are released now
+	// and the empty shell is freed by the collector when it drops the object from the buffer
+	object->ClearReferences();
+}
+
+void Heap::Collect(size_t max_roots) {
+	if (collecting_ || roots_.empty()) {
+		return;
+	}
+	collecting_ = true;
+	const auto start = chrono::steady_clock::now();
+
+	max_roots = std::min(max_roots, roots_.size());
+	vector<Object*> roots(roots_.begin(), roots_.begin() + max_roots);
+	roots_.erase(roots_.begin(), roots_.begin() + max_roots);
+
+	// Mark roots: trial deletion of the references inside the subgraphs of live roots
+	auto live_end = std::partition(roots.begin(), roots.end(), [](Object* root) {
+		return root->gc_color_ == GcColor::Purple && root->ref_count_ > 0;
+	});
+	for (auto it = live_end; it != roots.end(); ++it) {
+		(*it)->gc_buffered_ = false;
+		if ((*it)->ref_count_ == 0) {
+			delete *it;
+		}
+	}
+	roots.erase(live_end, roots.end());
+	for (Object* root : roots) {
+		MarkGray(root);
+	}
+
+	// Scan: whatever is still referenced from outside is alive together with its subgraph
+	for (Object* root : roots) {
+		Scan(root);
+	}
+
+	// Collect: the rest are garbage cycles
+	vector<Object*> garbage;
+	for (Object* root : roots) {
+		root->gc_buffered_ = false;
+		GatherWhite(root, garbage);
+	}
+	FreeGarbage(garbage);
+
+	const auto pause = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+	++stats_.collections;
+	stats_.collected_objects += garbage.size();
+	stats_.last_pause = pause;
+	stats_.max_pause = std::max(stats_.max_pause, pause);
+	stats_.total_pause += pause;
+	collecting_ = false;
+}
+
+// The graph walks use an explicit stack, as linked structures may be much deeper than the
+// native one
+
+void Heap::MarkGray(Object* root) {
+	if (root->gc_color_ == GcColor::Gray) {
+		return;
+	}
+	root->gc_color_ = GcColor::Gray;
+	work_stack_.push_back(root);
+	while (!work_stack_.empty()) {
+		Object* object = work_stack_.back();
+		work_stack_.pop_back();
+		ForEachCollectableChild(*object, [this](Object* child) {
+			--child->ref_count_;
+			if (child->gc_color_ != GcColor::Gray) {
+				child->gc_color_ = GcColor::Gray;
+				work_stack_.push_back(child);
+			}
+		});
+	}
+}
+
+void Heap::Scan(Object* root) {
+	work_stack_.push_back(root);
+	while (!work_stack_.empty()) {
+		Object* object = work_stack_.back();
+		work_stack_.pop_back();
+		if (object->gc_color_ != GcColor::Gray) {
+			continue;
+		}
+		if (object->ref_count_ > 0) {
+			ScanBlack(object);
+			continue;
+		}
+		object->gc_color_ = GcColor::White;
+		ForEachCollectableChild(*object, [this](Object* child) {
+			if (child->gc_color_ == GcColor::Gray) {
+				work_stack_.push_back(child);
+			}
+		});
+	}
+}
+
+void Heap::ScanBlack(Object* root) {
+	// Scan keeps its pending objects below this mark
+	const size_t bottom = work_stack_.size();
+	root->gc_color_ = GcColor::Black;
+	work_stack_.push_back(root);
+	while (work_stack_.size() > bottom) {
+		Object* object = work_stack_.back();
+		work_stack_.pop_back();
+		ForEachCollectableChild(*object, [this](Object* child) {
+			++child->ref_count_;
+			if (child->gc_color_ != GcColor::Black) {
+				child->gc_color_ = GcColor::Black;
+				work_stack_.push_back(child);
+			}
+		});
+	}
+}
+
+void Heap::GatherWhite(Object* root, vector<Object*>& garbage) {
+	if (root->gc_color_ != GcColor::White) {
+		return;
+	}
+	root->gc_color_ = GcColor::Garbage;
+	work_stack_.push_back(root);
+	while (!work_stack_.empty()) {
+		Object* object = work_stack_.back();
+		work_stack_.pop_back();
+		garbage.push_back(object);
+		ForEachCollectableChild(*object, [this](Object* child) {
+			if (child->gc_color_ == GcColor::White) {
+				child->gc_color_ = GcColor::Garbage;
+				work_stack_.push_back(child);
+			}
+		});
+	}
+}
+
+void Heap::FreeGarbage(const vector<Object*>& garbage) {
+	// Give back the references removed by the trial deletion and pin the garbage,
+	// so that breaking the cycles below does not free an object twice
+	for (Object* object : garbage) {
+		ForEachCollectableChild(*object, [](Object* child) {
+			++child->ref_count_;
+		});
+	}
+	for (Object* object : garbage) {
+		++object->ref_count_;
+	}
+	for (Object* object : garbage) {
+		object->ClearReferences();
+	}
+	for (Object* object : garbage) {
+		if (--object->ref_count_ == 0) {
+			ReleaseLast(object);
+		} else {
+			object->gc_color_ = GcColor::Black;
+		}
+	}
+}
+
+}  // namespace runtime
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace runtime {
+
+class Object;
+
+enum class GcColor : uint8_t {
+	Black,    // in use or free
+	Gray,     // possible member of a cycle
+	White,    // member of a garbage cycle
+	Purple,   // possible root of a cycle
+	Garbage,  // being freed by the collector
+};
+
+struct HeapStats {
+	size_t live_objects = 0;
+	size_t live_bytes = 0;  // the objects and the memory they hold apart, like string contents
+	size_t total_allocations = 0;
+	size_t collections = 0;
+	size_t collected_objects = 0;
+	std::chrono::nanoseconds last_pause{0};
+	std::chrono::nanoseconds max_pause{0};
+	std::chrono::nanoseconds total_pause{0};
+};
+
+struct CollectorOptions {
+	bool enabled = true;
+	// A collection step starts at a safe point once so many possible cycle roots are buffered
+	size_t root_threshold = 1000;
+	// Upper bound of roots examined by one step, 0 means the whole buffer
+	size_t max_roots_per_step = 0;
+};
+
+// Owns the bookkeeping of interpreter objects of the current thread: allocation statistics and
+// the synchronous cycle collector (trial deletion by Bacon and Rajan). Reference counting frees
+// acyclic garbage immediately; objects whose counter drops to a non-zero value are buffered as
+// possible roots of garbage cycles and examined later.
+class Heap {
+public:
+	static Heap& Current();
+
+	Heap() = default;
+	Heap(const Heap&) = delete;
+	Heap& operator=(const Heap&) = delete;
+	~Heap();
+
+	[[nodiscard]] const HeapStats& GetStats() const;
+	[[nodiscard]] const CollectorOptions& GetOptions() const;
+	void SetOptions(const CollectorOptions& options);
+
+	// Examines every buffered root and frees all garbage cycles found
+	void Collect();
+	// Examines at most max_roots_per_step buffered roots
+	void CollectStep();
+	// Called by the interpreter where no raw object pointers are in flight
+	void MaybeCollect() {
+		if (options_.enabled && roots_.size() >= options_.root_threshold) {
+			CollectStep();
+		}
+	}
+
+	// Allocations that would take the live bytes over the limit throw LimitExceeded;
+	// zero removes the limit
+	void SetByteLimit(size_t limit);
+	[[nodiscard]] size_t GetByteLimit() const;
+
+	void OnAllocate(size_t bytes);
+	void OnDeallocate(size_t bytes);
+	// Memory an object holds apart from itself, like the characters of a string
+	void OnExternalAllocate(size_t bytes);
+	void OnExternalDeallocate(size_t bytes);
+	// The reference counter of a cycle tracked object dropped but did not reach zero
+	void AddPossibleRoot(Object* object);
+	// The reference counter reached zero
+	void ReleaseLast(Object* object);
+
+private:
+	template <typename Func>
+	static void ForEachCollectableChild(Object& object, Func func);
+
+	void Collect(size_t max_roots);
+	void MarkGray(Object* root);
+	void Scan(Object* root);
+	void ScanBlack(Object* root);
+	void GatherWhite(Object* root, std::vector<Object*>& garbage);
+	void FreeGarbage(const std::vector<Object*>& garbage);
+
+	[[noreturn]] void OnByteLimit(size_t bytes);
+
+	HeapStats stats_;
+	CollectorOptions options_;
+	size_t byte_limit_ = 0;
+	std::vector<Object*> roots_;
+	std::vector<Object*> work_stack_;
+	bool collecting_ = false;
+};
+
+}  // namespace runtime
@@ -53,6 +53,11 @@ std::ostream& operator<<(std::ostream& os, const Token& rhs) {
 	UNVALUED_OUTPUT(Return);
 	UNVALUED_OUTPUT(If);
 	UNVALUED_OUTPUT(Else);
+	UNVALUED_OUTPUT(While);
+	UNVALUED_OUTPUT(For);
+	UNVALUED_OUTPUT(In);
+	UNVALUED_OUTPUT(Break);
+	UNVALUED_OUTPUT(Continue);
 	UNVALUED_OUTPUT(Def);
 	UNVALUED_OUTPUT(Newline);
 	UNVALUED_OUTPUT(Print);
@@ -75,6 +80,87 @@ std::ostream& operator<<(std::ostream& os, const Token& rhs) {
 	return os << "Unknown token :("sv;
 }
 
+std::string ToString(const Token& token) {
+	std::ostringstream out;
+	out << token;
+	return out.str();
+}
+
+LexerError::LexerError(const std::string& message, SourcePosition position)
+	: std::runtime_error(ToString(position) + ": "s + message)
+	, position_(position) {
+}
+
+std::optional<SourcePosition> LexerError::GetPosition() const {
+	return position_;
+}
+
+SourceReader::SourceReader(std::istream& input)
+	: text_(istreambuf_iterator<char>(input), istreambuf_iterator<char>()) {
+	line_starts_.push_back(0);
+	for (size_t i = text_.find('\n'); i != std::string::npos; i = text_.find('\n', i + 1)) {
+		line_starts_.push_back(i + 1);
+	}
+}
+
+char SourceReader::Get() {
+	if (offset_ < text_.size()) {
+		return text_[offset_++];
+	}
+	at_end_ = true;
+	return '\0';
+}
+
+char SourceReader::Peek() {
+	if (offset_ < text_.size()) {
+		return text_[offset_];
+	}
+	at_end_ = true;
+	return '\0';
+}
+
+void SourceReader::Unget() {
+	if (offset_ > 0) {
+		--offset_;
+		at_end_ = false;
+	}
+}
+
+bool SourceReader::AtEnd() const {
+	return at_end_;
+}
+
+void SourceReader::SkipLine() {
+	const size_t line_end = text_.find('\n', offset_);
+	if (line_end == std::string::npos) {
+		offset_ = text_.size();
+		at_end_ = true;
+	} else {
+		offset_ = line_end + 1;
+	}
+}
+
+std::string_view SourceReader::Rest() const {
+	return std::string_view(text_).substr(offset_);
+}
+
+void SourceReader::Skip(size_t count) {
+	offset_ = std::min(offset_ + count, text_.size());
+}
+
+size_t SourceReader::Offset() const {
+	return offset_;
+}
+
+SourcePosition SourceReader::PositionOf(size_t offset) const {
+	offset = std::min(offset, text_.size());
+	const auto next_line = std::upper_bound(line_starts_.begin(), line_starts_.end(), offset);
+	SourcePosition position;
+	position.line = static_cast<uint32_t>(next_line - line_starts_.begin());
+	position.column = static_cast<uint32_t>(offset - *(next_line - 1) + 1);
+	return position;
+}
+
 Lexer::Lexer(std::istream& input) : input_(input) {
 	MakeTokens();
 }
@@ -87,6 +173,18 @@ const Token& Lexer::CurrentToken() const {
 	}
 }
 
+SourcePosition Lexer::CurrentPosition() const {
+	if (token_offsets_.empty()) {
+		return {};
+	}
+	return input_.PositionOf(token_offsets_[current_token_id_]);
+}
+
+void Lexer::AddToken(Token token) {
+	lexemes_.push_back(std::move(token));
+	token_offsets_.push_back(static_cast<uint32_t>(token_begin_));
+}
+
 Token Lexer::NextToken() {
 	if (current_token_id_ < lexemes_.size() - 1) {
 		++current_token_id_;
@@ -101,45 +199,55 @@ inline bool Lexer::СharIsLettersOrNumbers(const char current_char) {
 void Lexer::DefineCommandOrID(char& current_char) {
 	std::string result_str;
 	result_str += current_char;
-	while (!input_.eof() && (input_.peek() == '_' || СharIsLettersOrNumbers(input_.peek()))){
-		result_str += input_.get();
+	while (!input_.AtEnd() && (input_.Peek() == '_' || СharIsLettersOrNumbers(input_.Peek()))){
+		result_str += input_.Get();
 	}
 	if (!CheckKeyWords(result_str)) {
 		token_type::Id id;
 		id.value = std::move(result_str);
-		lexemes_.push_back(std::move(id));
+		AddToken(std::move(id));
 	}
 }
 
 bool Lexer::CheckKeyWords(std::string_view def_str) {
 	using namespace std::literals;
-	if (def_str.size() > 6) {
+	if (def_str.size() > 8) {
 		return false;
 	}
 	if (def_str == "class"sv) {
-		lexemes_.push_back(token_type::Class());
+		AddToken(token_type::Class());
 	} else if (def_str == "return"sv) {
-		lexemes_.push_back(token_type::Return());
+		AddToken(token_type::Return());
 	} else if (def_str == "if"sv) {
-		lexemes_.push_back(token_type::If());
+		AddToken(token_type::If());
 	} else if (def_str == "else"sv) {
-		lexemes_.push_back(token_type::Else());
+		AddToken(token_type::Else());
+	} else if (def_str == "while"sv) {
+		AddToken(token_type::While());
+	} else if (def_str == "for"sv) {
+		AddToken(token_type::For());
+	} else if (def_str == "in"sv) {
+		AddToken(token_type::In());
+	} else if (def_str == "break"sv) {
+		AddToken(token_type::Break());
+	} else if (def_str == "continue"sv) {
+		AddToken(token_type::Continue());
 	} else if (def_str == "def"sv) {
-		lexemes_.push_back(token_type::Def());
+		AddToken(token_type::Def());
 	} else if (def_str == "print"sv) {
-		lexemes_.push_back(token_type::Print());
+		AddToken(token_type::Print());
 	} else if (def_str == "or"sv) {
-		lexemes_.push_back(token_type::Or());
+		AddToken(token_type::Or());
 	} else if (def_str == "None"sv) {
-		lexemes_.push_back(token_type::None());
+		AddToken(token_type::None());
 	} else if (def_str == "and"sv) {
-		lexemes_.push_back(token_type::And());
+		AddToken(token_type::And());
 	} else if (def_str == "not"sv) {
-		lexemes_.push_back(token_type::Not());
+		AddToken(token_type::Not());
 	} else if (def_str == "True"sv) {
-		lexemes_.push_back(token_type::True());
+		AddToken(token_type::True());
 	} else if (def_str == "False"sv) {
-		lexemes_.push_back(token_type::False());
+		AddToken(token_type::False());
 	} else {
 		return false;
 	}
@@ -151,12 +259,13 @@ inline void RepeatIndetation(int count, T type);
 
 void Lexer::DefineIndetations(char& current_char) {
 	size_t counter = 0;
-	while (!input_.eof() && current_char == ' ') {
-		current_char = input_.get();
+	while (!input_.AtEnd() && current_char == ' ') {
+		current_char = input_.Get();
 		++counter;
 	}
 	counter /= 2;
-	if (!(current_char == '\n' || current_char == '\r') || input_.eof()) {
+	// Lines holding only a comment do not change the indentation, like the empty ones
+	if (!(current_char == '\n' || current_char == '\r' || current_char == '#') || input_.AtEnd()) {
 		if (counter > indetation_counter_) {
 			RepeatIndetation(counter - indetation_counter_, token_type::Indent());
 			indetation_counter_ = counter;
@@ -168,95 +277,113 @@ void Lexer::DefineIndetations(char& current_char) {
 }
 
 void Lexer::DefineCharacter(char& current_char) {
-	if (current_char == '>' && input_.peek() == '=') {
-		current_char = input_.get();
-		lexemes_.push_back(token_type::GreaterOrEq());
-	} else if (current_char == '<' && input_.peek() == '=') {
-		current_char = input_.get();
-		lexemes_.push_back(token_type::LessOrEq());
-	} else if (current_char == '=' && input_.peek() == '=') {
-		current_char = input_.get();
-		lexemes_.push_back(token_type::Eq());
-	} else if (current_char == '!' && input_.peek() == '=') {
-		current_char = input_.get();
-		lexemes_.push_back(token_type::NotEq());
+	if (current_char == '>' && input_.Peek() == '=') {
+		current_char = input_.Get();
+		AddToken(token_type::GreaterOrEq());
+	} else if (current_char == '<' && input_.Peek() == '=') {
+		current_char = input_.Get();
+		AddToken(token_type::LessOrEq());
+	} else if (current_char == '=' && input_.Peek() == '=') {
+		current_char = input_.Get();
+		AddToken(token_type::Eq());
+	} else if (current_char == '!' && input_.Peek() == '=') {
+		current_char = input_.Get();
+		AddToken(token_type::NotEq());
 	} else if (current_char == '\n' && current_char != '\r' ) {
 		if (!lexemes_.empty() && !lexemes_.back().Is<token_type::Newline>() && !lexemes_.back().Is<token_type::Dedent>()) {
-			lexemes_.push_back(token_type::Newline());
+			AddToken(token_type::Newline());
 		}
 	} else if (current_char != ' ') {
 		token_type::Char char_token;
 		char_token.value = current_char;
-		lexemes_.push_back(char_token);
+		AddToken(char_token);
 	}
 }
 
+void Lexer::DefineNumber() {
+	const std::string_view digits = input_.Rest();
+	token_type::Number number_token{};
+	const auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), number_token.value);
+	if (error == std::errc::result_out_of_range) {
+		throw LexerError("Integer literal is out of range"s, input_.PositionOf(input_.Offset()));
+	}
+	input_.Skip(static_cast<size_t>(end - digits.data()));
+	AddToken(number_token);
+}
+
 void Lexer::IgnoreComment() {
-	std::string comment_txt;
-	std::getline(input_, comment_txt);
+	input_.SkipLine();
 	if (!lexemes_.empty() && !(lexemes_.back().Is<token_type::Newline>() || lexemes_.back().Is<token_type::Dedent>())) {
-		lexemes_.push_back(token_type::Newline());
+		AddToken(token_type::Newline());
 	}
 }
 
 inline void Lexer::DefineScreenedCharacter(char& current_char) { // определить экранированный символ
-	char next_char = input_.peek();
+	char next_char = input_.Peek();
 	if (next_char == '\'') {
-		current_char = input_.get();
+		current_char = input_.Get();
 	} else if (next_char == '\"') {
-		current_char = input_.get();
+		current_char = input_.Get();
 	} else if (next_char == 'n') {
-		input_.get();
+		input_.Get();
 		current_char = '\n';
 	}  else if (next_char == 't') {
-		input_.get();
+		input_.Get();
 		current_char = '\t';
 	}
 }
 
 void Lexer::MakeTokens() {
-	while (!input_.eof()) {
-		char defining_char(input_.get());
+	// Typical programs have a token per four to six characters; growing the vector of tokens
+	// step by step costs more than the spare capacity
+	lexemes_.reserve(input_.Rest().size() / 4 + 1);
+	token_offsets_.reserve(lexemes_.capacity());
+	while (!input_.AtEnd()) {
+		char defining_char(input_.Get());
+		token_begin_ = input_.AtEnd() ? input_.Offset() : input_.Offset() - 1;
 		if ((!lexemes_.empty() && lexemes_.back().Is<token_type::Newline>()) ) { // Отступы
 			DefineIndetations(defining_char);
+			token_begin_ = input_.AtEnd() ? input_.Offset() : input_.Offset() - 1;
 		}
 		if (defining_char == '_' || (96 < defining_char && defining_char < 123) || (64 < defining_char && defining_char < 91)) { // Идентификаторы и ключевые слова
 			DefineCommandOrID(defining_char);
 			continue;
 		}
 		if (47 < defining_char && defining_char < 58) { // Цифры
-			input_.putback(defining_char);
-			token_type::Number number_token;
-			input_ >> number_token.value;
-			lexemes_.push_back(number_token);
+			input_.Unget();
+			DefineNumber();
 			continue;
 		}
 		if (defining_char == '\'' || defining_char == '\"' ) { // Строки
 			token_type::String string_token;
 			char quotation_marks_type(defining_char);
-			defining_char = input_.get();
+			const size_t string_begin = input_.Offset() - 1;
+			defining_char = input_.Get();
 			while ( defining_char != quotation_marks_type) {
-				if (!input_.eof() && defining_char == '\\') {
+				if (input_.AtEnd()) {
+					throw LexerError("Unterminated string literal"s, input_.PositionOf(string_begin));
+				}
+				if (!input_.AtEnd() && defining_char == '\\') {
 					DefineScreenedCharacter(defining_char);
 				}
 				string_token.value += defining_char;
-				defining_char = input_.get();
+				defining_char = input_.Get();
 			}
-			lexemes_.push_back(std::move(string_token));
+			AddToken(std::move(string_token));
 			continue;
 		}
 		if (defining_char == '#') { // Комментарии
 			IgnoreComment();
 			continue;
 		}
-		if (!input_.eof()) {
+		if (!input_.AtEnd()) {
 			DefineCharacter(defining_char); // Отдельные знаки
 		}
 	}
 	if (!lexemes_.empty() && !(lexemes_.back().Is<token_type::Newline>() || lexemes_.back().Is<token_type::Dedent>())) {
-		lexemes_.push_back(token_type::Newline());
+		AddToken(token_type::Newline());
 	}
-	lexemes_.push_back(token_type::Eof());
+	AddToken(token_type::Eof());
 }
 
 }  // namespace parse
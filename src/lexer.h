@@ -1,5 +1,8 @@
 #pragma once
 
+#include "source_position.h"
+
+#include <cstdint>
 #include <iosfwd>
 #include <iostream>
 #include <optional>
@@ -15,7 +18,7 @@ namespace parse {
 namespace token_type {
 
 struct Number {
-	int value;
+	int64_t value;
 };
 
 struct Id {
@@ -34,6 +37,11 @@ struct Class {};
 struct Return {};
 struct If {};
 struct Else {};
+struct While {};
+struct For {};
+struct In {};
+struct Break {};
+struct Continue {};
 struct Def {};
 struct Newline {};
 struct Print {};
@@ -56,7 +64,8 @@ struct False {};
 using TokenBase
 	= std::variant<token_type::Number, token_type::Id, token_type::Char, token_type::String,
 				   token_type::Class, token_type::Return, token_type::If, token_type::Else,
-				   token_type::Def, token_type::Newline, token_type::Print, token_type::Indent,
+				   token_type::While, token_type::For, token_type::In, token_type::Break,
+				   token_type::Continue, token_type::Def, token_type::Newline, token_type::Print, token_type::Indent,
 				   token_type::Dedent, token_type::And, token_type::Or, token_type::Not,
 				   token_type::Eq, token_type::NotEq, token_type::LessOrEq, token_type::GreaterOrEq,
 				   token_type::None, token_type::True, token_type::False, token_type::Eof>;
@@ -84,10 +93,42 @@ bool operator==(const Token& lhs, const Token& rhs);
 bool operator!=(const Token& lhs, const Token& rhs);
 
 std::ostream& operator<<(std::ostream& os, const Token& rhs);
+std::string ToString(const Token& token);
 
 class LexerError : public std::runtime_error {
 public:
 	using std::runtime_error::runtime_error;
+	LexerError(const std::string& message, SourcePosition position);
+
+	[[nodiscard]] std::optional<SourcePosition> GetPosition() const;
+private:
+	std::optional<SourcePosition> position_;
+};
+
+// The whole program text and the read position in it, so that the lexer scans the characters
+// in memory instead of extracting them from the stream one by one
+class SourceReader {
+public:
+	explicit SourceReader(std::istream& input);
+
+	// Past the end of the text both give '\0' and AtEnd() becomes true, as eof() of a stream does
+	char Get();
+	char Peek();
+	void Unget();
+	[[nodiscard]] bool AtEnd() const;
+	// Skips the rest of the current line together with its line break
+	void SkipLine();
+
+	// The text from the read position on
+	[[nodiscard]] std::string_view Rest() const;
+	void Skip(size_t count);
+	[[nodiscard]] size_t Offset() const;
+	[[nodiscard]] SourcePosition PositionOf(size_t offset) const;
+private:
+	std::string text_;
+	std::vector<size_t> line_starts_;
+	size_t offset_ = 0;
+	bool at_end_ = false;
 };
 
 class Lexer {
@@ -95,6 +136,8 @@ public:
 	explicit Lexer(std::istream& input);
 
 	[[nodiscard]] const Token& CurrentToken() const;
+	// Where the current token starts
+	[[nodiscard]] SourcePosition CurrentPosition() const;
 	Token NextToken();
 
 	template <typename T>
@@ -110,12 +153,17 @@ public:
 	void ExpectNext(const U& value);
 
 private:
-	std::istream& input_;
+	SourceReader input_;
 	std::vector<Token> lexemes_;
+	// Parallel to lexemes_: the offsets of the tokens in the text
+	std::vector<uint32_t> token_offsets_;
+	size_t token_begin_ = 0;
 	size_t indetation_counter_ = 0;
 	size_t current_token_id_ = 0;
 
+	void AddToken(Token token);
 	void MakeTokens();
+	void DefineNumber();
 
 	template <typename T>
 	inline void RepeatIndetation(int count, T type);
@@ -134,7 +182,7 @@ const T& Lexer::Expect() const {
 	if (CurrentToken().Is<T>()) {
 		return CurrentToken().As<T>();
 	} else {
-		throw LexerError("Not implemented"s);
+		throw LexerError("Unexpected token "s + ToString(CurrentToken()), CurrentPosition());
 	}
 }
 
@@ -142,7 +190,7 @@ template <typename T, typename U>
 void Lexer::Expect(const U& value) const {
 	using namespace std::literals;
 	if ( !(CurrentToken().Is<T>() && CurrentToken().As<T>().value == value)) {
-		throw LexerError("Not implemented"s);
+		throw LexerError("Unexpected token "s + ToString(CurrentToken()), CurrentPosition());
 	}
 }
 
@@ -163,7 +211,7 @@ void Lexer::ExpectNext(const U& value) {
 template <typename T>
 inline void Lexer::RepeatIndetation(int count, T type) {
 	for (; count > 0; --count) {
-		lexemes_.push_back(type);
+		AddToken(type);
 	}
 }
 
@@ -39,6 +39,19 @@ void TestKeywords() {
 	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::False{}));
 }
 
+void TestLoopKeywords() {
+	istringstream input("while for in break continue While continued"s);
+	Lexer lexer(input);
+
+	ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::While{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::For{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::In{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Break{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Continue{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"While"s}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"continued"s}));
+}
+
 void TestNumbers() {
 	istringstream input("42 15 -53"s);
 	Lexer lexer(input);
@@ -50,6 +63,70 @@ void TestNumbers() {
 	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{53}));
 }
 
+void TestNumberLimits() {
+	istringstream input("x = 9223372036854775807 0017\ny = [1,2]\n"s);
+	Lexer lexer(input);
+
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{9223372036854775807}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{17}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'['}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{1}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{2}));
+
+	istringstream too_big("x = 1\ny = 9223372036854775808\n"s);
+	try {
+		Lexer failing(too_big);
+		ASSERT(false);
+	} catch (const LexerError& e) {
+		ASSERT(e.GetPosition().has_value());
+		ASSERT_EQUAL(e.GetPosition()->line, 2U);
+		ASSERT_EQUAL(e.GetPosition()->column, 5U);
+	}
+
+	istringstream unterminated("x = 'abc\n"s);
+	ASSERT_THROWS(Lexer{unterminated}, LexerError);
+}
+
+void TestTokenPositions() {
+	istringstream input("x = 1\nif x:\n  print  'a'\n"s);
+	Lexer lexer(input);
+
+	auto position_is = [&lexer](uint32_t line, uint32_t column) {
+		ASSERT_EQUAL(lexer.CurrentPosition().line, line);
+		ASSERT_EQUAL(lexer.CurrentPosition().column, column);
+	};
+	position_is(1, 1);
+	lexer.NextToken();
+	position_is(1, 3);
+	lexer.NextToken();
+	position_is(1, 5);
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::If{}));
+	position_is(2, 1);
+	lexer.NextToken();
+	position_is(2, 4);
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
+	position_is(3, 3);
+	ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"a"s}));
+	position_is(3, 10);
+
+	try {
+		lexer.Expect<token_type::Id>();
+		ASSERT(false);
+	} catch (const LexerError& e) {
+		ASSERT_EQUAL(e.GetPosition()->line, 3U);
+		ASSERT_EQUAL(string(e.what()), "line 3, column 10: Unexpected token String{a}"s);
+	}
+}
+
 void TestIds() {
 	istringstream input("x    _42 big_number   Return Class  dEf"s);
 	Lexer lexer(input);
@@ -349,13 +426,34 @@ abc#
 		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
 		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
 	}
+	{
+		istringstream is(R"(if x:
+  # comment
+      # a comment at any indentation
+  y
+)"s);
+
+		Lexer lexer(is);
+		ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::If{}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
+		ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+	}
 }
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
 	RUN_TEST(tr, parse::TestSimpleAssignment);
 	RUN_TEST(tr, parse::TestKeywords);
+	RUN_TEST(tr, parse::TestLoopKeywords);
 	RUN_TEST(tr, parse::TestNumbers);
+	RUN_TEST(tr, parse::TestNumberLimits);
+	RUN_TEST(tr, parse::TestTokenPositions);
 	RUN_TEST(tr, parse::TestIds);
 	RUN_TEST(tr, parse::TestStrings);
 	RUN_TEST(tr, parse::TestOperations);
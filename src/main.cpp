@@ -1,137 +1,199 @@
 #include "lexer.h"
+#include "memo.h"
 #include "parse.h"
+#include "profiler.h"
 #include "runtime.h"
 #include "statement.h"
-#include "test_runner_p.h"
 
+#include <charconv>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string_view>
 
 using namespace std;
 
-namespace parse {
-void RunOpenLexerTests(TestRunner& tr);
-}  // namespace parse
-
-namespace ast {
-void RunUnitTests(TestRunner& tr);
-}
-namespace runtime {
-void RunObjectHolderTests(TestRunner& tr);
-void RunObjectsTests(TestRunner& tr);
-}  // namespace runtime
-
-void TestParseProgram(TestRunner& tr);
-
 namespace {
 
-void RunMythonProgram(istream& input, ostream& output) {
+enum class ProfileReport { None, Flat, Collapsed };
+
+struct RunOptions {
+	ProfileReport profile = ProfileReport::None;
+	// The period of the sampling profiler, zero when it is off
+	chrono::microseconds sample_interval{0};
+	// Where the counters go as JSON at exit, an empty path means the report output
+	optional<string> metrics_path;
+	// Zero limits are off
+	runtime::ExecutionLimits limits;
+	// Wall-clock time the program may run, zero when unbounded
+	chrono::milliseconds timeout{0};
+	runtime::Engine engine = runtime::Engine::Bytecode;
+	// The results the memoization of pure methods keeps, zero when it is off
+	size_t memo_capacity = 0;
+	// The program and its output, the standard streams when empty
+	string input_path;
+	string output_path;
+};
+
+// Profiler reports are written even if the program fails
+void RunMythonProgram(istream& input, ostream& output, const RunOptions& options = {},
+					  ostream& report_output = cerr) {
 	parse::Lexer lexer(input);
 	auto program = ParseProgram(lexer);
 
 	runtime::SimpleContext context{output};
+	context.SetLimits(options.limits);
+	context.SetEngine(options.engine);
+	runtime::CancellationToken cancellation;
+	if (options.timeout.count() > 0) {
+		cancellation.CancelAfter(options.timeout);
+		context.SetCancellation(cancellation);
+	}
+	optional<runtime::MemoCache> memoization;
+	if (options.memo_capacity > 0) {
+		memoization.emplace(options.memo_capacity);
+		context.SetMemoization(&*memoization);
+	}
 	runtime::Closure closure;
-	program->Execute(closure, context);
-}
-
-void TestSimplePrints() {
-	istringstream input(R"(
-print 57
-print 10, 24, -8
-print 'hello'
-print "world"
-print True, False
-print
-print None
-)");
-
-	ostringstream output;
-	RunMythonProgram(input, output);
-
-	ASSERT_EQUAL(output.str(), "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n");
-}
-
-void TestAssignments() {
-	istringstream input(R"(
-x = 57
-print x
-x = 'C++ black belt'
-print x
-y = False
-x = y
-print x
-x = None
-print x, y
-)");
-
-	ostringstream output;
-	RunMythonProgram(input, output);
-
-	ASSERT_EQUAL(output.str(), "57\nC++ black belt\nFalse\nNone False\n");
-}
-
-void TestArithmetics() {
-	istringstream input("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2");
-
-	ostringstream output;
-	RunMythonProgram(input, output);
-
-	ASSERT_EQUAL(output.str(), "15 120 -13 3 15\n");
+	runtime::Profiler profiler;
+	runtime::ShadowStack shadow_stack;
+	optional<runtime::SamplingProfiler> sampler;
+	if (options.sample_interval.count() > 0) {
+		sampler.emplace(options.sample_interval);
+	}
+	auto write_reports = [&] {
+		if (options.profile == ProfileReport::Flat) {
+			profiler.ReportFlat(report_output, program->GetSourceMap());
+		} else if (options.profile == ProfileReport::Collapsed) {
+			profiler.ReportCollapsed(report_output);
+		}
+		if (sampler) {
+			sampler->Stop();
+			sampler->Report(report_output, program->GetSourceMap());
+		}
+		if (memoization) {
+			memoization->Report(report_output);
+		}
+		if (options.metrics_path) {
+			const runtime::Metrics& metrics = runtime::Metrics::Current();
+			const bool tree_walked = options.engine == runtime::Engine::Tree;
+			if (options.metrics_path->empty()) {
+				metrics.WriteJson(report_output, tree_walked);
+				report_output << endl;
+			} else {
+				ofstream metrics_output(*options.metrics_path);
+				metrics.WriteJson(metrics_output, tree_walked);
+				metrics_output << endl;
+			}
+		}
+	};
+	runtime::Metrics::Current() = {};
+	try {
+		optional<runtime::Profiler::Activation> profiling;
+		if (options.profile != ProfileReport::None) {
+			profiling.emplace(profiler);
+		}
+		optional<runtime::ShadowStack::Activation> sampling;
+		if (sampler) {
+			sampling.emplace(shadow_stack);
+			sampler->Start();
+		}
+		program->Execute(closure, context);
+	} catch (...) {
+		write_reports();
+		throw;
+	}
+	write_reports();
 }
 
-void TestVariablesArePointers() {
-	istringstream input(R"(
-class Counter:
-  def __init__():
-    self.value = 0
-
-  def add():
-    self.value = self.value + 1
-
-class Dummy:
-  def do_add(counter):
-    counter.add()
-
-x = Counter()
-y = x
-
-x.add()
-y.add()
-
-print x.value
-
-d = Dummy()
-d.do_add(x)
-
-print y.value
-)");
-
-	ostringstream output;
-	RunMythonProgram(input, output);
-
-	ASSERT_EQUAL(output.str(), "2\n3\n");
+template <typename Number>
+Number ParseLimit(string_view option, string_view value) {
+	Number number = 0;
+	const auto [end, error] = from_chars(value.data(), value.data() + value.size(), number);
+	if (error != errc() || end != value.data() + value.size() || !(number > 0)) {
+		throw invalid_argument("Bad limit "s + string(option) + ", expected a positive number"s);
+	}
+	return number;
 }
 
-void TestAll() {
-	TestRunner tr;
-	parse::RunOpenLexerTests(tr);
-	runtime::RunObjectHolderTests(tr);
-	runtime::RunObjectsTests(tr);
-	ast::RunUnitTests(tr);
-	TestParseProgram(tr);
-
-	RUN_TEST(tr, TestSimplePrints);
-	RUN_TEST(tr, TestAssignments);
-	RUN_TEST(tr, TestArithmetics);
-	RUN_TEST(tr, TestVariablesArePointers);
+RunOptions ParseOptions(int argc, const char** argv) {
+	RunOptions options;
+	for (int i = 1; i < argc; ++i) {
+		const string_view option = argv[i];
+		if (option == "--profile=flat"sv || option == "--profile"sv) {
+			options.profile = ProfileReport::Flat;
+		} else if (option == "--profile=collapsed"sv) {
+			options.profile = ProfileReport::Collapsed;
+		} else if (option == "--sample"sv) {
+			options.sample_interval = chrono::milliseconds(10);
+		} else if (option.substr(0, 9) == "--sample="sv) {
+			const string_view value = option.substr(9);
+			int64_t microseconds = 0;
+			const auto [end, error] = from_chars(value.data(), value.data() + value.size(), microseconds);
+			if (error != errc() || end != value.data() + value.size() || microseconds <= 0) {
+				throw invalid_argument("Bad sampling period "s + string(value) + ", expected microseconds"s);
+			}
+			options.sample_interval = chrono::microseconds(microseconds);
+		} else if (option == "--metrics"sv) {
+			options.metrics_path = ""s;
+		} else if (option.substr(0, 10) == "--metrics="sv) {
+			options.metrics_path = string(option.substr(10));
+		} else if (option.substr(0, 12) == "--max-steps="sv) {
+			options.limits.max_steps = ParseLimit<uint64_t>(option, option.substr(12));
+		} else if (option.substr(0, 11) == "--max-heap="sv) {
+			options.limits.max_heap_bytes = ParseLimit<size_t>(option, option.substr(11));
+		} else if (option.substr(0, 12) == "--max-depth="sv) {
+			options.limits.max_call_depth = ParseLimit<size_t>(option, option.substr(12));
+		} else if (option.substr(0, 10) == "--timeout="sv) {
+			options.timeout = chrono::milliseconds(ParseLimit<int64_t>(option, option.substr(10)));
+		} else if (option == "--engine=bytecode"sv) {
+			options.engine = runtime::Engine::Bytecode;
+		} else if (option == "--engine=tree"sv) {
+			options.engine = runtime::Engine::Tree;
+		} else if (option == "--memoize"sv) {
+			options.memo_capacity = runtime::MemoCache::DEFAULT_CAPACITY;
+		} else if (option.substr(0, 10) == "--memoize="sv) {
+			options.memo_capacity = ParseLimit<size_t>(option, option.substr(10));
+		} else if (option.substr(0, 2) != "--"sv && options.input_path.empty()) {
+			options.input_path = string(option);
+		} else if (option.substr(0, 2) != "--"sv && options.output_path.empty()) {
+			options.output_path = string(option);
+		} else {
+			throw invalid_argument("Unknown option "s + string(option)
+								   + ", expected --profile=flat, --profile=collapsed, --sample[=microseconds]"s
+								   + ", --metrics[=file], --max-steps=N, --max-heap=BYTES"s
+								   + ", --max-depth=N, --timeout=MILLISECONDS, --engine=bytecode|tree"s
+								   + " or --memoize[=ENTRIES]"s);
+		}
+	}
+	return options;
 }
 
 }  // namespace
 
-int main() {
+int main(int argc, const char** argv) {
 	try {
-		TestAll();
-
-		RunMythonProgram(cin, cout);
+		const RunOptions options = ParseOptions(argc, argv);
+		ifstream input_file;
+		if (!options.input_path.empty()) {
+			input_file.open(options.input_path);
+			if (!input_file) {
+				throw runtime_error("Cannot open "s + options.input_path);
+			}
+		}
+		ofstream output_file;
+		if (!options.output_path.empty()) {
+			output_file.open(options.output_path);
+			if (!output_file) {
+				throw runtime_error("Cannot write "s + options.output_path);
+			}
+		}
+		RunMythonProgram(options.input_path.empty() ? cin : input_file,
+						 options.output_path.empty() ? cout : output_file, options);
+	} catch (const ast::ExecutionError& e) {
+		std::cerr << e.FormatStackTrace() << e.what() << std::endl;
+		return 1;
 	} catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return 1;
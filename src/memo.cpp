@@ -0,0 +1,191 @@
+#include "memo.h"
+
+#include <functional>
+#include <iomanip>
+#include <optional>
+#include <string_view>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+size_t Combine(size_t hash, size_t value) {
+	uint64_t h = hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return static_cast<size_t>(h);
+}
+
+// Hashes the values the results are kept for, the type is mixed in so 1 and True differ;
+// nothing for other objects
+optional<size_t> HashValue(const ObjectHolder& value) {
+	if (const auto number = value.TryAsNumber()) {
+		return Combine(1, hash<int64_t>{}(*number));
+	}
+	if (!value) {
+		return 2;
+	}
+	if (const auto* big_number = value.TryAs<BigNumber>()) {
+		return Combine(3, big_number->GetValue().Hash());
+	}
+	if (const auto* str = value.TryAs<String>()) {
+		return Combine(4, hash<string_view>{}(str->GetValue()));
+	}
+	if (const auto* boolean = value.TryAs<Bool>()) {
+		return Combine(5, boolean->GetValue() ? 1U : 0U);
+	}
+	return nullopt;
+}
+
+// Equality of values HashValue accepts
+bool SameValue(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	if (const auto number = lhs.TryAsNumber()) {
+		return number == rhs.TryAsNumber();
+	}
+	if (!lhs) {
+		return !rhs;
+	}
+	if (const auto* big_number = lhs.TryAs<BigNumber>()) {
+		const auto* other = rhs.TryAs<BigNumber>();
+		return other != nullptr && big_number->GetValue() == other->GetValue();
+	}
+	if (const auto* str = lhs.TryAs<String>()) {
+		const auto* other = rhs.TryAs<String>();
+		return other != nullptr && str->GetValue() == other->GetValue();
+	}
+	const auto* boolean = lhs.TryAs<Bool>();
+	const auto* other = rhs.TryAs<Bool>();
+	return boolean != nullptr && other != nullptr && boolean->GetValue() == other->GetValue();
+}
+
+}  // namespace
+
+double MemoStats::GetHitRate() const {
+	const uint64_t calls = hits + misses;
+	return calls == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(calls);
+}
+
+size_t MemoCache::MethodKeyHash::operator()(const MethodKey& key) const {
+	return Combine(hash<const void*>{}(key.cls), hash<const void*>{}(key.method));
+}
+
+MemoCache::MemoCache(size_t capacity) : capacity_(capacity) {
+}
+
+ObjectHolder MemoCache::Call(ClassInstance& instance, const Method& method, ArgumentList actual_args,
+							 Context& context) {
+	const MethodKey key{&instance.GetClass(), &method};
+	size_t hash = MethodKeyHash{}(key);
+	bool values = true;
+	for (const ObjectHolder& arg : actual_args) {
+		const optional<size_t> arg_hash = HashValue(arg);
+		if (!arg_hash) {
+			values = false;
+			break;
+		}
+		hash = Combine(hash, *arg_hash);
+	}
+	if (!values || !IsPure(*key.cls, method)) {
+		return method.body->Call(method, ObjectHolder::Share(instance), actual_args, context);
+	}
+
+	if (const auto it = Find(key, hash, actual_args); it != entries_.end()) {
+		++stats_.hits;
+		entries_.splice(entries_.begin(), entries_, it);
+		return it->result;
+	}
+	ObjectHolder result = method.body->Call(method, ObjectHolder::Share(instance), actual_args, context);
+	++stats_.misses;
+	if (HashValue(result)) {
+		Insert(key, hash, actual_args, result);
+	}
+	return result;
+}
+
+bool MemoCache::IsPure(const Class& cls, const Method& method) {
+	const MethodKey key{&cls, &method};
+	if (const auto it = purity_.find(key); it != purity_.end()) {
+		return it->second != Purity::Impure;
+	}
+	purity_.emplace(key, Purity::Analyzing);
+	++analyzing_;
+	const size_t decided_before = decided_.size();
+
+	const MethodEffects* effects = method.body->GetEffects(method);
+	bool pure = effects != nullptr && effects->pure;
+	for (size_t i = 0; pure && i < effects->self_calls.size(); ++i) {
+		const auto& [name, argument_count] = effects->self_calls[i];
+		const Method* callee = cls.GetMethod(name);
+		pure = callee != nullptr && callee->formal_params.size() == argument_count && IsPure(cls, *callee);
+	}
+
+	--analyzing_;
+	if (pure) {
+		purity_[key] = Purity::Pure;
+		decided_.push_back(key);
+	} else {
+		purity_[key] = Purity::Impure;
+		// The methods found pure since took this one for pure
+		for (size_t i = decided_before; i < decided_.size(); ++i) {
+			purity_.erase(decided_[i]);
+		}
+		decided_.resize(decided_before);
+	}
+	if (analyzing_ == 0) {
+		decided_.clear();
+	}
+	return pure;
+}
+
+void MemoCache::Report(ostream& out) const {
+	const ios_base::fmtflags flags = out.flags();
+	const streamsize precision = out.precision();
+	out << "memoization: "sv << stats_.hits << " hits, "sv << stats_.misses << " misses ("sv << fixed
+		<< setprecision(1) << stats_.GetHitRate() * 100.0 << "% hit rate), "sv << stats_.evictions
+		<< " evictions, "sv << entries_.size() << " results kept\n"sv;
+	out.precision(precision);
+	out.flags(flags);
+}
+
+MemoCache::Entries::iterator MemoCache::Find(const MethodKey& key, size_t hash, ArgumentList actual_args) {
+	const auto [first, last] = index_.equal_range(hash);
+	for (auto it = first; it != last; ++it) {
+		const Entry& entry = *it->second;
+		if (!(entry.key == key) || entry.args.size() != actual_args.size()) {
+			continue;
+		}
+		bool same = true;
+		for (size_t i = 0; same && i < actual_args.size(); ++i) {
+			same = SameValue(entry.args[i], actual_args[i]);
+		}
+		if (same) {
+			return it->second;
+		}
+	}
+	return entries_.end();
+}
+
+void MemoCache::Insert(const MethodKey& key, size_t hash, ArgumentList actual_args, ObjectHolder result) {
+	if (capacity_ == 0) {
+		return;
+	}
+	if (entries_.size() == capacity_) {
+		const auto oldest = prev(entries_.end());
+		const auto [first, last] = index_.equal_range(oldest->hash);
+		for (auto it = first; it != last; ++it) {
+			if (it->second == oldest) {
+				index_.erase(it);
+				break;
+			}
+		}
+		entries_.erase(oldest);
+		++stats_.evictions;
+	}
+	entries_.push_front({key, hash, {actual_args.begin(), actual_args.end()}, std::move(result)});
+	index_.emplace(hash, entries_.begin());
+}
+
+}  // namespace runtime
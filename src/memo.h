@@ -0,0 +1,94 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace runtime {
+
+struct MemoStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;     // calls of pure methods that ran and whose results were kept
+	uint64_t evictions = 0;
+
+	[[nodiscard]] double GetHitRate() const;
+};
+
+// Memoization of pure methods, installed with Context::SetMemoization. A method of a class is
+// pure when its body has no effects (see MethodEffects) and the methods it calls on self are
+// pure in the same class; mutually recursive methods are pure together unless one of them is
+// not. The results of calls passing values only, Numbers, Strings, Bools or None, are kept until
+// the cache is full, then the least recently used ones go. Errors are never kept, so a call
+// raising one runs again the next time
+class MemoCache {
+public:
+	static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+	explicit MemoCache(size_t capacity = DEFAULT_CAPACITY);
+	MemoCache(const MemoCache&) = delete;
+	MemoCache& operator=(const MemoCache&) = delete;
+
+	// Calls method on instance, or gives the result of the same call made before
+	ObjectHolder Call(ClassInstance& instance, const Method& method, ArgumentList actual_args, Context& context);
+
+	[[nodiscard]] bool IsPure(const Class& cls, const Method& method);
+
+	[[nodiscard]] const MemoStats& GetStats() const {
+		return stats_;
+	}
+	[[nodiscard]] size_t GetSize() const {
+		return entries_.size();
+	}
+	// One line: hits, misses, the hit rate, evictions and the results kept
+	void Report(std::ostream& out) const;
+
+private:
+	enum class Purity : uint8_t {
+		Analyzing,  // taken for pure while the methods it calls are analyzed
+		Pure,
+		Impure,
+	};
+
+	struct MethodKey {
+		const Class* cls;
+		const Method* method;
+
+		bool operator==(const MethodKey& other) const {
+			return cls == other.cls && method == other.method;
+		}
+	};
+	struct MethodKeyHash {
+		size_t operator()(const MethodKey& key) const;
+	};
+
+	struct Entry {
+		MethodKey key;
+		size_t hash;
+		std::vector<ObjectHolder> args;
+		ObjectHolder result;
+	};
+	using Entries = std::list<Entry>;
+
+	[[nodiscard]] Entries::iterator Find(const MethodKey& key, size_t hash, ArgumentList actual_args);
+	void Insert(const MethodKey& key, size_t hash, ArgumentList actual_args, ObjectHolder result);
+
+	size_t capacity_;
+	MemoStats stats_;
+	// Most recently used first
+	Entries entries_;
+	// The hashes of the calls of the entries; probes compare the arguments without copying them
+	std::unordered_multimap<size_t, Entries::iterator> index_;
+	std::unordered_map<MethodKey, Purity, MethodKeyHash> purity_;
+	// The methods found pure while others were being analyzed, in order: they have to be
+	// analyzed again if one of those turns out impure
+	std::vector<MethodKey> decided_;
+	size_t analyzing_ = 0;
+};
+
+}  // namespace runtime
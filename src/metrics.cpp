@@ -0,0 +1,17 @@
+#include "metrics.h"
+
+namespace runtime {
+
+void Metrics::WriteJson(std::ostream& out, bool with_variable_lookups) const {
+	out << "{\"method_calls\": " << method_calls
+		<< ", \"allocations\": " << allocations;
+	if (with_variable_lookups) {
+		out << ", \"variable_lookups\": " << variable_lookups;
+	}
+	out << ", \"field_lookups\": " << field_lookups
+		<< ", \"field_assignments\": " << field_assignments
+		<< ", \"prints\": " << prints
+		<< ", \"errors\": " << errors << "}";
+}
+
+}  // namespace runtime
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+namespace runtime {
+
+// Counters of the work done by the interpreter on the current thread. Building with
+// MYTHON_NO_METRICS defined removes the updates, the counters then stay zero
+struct Metrics {
+	uint64_t method_calls = 0;
+	uint64_t allocations = 0;        // objects created through ObjectHolder::Own
+	// Names looked up in closures by the tree walker. The bytecode keeps locals in registers and
+	// counts nothing, under it only the code outside of methods adds to the counter
+	uint64_t variable_lookups = 0;
+	uint64_t field_lookups = 0;      // fields read through dotted names
+	uint64_t field_assignments = 0;
+	uint64_t prints = 0;
+	uint64_t errors = 0;             // runtime errors raised by statements of parsed programs
+
+	static Metrics& Current() {
+		thread_local Metrics metrics;
+		return metrics;
+	}
+
+	// A flat JSON object with a member per counter; variable_lookups is left out for the runs
+	// of the bytecode, where it would not compare with the tree walker's
+	void WriteJson(std::ostream& out, bool with_variable_lookups = true) const;
+};
+
+}  // namespace runtime
+
+#ifdef MYTHON_NO_METRICS
+#define MYTHON_COUNT(counter) static_cast<void>(0)
+#else
+#define MYTHON_COUNT(counter) static_cast<void>(++::runtime::Metrics::Current().counter)
+#endif
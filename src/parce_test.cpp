@@ -1,13 +1,16 @@
 #include "lexer.h"
 #include "parse.h"
+#include "profiler.h"
 #include "statement.h"
 #include "test_runner_p.h"
 
+#include <thread>
+
 using namespace std;
 
 namespace parse {
 
-unique_ptr<ast::Statement> ParseProgramFromString(const string& program) {
+unique_ptr<ast::Program> ParseProgramFromString(const string& program) {
 	istringstream is(program);
 	parse::Lexer lexer(is);
 	return ParseProgram(lexer);
@@ -173,6 +176,604 @@ print x.call_count
 	ASSERT_EQUAL(context.output.str(), "17\n1\n115\n"s);
 }
 
+void TestTailRecursion() {
+	const string program = R"(
+class Counter:
+  def count(n, acc):
+    if n == 0:
+      return acc
+    return self.count(n - 1, acc + 2)
+
+class Parity:
+  def __init__(other):
+    self.other = other
+
+  def is_even(n):
+    if n == 0:
+      return True
+    return self.other.is_odd(n - 1)
+
+  def is_odd(n):
+    if n == 0:
+      return False
+    return self.other.is_even(n - 1)
+
+counter = Counter()
+print counter.count(200000, 0)
+
+a = Parity(None)
+b = Parity(a)
+a.other = b
+print a.is_even(100001), b.is_odd(100001)
+)"s;
+
+	runtime::DummyContext context;
+
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	tree->Execute(closure, context);
+
+	ASSERT_EQUAL(context.output.str(), "400000\nFalse True\n"s);
+}
+
+void TestWhileLoop() {
+	const string program = R"(
+class Search:
+  def first_multiple(divisor, limit):
+    n = 1
+    while n < limit:
+      if n / divisor * divisor == n:
+        return n
+      n = n + 1
+    return None
+
+i = 0
+sum = 0
+while True:
+  i = i + 1
+  if i > 10:
+    break
+  if i / 2 * 2 == i:
+    continue
+  sum = sum + i
+print i, sum
+
+search = Search()
+print search.first_multiple(7, 100), search.first_multiple(700, 100)
+
+n = 0
+while n < 3:
+  m = 0
+  while m < 3:
+    m = m + 1
+    if m == 2:
+      break
+  n = n + m
+print n, m
+)"s;
+
+	runtime::DummyContext context;
+
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	tree->Execute(closure, context);
+
+	ASSERT_EQUAL(context.output.str(), "11 25\n7 None\n4 2\n"s);
+
+	ASSERT_THROWS(ParseProgramFromString("break\n"s), ParseError);
+	ASSERT_THROWS(ParseProgramFromString(R"(
+while True:
+  class A:
+    def f():
+      continue
+)"s), ParseError);
+	ASSERT_THROWS(ParseProgramFromString("return 1\n"s), ParseError);
+	ASSERT_THROWS(ParseProgramFromString(R"(
+class A:
+  def f():
+    return 1
+if True:
+  return 2
+)"s), ParseError);
+}
+
+void TestLists() {
+	const string program = R"(
+class Node:
+  def __init__(value):
+    self.value = value
+
+  def __str__():
+    return 'Node(' + str(self.value) + ')'
+
+xs = [1, 'two', None]
+xs.append(Node(4))
+xs[1] = 2
+last = xs[-1]
+print xs, len(xs), last.value, len('abc')
+
+matrix = [[1, 2], [3, 4]]
+matrix[1][0] = 5
+total = 0
+for row in matrix:
+  for item in row:
+    if item == 2:
+      continue
+    total = total + item
+print matrix, total
+
+empty = []
+if empty:
+  print 'not empty'
+else:
+  print 'empty'
+print xs.pop(), len(xs)
+)"s;
+
+	runtime::DummyContext context;
+
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	tree->Execute(closure, context);
+
+	ASSERT_EQUAL(context.output.str(), "[1, 2, None, Node(4)] 4 4 3\n[[1, 2], [5, 4]] 10\nempty\nNode(4) 3\n"s);
+
+	auto out_of_range = ParseProgramFromString("x = [1]\nprint x[1]\n"s);
+	ASSERT_THROWS(out_of_range->Execute(closure, context), runtime_error);
+
+	// An empty loop does not define its variable
+	runtime::Closure empty_loop_closure;
+	auto empty_loop = ParseProgramFromString("for y in []:\n  print y\nprint y\n"s);
+	ASSERT_THROWS(empty_loop->Execute(empty_loop_closure, context), runtime_error);
+	ASSERT(empty_loop_closure.count("y"s) == 0);
+}
+
+void TestDicts() {
+	const string program = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __hash__():
+    return self.x * 31 + self.y
+
+  def __eq__(other):
+    return self.x == other.x and self.y == other.y
+
+ages = {'ann': 30, 'bob': 25}
+ages['eve'] = 41
+ages['ann'] = ages['ann'] + 1
+print ages, len(ages), 'bob' in ages, 'joe' in ages, ages.get('joe')
+
+names = ''
+for name in ages:
+  names = names + name
+print names, ages.pop('bob'), ages
+
+grid = {}
+grid[Point(1, 2)] = 'a'
+grid[Point(1, 2)] = 'b'
+print len(grid), grid[Point(1, 2)], 3 in [1, 2, 3]
+if {}:
+  print 'not empty'
+)"s;
+
+	runtime::DummyContext context;
+
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	tree->Execute(closure, context);
+
+	ASSERT_EQUAL(context.output.str(),
+				 "{ann: 31, bob: 25, eve: 41} 3 True False None\nannbobeve 25 {ann: 31, eve: 41}\n1 b True\n"s);
+
+	auto missing_key = ParseProgramFromString("x = {1: 2}\nprint x[2]\n"s);
+	ASSERT_THROWS(missing_key->Execute(closure, context), runtime_error);
+	auto unhashable = ParseProgramFromString("x = {[1]: 2}\n"s);
+	ASSERT_THROWS(unhashable->Execute(closure, context), runtime_error);
+}
+
+void TestLongArithmetic() {
+	const string program = R"(
+class Math:
+  def factorial(n):
+    if n < 2:
+      return 1
+    return n * self.factorial(n - 1)
+
+math = Math()
+big = math.factorial(25)
+print big, big / math.factorial(23), -big / 7
+print 3000000000 * 4, 9223372036854775807 + 1 - 1, big > 1, {big: 'big'}[math.factorial(25)]
+)"s;
+
+	runtime::DummyContext context;
+
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	tree->Execute(closure, context);
+
+	ASSERT_EQUAL(context.output.str(),
+				 "15511210043330985984000000 600 -2215887149047283712000000\n"
+				 "12000000000 9223372036854775807 True big\n"s);
+}
+
+void TestErrorLocations() {
+	const string program = R"(
+class Divider:
+  def divide(a, b):
+    result = a / b
+    return result
+
+divider = Divider()
+print divider.divide(4, 2)
+x = divider.divide(1, 0)
+)"s;
+
+	runtime::DummyContext context;
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	try {
+		tree->Execute(closure, context);
+		ASSERT(false);
+	} catch (const ast::ExecutionError& e) {
+		ASSERT_EQUAL(e.GetPosition().line, 4U);
+		ASSERT_EQUAL(string(e.what()), "line 4, column 5: Division by zero"s);
+	}
+	ASSERT_EQUAL(context.output.str(), "2\n"s);
+
+	try {
+		ParseProgramFromString("x = 1\ny = unknown(x)\n"s);
+		ASSERT(false);
+	} catch (const ParseError& e) {
+		ASSERT_EQUAL(string(e.what()).substr(0, 7), "line 2,"s);
+	}
+
+	auto missing_name = ParseProgramFromString("x = 1\nprint x, y\n"s);
+	try {
+		missing_name->Execute(closure, context);
+		ASSERT(false);
+	} catch (const ast::ExecutionError& e) {
+		ASSERT_EQUAL(string(e.what()), "line 2, column 1: Name y not found in the scope"s);
+	}
+}
+
+void TestProfiler() {
+	const string program = R"(
+class Counter:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+class Loop(Counter):
+  def count(n):
+    if n == 0:
+      return 0
+    return self.count(n - 1)
+
+x = Loop()
+print x.fib(5)
+print x.count(3)
+)"s;
+
+	runtime::DummyContext context;
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	runtime::Profiler profiler;
+	{
+		runtime::Profiler::Activation activation(profiler);
+		tree->Execute(closure, context);
+	}
+	ASSERT(runtime::Profiler::Current() == nullptr);
+	ASSERT_EQUAL(context.output.str(), "5\n0\n"s);
+
+	// Rows of the flat report are "count inclusive exclusive name"
+	ostringstream flat;
+	profiler.ReportFlat(flat, tree->GetSourceMap());
+	istringstream flat_input(flat.str());
+	map<string, uint64_t> method_calls;
+	map<string, uint64_t> line_runs;
+	auto* section = &method_calls;
+	for (string row; getline(flat_input, row);) {
+		if (row.empty()) {
+			section = &line_runs;
+			continue;
+		}
+		istringstream fields(row);
+		uint64_t count = 0;
+		double inclusive = 0;
+		double exclusive = 0;
+		string name;
+		if (fields >> count >> inclusive >> exclusive >> name) {
+			ASSERT(exclusive <= inclusive + 0.001);
+			(*section)[name] = count;
+		}
+	}
+	// Inherited methods are named after the class defining them, tail calls are counted too
+	ASSERT_EQUAL(method_calls, (map<string, uint64_t>{{"Counter.fib"s, 15}, {"Loop.count"s, 4}}));
+	ASSERT_EQUAL(line_runs.at("4"s), 15U);
+	ASSERT_EQUAL(line_runs.at("6"s), 7U);
+	ASSERT_EQUAL(line_runs.at("10"s), 4U);
+	ASSERT_EQUAL(line_runs.at("16"s), 1U);
+
+	// A tail call takes the place of its caller on the stack
+	ostringstream collapsed;
+	profiler.ReportCollapsed(collapsed);
+	istringstream collapsed_input(collapsed.str());
+	set<string> stacks;
+	for (string row; getline(collapsed_input, row);) {
+		stacks.insert(row.substr(0, row.rfind(' ')));
+	}
+	ASSERT_EQUAL(stacks, (set<string>{
+		"<module>"s,
+		"<module>;Counter.fib"s,
+		"<module>;Counter.fib;Counter.fib"s,
+		"<module>;Counter.fib;Counter.fib;Counter.fib"s,
+		"<module>;Counter.fib;Counter.fib;Counter.fib;Counter.fib"s,
+		"<module>;Counter.fib;Counter.fib;Counter.fib;Counter.fib;Counter.fib"s,
+		"<module>;Loop.count"s,
+	}));
+}
+
+void TestSamplingProfiler() {
+	const string program = R"(
+class Counter:
+  def fib(n):
+    if n < 2:
+      return n
+    return self.fib(n - 1) + self.fib(n - 2)
+
+x = Counter()
+y = x.fib(12)
+)"s;
+
+	auto tree = ParseProgramFromString(program);
+	runtime::ShadowStack shadow_stack;
+	runtime::SamplingProfiler sampler(chrono::microseconds(200));
+	{
+		runtime::ShadowStack::Activation activation(shadow_stack);
+		sampler.Start();
+		runtime::SamplingProfiler other;
+		try {
+			other.Start();
+			ASSERT(false);
+		} catch (const runtime_error&) {
+		}
+		// The timer counts processor time, so the program is run until enough of it has passed
+		for (int i = 0; i < 10'000 && sampler.GetSampleCount() < 5; ++i) {
+			runtime::DummyContext context;
+			runtime::Closure closure;
+			tree->Execute(closure, context);
+			ASSERT_EQUAL(shadow_stack.Depth(), 1U);
+		}
+		sampler.Stop();
+
+		// Frames of a failed call are popped too
+		auto failing = ParseProgramFromString("class Failing:\n  def fail():\n    return 1 / 0\n\nx = Failing()\nprint x.fail()\n"s);
+		runtime::DummyContext context;
+		runtime::Closure closure;
+		try {
+			failing->Execute(closure, context);
+			ASSERT(false);
+		} catch (const ast::ExecutionError&) {
+		}
+		ASSERT_EQUAL(shadow_stack.Depth(), 1U);
+	}
+	ASSERT(runtime::ShadowStack::Current() == nullptr);
+	ASSERT(sampler.GetSampleCount() >= 5U);
+
+	ostringstream report;
+	sampler.Report(report, tree->GetSourceMap());
+	istringstream input(report.str());
+	uint64_t total = 0;
+	for (string row; getline(input, row);) {
+		ASSERT_EQUAL(row.substr(0, 9), "<module>:"s);
+		if (row.find(';') != string::npos) {
+			ASSERT(row.find(";Counter.fib"s) != string::npos);
+		}
+		total += stoull(row.substr(row.rfind(' ') + 1));
+	}
+	ASSERT_EQUAL(total + sampler.GetMissedCount(), sampler.GetSampleCount());
+}
+
+void TestMetrics() {
+	const string program = R"(
+class Point:
+  def __init__(x):
+    self.x = x
+
+  def get():
+    return self.x
+
+p = Point(1)
+print p.get(), p.x
+print 1 / 0
+)"s;
+
+	runtime::DummyContext context;
+	// The bytecode reads variables from registers, the lookups are those of the tree walker
+	context.SetEngine(runtime::Engine::Tree);
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(program);
+	runtime::Metrics::Current() = {};
+	ASSERT_THROWS(tree->Execute(closure, context), ast::ExecutionError);
+	const runtime::Metrics metrics = runtime::Metrics::Current();
+
+#ifndef MYTHON_NO_METRICS
+	ASSERT_EQUAL(metrics.method_calls, 2U);
+	ASSERT_EQUAL(metrics.variable_lookups, 5U);
+	ASSERT_EQUAL(metrics.field_lookups, 2U);
+	ASSERT_EQUAL(metrics.field_assignments, 1U);
+	// The print of 1 / 0 is not counted
+	ASSERT_EQUAL(metrics.prints, 1U);
+	ASSERT_EQUAL(metrics.errors, 1U);
+	ASSERT(metrics.allocations > 0);
+#endif
+
+	ostringstream json;
+	metrics.WriteJson(json);
+	ASSERT_EQUAL(json.str().substr(0, 17), "{\"method_calls\": "s);
+	ASSERT(json.str().find("\"variable_lookups\": "s) != string::npos);
+	ASSERT(json.str().find("\"errors\": "s) != string::npos);
+
+	ostringstream bytecode_json;
+	metrics.WriteJson(bytecode_json, false);
+	ASSERT(bytecode_json.str().find("variable_lookups"s) == string::npos);
+	ASSERT(bytecode_json.str().find("\"prints\": "s) != string::npos);
+}
+
+void TestExecutionLimits() {
+	runtime::DummyContext context;
+	runtime::Closure closure;
+
+	runtime::ExecutionLimits limits;
+	limits.max_call_depth = 50;
+	context.SetLimits(limits);
+	auto recursion = ParseProgramFromString(R"(
+class Rec:
+  def go(n):
+    x = self.go(n + 1)
+    return x
+
+r = Rec()
+r.go(0)
+)"s);
+	try {
+		recursion->Execute(closure, context);
+		ASSERT(false);
+	} catch (const ast::LimitExceededError& error) {
+		const auto& trace = error.GetStackTrace();
+		ASSERT_EQUAL(trace.size(), 51U);
+		ASSERT_EQUAL(trace.front().function, "Rec.go"s);
+		ASSERT_EQUAL(trace.front().position.line, 4U);
+		ASSERT_EQUAL(trace.back().function, "<module>"s);
+		ASSERT_EQUAL(trace.back().position.line, 8U);
+	}
+	// The depth is restored by the unwinding
+	context.SetLimits({});
+	auto shallow = ParseProgramFromString(R"(
+class Id:
+  def get(n):
+    return n
+
+i = Id()
+print i.get(1)
+)"s);
+	shallow->Execute(closure, context);
+
+	limits = {};
+	limits.max_steps = 1000;
+	context.SetLimits(limits);
+	auto endless = ParseProgramFromString(R"(
+x = 0
+while True:
+  x = x + 1
+)"s);
+	ASSERT_THROWS(endless->Execute(closure, context), ast::LimitExceededError);
+	ASSERT(runtime::Equal(closure.at("x"s), runtime::ObjectHolder::Own(runtime::Number(998)), context));
+
+	limits = {};
+	limits.max_heap_bytes = 1 << 16;
+	context.SetLimits(limits);
+	auto doubling = ParseProgramFromString(R"(
+s = 'ab'
+while True:
+  s = s + s
+)"s);
+	ASSERT_THROWS(doubling->Execute(closure, context), ast::LimitExceededError);
+	ASSERT_EQUAL(runtime::Heap::Current().GetByteLimit(), 0U);
+	auto hoarding = ParseProgramFromString(R"(
+class Node:
+  def __init__(next):
+    self.next = next
+
+head = None
+while True:
+  head = Node(head)
+)"s);
+	ASSERT_THROWS(hoarding->Execute(closure, context), ast::LimitExceededError);
+	closure.clear();
+}
+
+void TestStackTrace() {
+	runtime::DummyContext context;
+	runtime::Closure closure;
+	auto tree = ParseProgramFromString(R"(
+class Divider:
+  def divide(a, b):
+    return a / b
+
+  def run(a):
+    if a > 0:
+      q = self.divide(a, 0)
+    return q
+
+d = Divider()
+d.run(1)
+)"s);
+	try {
+		tree->Execute(closure, context);
+		ASSERT(false);
+	} catch (const ast::ExecutionError& error) {
+		ASSERT_EQUAL(error.FormatStackTrace(),
+					 "Traceback (most recent call last):\n"
+					 "  line 12, column 1, in <module>\n"
+					 "  line 8, column 7, in Divider.run\n"
+					 "  line 4, column 12, in Divider.divide\n"s);
+	}
+}
+
+void TestCancellation() {
+	runtime::DummyContext context;
+	runtime::Closure closure;
+	auto endless = ParseProgramFromString(R"(
+class Spinner:
+  def spin(n):
+    return self.spin(n + 1)
+
+x = 0
+while True:
+  x = x + 1
+  if x == 1000:
+    s = Spinner()
+    s.spin(0)
+)"s);
+
+	runtime::CancellationToken deadline;
+	deadline.CancelAfter(chrono::milliseconds(20));
+	context.SetCancellation(deadline);
+	try {
+		endless->Execute(closure, context);
+		ASSERT(false);
+	} catch (const ast::LimitExceededError& error) {
+		ASSERT(string(error.what()).find("Deadline exceeded"s) != string::npos);
+		ASSERT_EQUAL(static_cast<int>(deadline.GetReason()), static_cast<int>(runtime::CancelReason::Deadline));
+		// The tail recursive method is where the time went
+		ASSERT_EQUAL(error.GetStackTrace().front().function, "Spinner.spin"s);
+		ASSERT_EQUAL(error.GetStackTrace().back().function, "<module>"s);
+	}
+
+	runtime::CancellationToken token;
+	context.SetCancellation(token);
+	closure.clear();
+	thread canceller([&token] {
+		this_thread::sleep_for(chrono::milliseconds(5));
+		token.Cancel();
+	});
+	ASSERT_THROWS(endless->Execute(closure, context), ast::LimitExceededError);
+	canceller.join();
+	ASSERT_EQUAL(static_cast<int>(token.GetReason()), static_cast<int>(runtime::CancelReason::Cancelled));
+
+	// A cancelled token stops the next run at its first loop iteration
+	closure.clear();
+	ASSERT_THROWS(endless->Execute(closure, context), ast::LimitExceededError);
+	ASSERT(runtime::Equal(closure.at("x"s), runtime::ObjectHolder::Own(runtime::Number(0)), context));
+	context.SetCancellation(runtime::CancellationToken::Never());
+	closure.clear();
+}
+
 void TestComplexLogicalExpression() {
 	const string program = R"(
 a = 1
@@ -253,6 +854,18 @@ void TestParseProgram(TestRunner& tr) {
 	RUN_TEST(tr, parse::TestReturnFromIf);
 	RUN_TEST(tr, parse::TestRecursion);
 	RUN_TEST(tr, parse::TestRecursion2);
+	RUN_TEST(tr, parse::TestTailRecursion);
+	RUN_TEST(tr, parse::TestWhileLoop);
+	RUN_TEST(tr, parse::TestLists);
+	RUN_TEST(tr, parse::TestDicts);
+	RUN_TEST(tr, parse::TestLongArithmetic);
+	RUN_TEST(tr, parse::TestErrorLocations);
+	RUN_TEST(tr, parse::TestProfiler);
+	RUN_TEST(tr, parse::TestSamplingProfiler);
+	RUN_TEST(tr, parse::TestMetrics);
+	RUN_TEST(tr, parse::TestExecutionLimits);
+	RUN_TEST(tr, parse::TestStackTrace);
+	RUN_TEST(tr, parse::TestCancellation);
 	RUN_TEST(tr, parse::TestComplexLogicalExpression);
 	RUN_TEST(tr, parse::TestClassicalPolymorphism);
 }
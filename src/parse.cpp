@@ -3,6 +3,8 @@
 #include "lexer.h"
 #include "statement.h"
 
+#include <unordered_map>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -20,21 +22,49 @@ bool operator!=(const parse::Token& token, char c) {
 class Parser {
 public:
 	explicit Parser(parse::Lexer& lexer)
-		: lexer_(lexer) {
+		: lexer_(lexer), scopes_(1) {
 	}
 
 	// Program -> eps
 	//          | Statement \n Program
-	unique_ptr<ast::Statement> ParseProgram() {
+	unique_ptr<ast::Program> ParseProgram() {
 		auto result = make_unique<ast::Compound>();
 		while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
 			result->AddStatement(ParseStatement());
 		}
+		BindCalls();
 
-		return result;
+		return make_unique<ast::Program>(std::move(result), std::move(source_map_));
 	}
 
 private:
+	// The names of a method body or of the top level and the classes they are known to hold
+	struct Scope {
+		// The class the method belongs to, empty at the top level
+		string class_name;
+		// The class every assignment to a name instantiates; nullptr for parameters and for
+		// names some assignment gives anything else. Self is not there unless assigned
+		unordered_map<string, const runtime::Class*> names;
+	};
+
+	// A call on a variable, to be bound to its method once all classes are known
+	struct CallSite {
+		ast::MethodCall* call;
+		size_t scope;
+		string receiver;
+	};
+
+	ParseError Error(const string& message) const {
+		return ParseError(parse::ToString(lexer_.CurrentPosition()) + ": "s + message);
+	}
+
+	// Every parsing function reports where its result starts. Outer functions often pass on
+	// a node made by an inner one, so only the first position given to a node is kept
+	unique_ptr<ast::Statement> Located(parse::SourcePosition position, unique_ptr<ast::Statement> node) {
+		source_map_.Add(node.get(), position);
+		return node;
+	}
+
 	// Suite -> NEWLINE INDENT (Statement)+ DEDENT
 	unique_ptr<ast::Statement> ParseSuite()  // NOLINT
 	{
@@ -55,7 +85,7 @@ private:
 	}
 
 	// Methods -> [def id(Params) : Suite]*
-	vector<runtime::Method> ParseMethods()  // NOLINT
+	vector<runtime::Method> ParseMethods(const string& class_name)  // NOLINT
 	{
 		vector<runtime::Method> result;
 
@@ -76,7 +106,18 @@ private:
 			lexer_.ExpectNext<TokenType::Char>(':');
 			lexer_.NextToken();
 
-			m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+			// Loops enclosing the class definition can not be left from its methods
+			size_t loop_depth = std::exchange(loop_depth_, 0);
+			size_t scope = std::exchange(scope_, scopes_.size());
+			scopes_.push_back({class_name, {}});
+			for (const string& param : m.formal_params) {
+				scopes_[scope_].names[param] = nullptr;
+			}
+			++method_depth_;
+			m.body = std::make_unique<ast::MethodBody>(ParseSuite(), class_name + "."s + m.name);  // NOLINT
+			--method_depth_;
+			scope_ = scope;
+			loop_depth_ = loop_depth;
 
 			result.push_back(std::move(m));
 		}
@@ -87,6 +128,7 @@ private:
 	unique_ptr<ast::Statement> ParseClassDefinition()  // NOLINT
 	{
 		string class_name = lexer_.Expect<TokenType::Id>().value;
+		Assign(class_name, nullptr);
 
 		lexer_.NextToken();
 
@@ -98,7 +140,7 @@ private:
 
 			auto it = declared_classes_.find(name);
 			if (it == declared_classes_.end()) {
-				throw ParseError("Base class "s + name + " not found for class "s + class_name);
+				throw Error("Base class "s + name + " not found for class "s + class_name);
 			}
 			base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
 		}
@@ -107,7 +149,7 @@ private:
 		lexer_.ExpectNext<TokenType::Newline>();
 		lexer_.ExpectNext<TokenType::Indent>();
 		lexer_.ExpectNext<TokenType::Def>();
-		vector<runtime::Method> methods = ParseMethods();  // NOLINT
+		vector<runtime::Method> methods = ParseMethods(class_name);  // NOLINT
 
 		lexer_.Expect<TokenType::Dedent>();
 		lexer_.NextToken();
@@ -118,7 +160,7 @@ private:
 		});
 
 		if (!inserted) {
-			throw ParseError("Class "s + class_name + " already exists"s);
+			throw Error("Class "s + class_name + " already exists"s);
 		}
 
 		return make_unique<ast::ClassDefinition>(it->second);
@@ -134,12 +176,34 @@ private:
 		return result;
 	}
 
+	// Index -> '[' Test ']'
+	unique_ptr<ast::Statement> ParseIndex() {
+		lexer_.Expect<TokenType::Char>('[');
+		lexer_.NextToken();
+		auto result = ParseTest();
+		lexer_.Expect<TokenType::Char>(']');
+		lexer_.NextToken();
+		return result;
+	}
+
 	//  AssgnOrCall -> DottedIds = Expr
+	//               | DottedIds Index+ = Expr
 	//               | DottedIds '(' ExprList ')'
 	unique_ptr<ast::Statement> ParseAssignmentOrCall() {
 		lexer_.Expect<TokenType::Id>();
 
 		vector<string> id_list = ParseDottedIds();
+		if (lexer_.CurrentToken() == '[') {
+			unique_ptr<ast::Statement> object = make_unique<ast::VariableValue>(std::move(id_list));
+			auto index = ParseIndex();
+			while (lexer_.CurrentToken() == '[') {
+				object = make_unique<ast::Subscript>(std::move(object), std::move(index));
+				index = ParseIndex();
+			}
+			lexer_.Expect<TokenType::Char>('=');
+			lexer_.NextToken();
+			return make_unique<ast::SubscriptAssignment>(std::move(object), std::move(index), ParseTest());
+		}
 		string last_name = id_list.back();
 		id_list.pop_back();
 
@@ -147,7 +211,9 @@ private:
 			lexer_.NextToken();
 
 			if (id_list.empty()) {
-				return make_unique<ast::Assignment>(std::move(last_name), ParseTest());
+				auto value = ParseTest();
+				Assign(last_name, value.get());
+				return make_unique<ast::Assignment>(std::move(last_name), std::move(value));
 			}
 			return make_unique<ast::FieldAssignment>(ast::VariableValue{std::move(id_list)},
 													 std::move(last_name), ParseTest());
@@ -156,7 +222,7 @@ private:
 		lexer_.NextToken();
 
 		if (id_list.empty()) {
-			throw ParseError("Mython doesn't support functions, only methods: "s + last_name);
+			throw Error("Mython doesn't support functions, only methods: "s + last_name);
 		}
 
 		vector<unique_ptr<ast::Statement>> args;
@@ -166,13 +232,13 @@ private:
 		lexer_.Expect<TokenType::Char>(')');
 		lexer_.NextToken();
 
-		return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(id_list)),
-											std::move(last_name), std::move(args));
+		return MakeMethodCall(std::move(id_list), std::move(last_name), std::move(args));
 	}
 
 	// Expr -> Adder ['+'/'-' Adder]*
 	unique_ptr<ast::Statement> ParseExpression()  // NOLINT
 	{
+		const auto position = lexer_.CurrentPosition();
 		unique_ptr<ast::Statement> result = ParseAdder();
 		while (lexer_.CurrentToken() == '+' || lexer_.CurrentToken() == '-') {
 			char op = lexer_.CurrentToken().As<TokenType::Char>().value;
@@ -184,12 +250,13 @@ private:
 				result = make_unique<ast::Sub>(std::move(result), ParseAdder());
 			}
 		}
-		return result;
+		return Located(position, std::move(result));
 	}
 
 	// Adder -> Mult ['*'/'/' Mult]*
 	unique_ptr<ast::Statement> ParseAdder()  // NOLINT
 	{
+		const auto position = lexer_.CurrentPosition();
 		unique_ptr<ast::Statement> result = ParseMult();
 		while (lexer_.CurrentToken() == '*' || lexer_.CurrentToken() == '/') {
 			char op = lexer_.CurrentToken().As<TokenType::Char>().value;
@@ -201,19 +268,36 @@ private:
 				result = make_unique<ast::Div>(std::move(result), ParseMult());
 			}
 		}
-		return result;
+		return Located(position, std::move(result));
 	}
 
-	// Mult -> '(' Expr ')'
-	//       | NUMBER
-	//       | '-' Mult
-	//       | STRING
-	//       | NONE
-	//       | TRUE
-	//       | FALSE
-	//       | DottedIds '(' ExprList ')'
-	//       | DottedIds
+	// Mult -> '-' Mult
+	//       | Primary Index*
 	unique_ptr<ast::Statement> ParseMult()  // NOLINT
+	{
+		const auto position = lexer_.CurrentPosition();
+		if (lexer_.CurrentToken() == '-') {
+			lexer_.NextToken();
+			return Located(position, make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1)));
+		}
+		unique_ptr<ast::Statement> result = ParsePrimary();
+		while (lexer_.CurrentToken() == '[') {
+			result = make_unique<ast::Subscript>(std::move(result), ParseIndex());
+		}
+		return Located(position, std::move(result));
+	}
+
+	// Primary -> '(' Expr ')'
+	//          | '[' [ExprList] ']'
+	//          | '{' [Expr ':' Expr {',' Expr ':' Expr}] '}'
+	//          | NUMBER
+	//          | STRING
+	//          | NONE
+	//          | TRUE
+	//          | FALSE
+	//          | DottedIds '(' ExprList ')'
+	//          | DottedIds
+	unique_ptr<ast::Statement> ParsePrimary()  // NOLINT
 	{
 		if (lexer_.CurrentToken() == '(') {
 			lexer_.NextToken();
@@ -222,12 +306,35 @@ private:
 			lexer_.NextToken();
 			return result;
 		}
-		if (lexer_.CurrentToken() == '-') {
+		if (lexer_.CurrentToken() == '[') {
+			vector<unique_ptr<ast::Statement>> items;
+			if (lexer_.NextToken() != ']') {
+				items = ParseTestList();
+			}
+			lexer_.Expect<TokenType::Char>(']');
 			lexer_.NextToken();
-			return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
+			return make_unique<ast::NewList>(std::move(items));
+		}
+		if (lexer_.CurrentToken() == '{') {
+			vector<pair<unique_ptr<ast::Statement>, unique_ptr<ast::Statement>>> items;
+			if (lexer_.NextToken() != '}') {
+				while (true) {
+					auto key = ParseTest();
+					lexer_.Expect<TokenType::Char>(':');
+					lexer_.NextToken();
+					items.emplace_back(std::move(key), ParseTest());
+					if (lexer_.CurrentToken() != ',') {
+						break;
+					}
+					lexer_.NextToken();
+				}
+			}
+			lexer_.Expect<TokenType::Char>('}');
+			lexer_.NextToken();
+			return make_unique<ast::NewDict>(std::move(items));
 		}
 		if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
-			int result = num->value;
+			int64_t result = num->value;
 			lexer_.NextToken();
 			return make_unique<ast::NumericConst>(result);
 		}
@@ -268,9 +375,7 @@ private:
 			names.pop_back();
 
 			if (!names.empty()) {
-				return make_unique<ast::MethodCall>(
-					make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
-					std::move(args));
+				return MakeMethodCall(std::move(names), std::move(method_name), std::move(args));
 			}
 			if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
 				return make_unique<ast::NewInstance>(
@@ -278,11 +383,17 @@ private:
 			}
 			if (method_name == "str"sv) {
 				if (args.size() != 1) {
-					throw ParseError("Function str takes exactly one argument"s);
+					throw Error("Function str takes exactly one argument"s);
 				}
 				return make_unique<ast::Stringify>(std::move(args.front()));
 			}
-			throw ParseError("Unknown call to "s + method_name + "()"s);
+			if (method_name == "len"sv) {
+				if (args.size() != 1) {
+					throw Error("Function len takes exactly one argument"s);
+				}
+				return make_unique<ast::Length>(std::move(args.front()));
+			}
+			throw Error("Unknown call to "s + method_name + "()"s);
 		}
 		return make_unique<ast::VariableValue>(std::move(names));
 	}
@@ -323,40 +434,83 @@ private:
 										std::move(else_body));
 	}
 
+	// Loop -> while LogicalExpr: Suite
+	unique_ptr<ast::Statement> ParseLoop()  // NOLINT
+	{
+		lexer_.Expect<TokenType::While>();
+		lexer_.NextToken();
+
+		auto condition = ParseTest();
+
+		lexer_.Expect<TokenType::Char>(':');
+		lexer_.NextToken();
+
+		++loop_depth_;
+		auto body = ParseSuite();
+		--loop_depth_;
+
+		return make_unique<ast::While>(std::move(condition), std::move(body));
+	}
+
+	// ForLoop -> for Id in LogicalExpr: Suite
+	unique_ptr<ast::Statement> ParseForLoop()  // NOLINT
+	{
+		lexer_.Expect<TokenType::For>();
+		string var = lexer_.ExpectNext<TokenType::Id>().value;
+		Assign(var, nullptr);
+		lexer_.ExpectNext<TokenType::In>();
+		lexer_.NextToken();
+
+		auto iterable = ParseTest();
+
+		lexer_.Expect<TokenType::Char>(':');
+		lexer_.NextToken();
+
+		++loop_depth_;
+		auto body = ParseSuite();
+		--loop_depth_;
+
+		return make_unique<ast::ForEach>(std::move(var), std::move(iterable), std::move(body));
+	}
+
 	// LogicalExpr -> AndTest [OR AndTest]
 	// AndTest -> NotTest [AND NotTest]
 	// NotTest -> [NOT] NotTest
 	//          | Comparison
 	unique_ptr<ast::Statement> ParseTest()  // NOLINT
 	{
+		const auto position = lexer_.CurrentPosition();
 		auto result = ParseAndTest();
 		while (lexer_.CurrentToken().Is<TokenType::Or>()) {
 			lexer_.NextToken();
 			result = make_unique<ast::Or>(std::move(result), ParseAndTest());
 		}
-		return result;
+		return Located(position, std::move(result));
 	}
 
 	unique_ptr<ast::Statement> ParseAndTest()  // NOLINT
 	{
+		const auto position = lexer_.CurrentPosition();
 		auto result = ParseNotTest();
 		while (lexer_.CurrentToken().Is<TokenType::And>()) {
 			lexer_.NextToken();
 			result = make_unique<ast::And>(std::move(result), ParseNotTest());
 		}
-		return result;
+		return Located(position, std::move(result));
 	}
 
 	unique_ptr<ast::Statement> ParseNotTest()  // NOLINT
 	{
+		const auto position = lexer_.CurrentPosition();
 		if (lexer_.CurrentToken().Is<TokenType::Not>()) {
 			lexer_.NextToken();
-			return make_unique<ast::Not>(ParseNotTest());  // NOLINT
+			return Located(position, make_unique<ast::Not>(ParseNotTest()));  // NOLINT
 		}
-		return ParseComparison();
+		return Located(position, ParseComparison());
 	}
 
 	// Comparison -> Expr [COMP_OP Expr]
+	// COMP_OP -> '<' | '>' | '==' | '!=' | '<=' | '>=' | in
 	unique_ptr<ast::Statement> ParseComparison()  // NOLINT
 	{
 		auto result = ParseExpression();
@@ -393,39 +547,69 @@ private:
 			return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
 												ParseExpression());
 		}
+		if (tok.Is<TokenType::In>()) {
+			lexer_.NextToken();
+			return make_unique<ast::Comparison>(runtime::Contains, std::move(result),
+												ParseExpression());
+		}
 		return result;
 	}
 
 	// Statement -> SimpleStatement Newline
 	//           | class ClassDefinition
 	//           | if Condition
+	//           | while Loop
+	//           | for ForLoop
 	unique_ptr<ast::Statement> ParseStatement()  // NOLINT
 	{
+		const auto position = lexer_.CurrentPosition();
 		const auto& tok = lexer_.CurrentToken();
 
 		if (tok.Is<TokenType::Class>()) {
 			lexer_.NextToken();
-			return ParseClassDefinition();  // NOLINT
+			return Located(position, ParseClassDefinition());  // NOLINT
 		}
 		if (tok.Is<TokenType::If>()) {
-			return ParseCondition();
+			return Located(position, ParseCondition());
+		}
+		if (tok.Is<TokenType::While>()) {
+			return Located(position, ParseLoop());
+		}
+		if (tok.Is<TokenType::For>()) {
+			return Located(position, ParseForLoop());
 		}
 		auto result = ParseSimpleStatement();
 		lexer_.Expect<TokenType::Newline>();
 		lexer_.NextToken();
-		return result;
+		return Located(position, std::move(result));
 	}
 
 	// StatementBody -> return Expression
 	//               | print ExpressionList
+	//               | break
+	//               | continue
 	//               | AssignmentOrCall
 	unique_ptr<ast::Statement> ParseSimpleStatement() {
 		const auto& tok = lexer_.CurrentToken();
 
 		if (tok.Is<TokenType::Return>()) {
+			if (method_depth_ == 0) {
+				throw Error("return outside of a method"s);
+			}
 			lexer_.NextToken();
 			return make_unique<ast::Return>(ParseTest());
 		}
+		if (tok.Is<TokenType::Break>() || tok.Is<TokenType::Continue>()) {
+			const bool is_break = tok.Is<TokenType::Break>();
+			if (loop_depth_ == 0) {
+				throw Error((is_break ? "break"s : "continue"s) + " outside of a loop"s);
+			}
+			lexer_.NextToken();
+			if (is_break) {
+				return make_unique<ast::Break>();
+			}
+			return make_unique<ast::Continue>();
+		}
 		if (tok.Is<TokenType::Print>()) {
 			lexer_.NextToken();
 			vector<unique_ptr<ast::Statement>> args;
@@ -437,12 +621,85 @@ private:
 		return ParseAssignmentOrCall();
 	}
 
+	unique_ptr<ast::Statement> MakeMethodCall(vector<string> receiver, string method,
+											  vector<unique_ptr<ast::Statement>> args) {
+		auto call = make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(receiver), std::move(method),
+												 std::move(args));
+		if (receiver.size() == 1) {
+			call_sites_.push_back({call.get(), scope_, std::move(receiver.front())});
+		}
+		return call;
+	}
+
+	// Notes an assignment of value to name in the current scope, nullptr for other bindings
+	void Assign(const string& name, const ast::Statement* value) {
+		const auto* new_instance = dynamic_cast<const ast::NewInstance*>(value);
+		const runtime::Class* cls = new_instance != nullptr ? &new_instance->GetClass() : nullptr;
+		Scope& scope = scopes_[scope_];
+		if (name == "self"sv && !scope.class_name.empty()) {
+			cls = nullptr;
+		}
+		auto [it, inserted] = scope.names.emplace(name, cls);
+		if (!inserted && it->second != cls) {
+			it->second = nullptr;
+		}
+	}
+
+	// The method cls resolves name to, provided every class derived from cls resolves it to the same
+	const runtime::Method* FindNotOverridden(const runtime::Class& cls, const string& name) const {
+		const runtime::Method* method = cls.GetMethod(name);
+		if (method == nullptr) {
+			return nullptr;
+		}
+		for (const auto& [class_name, holder] : declared_classes_) {
+			const auto& derived = static_cast<const runtime::Class&>(*holder);  // NOLINT
+			for (const runtime::Class* base = derived.GetParent(); base != nullptr; base = base->GetParent()) {
+				if (base == &cls) {
+					if (derived.GetMethod(name) != method) {
+						return nullptr;
+					}
+					break;
+				}
+			}
+		}
+		return method;
+	}
+
+	// Whole program devirtualization. A variable every assignment of its scope makes an instance
+	// of one class calls the methods of that class; self calls the methods no class derived from
+	// the class of the method overrides. Other calls keep looking their methods up by name
+	void BindCalls() {
+		for (const CallSite& site : call_sites_) {
+			const Scope& scope = scopes_[site.scope];
+			const string& name = site.call->GetMethodName();
+			const runtime::Method* method = nullptr;
+			const runtime::Class* receiver_class = nullptr;
+			if (const auto it = scope.names.find(site.receiver); it != scope.names.end()) {
+				receiver_class = it->second;
+				method = receiver_class != nullptr ? receiver_class->GetMethod(name) : nullptr;
+			} else if (site.receiver == "self"sv && !scope.class_name.empty()) {
+				const auto& cls = static_cast<const runtime::Class&>(*declared_classes_.at(scope.class_name));  // NOLINT
+				method = FindNotOverridden(cls, name);
+			}
+			if (method != nullptr && method->formal_params.size() == site.call->GetArgumentCount()) {
+				site.call->Bind(*method, receiver_class);
+			}
+		}
+	}
+
 	parse::Lexer& lexer_;
+	ast::SourceMap source_map_;
 	runtime::Closure declared_classes_;
+	size_t loop_depth_ = 0;
+	size_t method_depth_ = 0;
+	// The top level is the first scope, each method body adds one
+	vector<Scope> scopes_;
+	size_t scope_ = 0;
+	vector<CallSite> call_sites_;
 };
 
 }  // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
+unique_ptr<ast::Program> ParseProgram(parse::Lexer& lexer) {
 	return Parser{lexer}.ParseProgram();
 }
@@ -7,12 +7,12 @@ namespace parse {
 class Lexer;
 }
 
-namespace runtime {
-class Executable;
+namespace ast {
+class Program;
 }
 
 struct ParseError : std::runtime_error {
 	using std::runtime_error::runtime_error;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
+std::unique_ptr<ast::Program> ParseProgram(parse::Lexer& lexer);
@@ -0,0 +1,391 @@
+#include "profiler.h"
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+
+#include <sys/time.h>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+thread_local Profiler* current_profiler = nullptr;
+thread_local ShadowStack* current_shadow_stack = nullptr;
+atomic<SamplingProfiler*> running_sampler{nullptr};
+
+// The class whose definition contains the method, so inherited methods are reported once
+const Class& DefiningClass(const Class& cls, const Method& method) {
+	const Class* result = &cls;
+	while (result->GetParent() != nullptr && result->GetParent()->GetMethod(method.name) == &method) {
+		result = result->GetParent();
+	}
+	return *result;
+}
+
+string LineOf(const Executable* statement, const ast::SourceMap& source_map) {
+	const auto* node = dynamic_cast<const ast::Statement*>(statement);
+	const auto position = node != nullptr ? source_map.Find(node) : nullopt;
+	return position ? ":"s + to_string(position->line) : ""s;
+}
+
+double ToMilliseconds(Profiler::Clock::duration duration) {
+	return chrono::duration<double, milli>(duration).count();
+}
+
+}  // namespace
+
+Profiler::Activation::Activation(Profiler& profiler)
+	: previous_(current_profiler) {
+	current_profiler = &profiler;
+	profiler.started_ = Clock::now();
+}
+
+Profiler::Activation::~Activation() {
+	current_profiler->total_ += Clock::now() - current_profiler->started_;
+	current_profiler = previous_;
+}
+
+Profiler* Profiler::Current() {
+	return current_profiler;
+}
+
+Profiler::Profiler() {
+	paths_.push_back({0, nullptr, {}, {}});
+}
+
+void Profiler::EnterMethod(const Class& cls, const Method& method) {
+	const size_t parent_path = method_stack_.empty() ? 0 : method_stack_.back().path_node;
+	Enter(method_stack_, StatsOf(cls, method), ChildPath(parent_path, method));
+}
+
+void Profiler::LeaveMethod() {
+	const size_t path_node = method_stack_.back().path_node;
+	paths_[path_node].exclusive += Leave(method_stack_);
+}
+
+void Profiler::ReplaceMethod(const Class& cls, const Method& method) {
+	if (method_stack_.empty()) {
+		return;
+	}
+	const size_t caller_path = paths_[method_stack_.back().path_node].parent;
+	LeaveMethod();
+	Enter(method_stack_, StatsOf(cls, method), ChildPath(caller_path, method));
+}
+
+void Profiler::EnterStatement(const Executable& statement) {
+	Enter(statement_stack_, statements_[&statement], 0);
+}
+
+void Profiler::LeaveStatement() {
+	Leave(statement_stack_);
+}
+
+void Profiler::Enter(vector<Frame>& stack, Stats& stats, size_t path_node) {
+	++stats.count;
+	++stats.active;
+	stack.push_back({&stats, Clock::now(), {}, path_node});
+}
+
+Profiler::Clock::duration Profiler::Leave(vector<Frame>& stack) {
+	const Frame frame = stack.back();
+	stack.pop_back();
+	const Clock::duration elapsed = Clock::now() - frame.start;
+	const Clock::duration exclusive = elapsed - frame.children;
+	frame.stats->exclusive += exclusive;
+	if (--frame.stats->active == 0) {
+		frame.stats->inclusive += elapsed;
+	}
+	if (!stack.empty()) {
+		stack.back().children += elapsed;
+	} else if (&stack == &method_stack_) {
+		top_level_ += elapsed;
+	}
+	return exclusive;
+}
+
+Profiler::MethodStats& Profiler::StatsOf(const Class& cls, const Method& method) {
+	auto [it, inserted] = methods_.try_emplace(&method);
+	if (inserted) {
+		it->second.name = DefiningClass(cls, method).GetName() + "."s + method.name;
+	}
+	return it->second;
+}
+
+size_t Profiler::ChildPath(size_t parent, const Method& method) {
+	const auto [it, inserted] = paths_[parent].children.try_emplace(&method, paths_.size());
+	const size_t node = it->second;
+	if (inserted) {
+		paths_.push_back({parent, &method, {}, {}});
+	}
+	return node;
+}
+
+void Profiler::ReportFlat(ostream& out, const ast::SourceMap& source_map) const {
+	vector<const MethodStats*> methods;
+	methods.reserve(methods_.size());
+	for (const auto& [method, stats] : methods_) {
+		methods.push_back(&stats);
+	}
+	sort(methods.begin(), methods.end(), [](const MethodStats* lhs, const MethodStats* rhs) {
+		return lhs->exclusive > rhs->exclusive;
+	});
+
+	// Statements sharing a line are reported together. A returned expression runs apart from its
+	// return statement, so the runs of a line are those of its most frequent statement
+	map<size_t, Stats> lines;
+	for (const auto& [statement, stats] : statements_) {
+		const auto* node = dynamic_cast<const ast::Statement*>(statement);
+		const auto position = node != nullptr ? source_map.Find(node) : nullopt;
+		if (!position) {
+			continue;
+		}
+		Stats& line = lines[position->line];
+		line.count = max(line.count, stats.count);
+		line.inclusive += stats.inclusive;
+		line.exclusive += stats.exclusive;
+	}
+	vector<pair<size_t, Stats>> sorted_lines(lines.begin(), lines.end());
+	stable_sort(sorted_lines.begin(), sorted_lines.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.second.exclusive > rhs.second.exclusive;
+	});
+
+	const ios_base::fmtflags flags = out.flags();
+	const streamsize precision = out.precision();
+	out << fixed << setprecision(3);
+	out << setw(10) << "calls" << setw(14) << "incl, ms" << setw(14) << "excl, ms" << "  method\n";
+	for (const MethodStats* stats : methods) {
+		out << setw(10) << stats->count << setw(14) << ToMilliseconds(stats->inclusive)
+			<< setw(14) << ToMilliseconds(stats->exclusive) << "  " << stats->name << '\n';
+	}
+	out << '\n';
+	out << setw(10) << "runs" << setw(14) << "incl, ms" << setw(14) << "excl, ms" << "  line\n";
+	for (const auto& [line, stats] : sorted_lines) {
+		out << setw(10) << stats.count << setw(14) << ToMilliseconds(stats.inclusive)
+			<< setw(14) << ToMilliseconds(stats.exclusive) << "  " << line << '\n';
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+void Profiler::ReportCollapsed(ostream& out) const {
+	const Clock::duration module_time = total_ > top_level_ ? total_ - top_level_ : Clock::duration{};
+	for (size_t node = 0; node < paths_.size(); ++node) {
+		const Clock::duration exclusive = node == 0 ? module_time : paths_[node].exclusive;
+		const auto microseconds = chrono::duration_cast<chrono::microseconds>(exclusive).count();
+		vector<const string*> names;
+		for (size_t current = node; current != 0; current = paths_[current].parent) {
+			names.push_back(&methods_.at(paths_[current].method).name);
+		}
+		out << "<module>";
+		for (auto it = names.rbegin(); it != names.rend(); ++it) {
+			out << ';' << **it;
+		}
+		out << ' ' << microseconds << '\n';
+	}
+}
+
+ShadowStack::Activation::Activation(ShadowStack& stack)
+	: previous_(current_shadow_stack) {
+	current_shadow_stack = &stack;
+}
+
+ShadowStack::Activation::~Activation() {
+	current_shadow_stack = previous_;
+}
+
+ShadowStack* ShadowStack::Current() {
+	return current_shadow_stack;
+}
+
+void ShadowStack::Push(const Class& cls, const Method& method) {
+	const size_t depth = depth_.load(memory_order_relaxed);
+	if (depth < CAPACITY) {
+		Frame& frame = frames_[depth];
+		frame.cls.store(&cls, memory_order_relaxed);
+		frame.method.store(&method, memory_order_relaxed);
+		frame.statement.store(nullptr, memory_order_relaxed);
+	}
+	// The handler must not see the new depth before the frame
+	atomic_signal_fence(memory_order_release);
+	depth_.store(depth + 1, memory_order_relaxed);
+}
+
+void ShadowStack::Pop() {
+	depth_.store(depth_.load(memory_order_relaxed) - 1, memory_order_relaxed);
+}
+
+void ShadowStack::Replace(const Class& cls, const Method& method) {
+	Frame& frame = Top();
+	frame.cls.store(&cls, memory_order_relaxed);
+	frame.method.store(&method, memory_order_relaxed);
+	frame.statement.store(nullptr, memory_order_relaxed);
+}
+
+size_t ShadowStack::Depth() const {
+	return min(depth_.load(memory_order_relaxed), CAPACITY);
+}
+
+const ShadowStack::Frame& ShadowStack::At(size_t index) const {
+	return frames_[index];
+}
+
+SamplingProfiler::SamplingProfiler(chrono::microseconds interval)
+	: interval_(interval), slots_(make_unique<Slot[]>(TABLE_SIZE)) {
+}
+
+SamplingProfiler::~SamplingProfiler() {
+	Stop();
+}
+
+void SamplingProfiler::Start() {
+	if (running_) {
+		return;
+	}
+	SamplingProfiler* expected = nullptr;
+	if (!running_sampler.compare_exchange_strong(expected, this)) {
+		throw runtime_error("Another sampling profiler is running"s);
+	}
+	struct sigaction action{};
+	action.sa_handler = &SamplingProfiler::HandleSignal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGPROF, &action, &previous_action_) != 0) {
+		running_sampler.store(nullptr);
+		throw runtime_error("Cannot install the SIGPROF handler: "s + strerror(errno));
+	}
+	itimerval timer{};
+	timer.it_interval.tv_sec = static_cast<time_t>(interval_.count() / 1'000'000);
+	timer.it_interval.tv_usec = static_cast<suseconds_t>(interval_.count() % 1'000'000);
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+		sigaction(SIGPROF, &previous_action_, nullptr);
+		running_sampler.store(nullptr);
+		throw runtime_error("Cannot start the profiling timer: "s + strerror(errno));
+	}
+	running_ = true;
+}
+
+void SamplingProfiler::Stop() {
+	if (!running_) {
+		return;
+	}
+	const itimerval disabled{};
+	setitimer(ITIMER_PROF, &disabled, nullptr);
+	sigaction(SIGPROF, &previous_action_, nullptr);
+	running_sampler.store(nullptr);
+	running_ = false;
+}
+
+uint64_t SamplingProfiler::GetSampleCount() const {
+	return samples_.load(memory_order_relaxed);
+}
+
+uint64_t SamplingProfiler::GetMissedCount() const {
+	return missed_.load(memory_order_relaxed);
+}
+
+void SamplingProfiler::HandleSignal(int /*signal*/) {
+	const int saved_errno = errno;
+	SamplingProfiler* sampler = running_sampler.load(memory_order_acquire);
+	if (sampler != nullptr) {
+		sampler->samples_.fetch_add(1, memory_order_relaxed);
+		if (const ShadowStack* stack = ShadowStack::Current()) {
+			sampler->Record(*stack);
+		} else {
+			sampler->missed_.fetch_add(1, memory_order_relaxed);
+		}
+	}
+	errno = saved_errno;
+}
+
+void SamplingProfiler::Record(const ShadowStack& stack) {
+	array<SampleFrame, MAX_SAMPLE_DEPTH> frames;
+	const size_t depth = min(stack.Depth(), MAX_SAMPLE_DEPTH);
+	atomic_signal_fence(memory_order_acquire);
+	uint64_t hash = 14'695'981'039'346'656'037ULL;
+	const auto mix = [&hash](const void* pointer) {
+		hash = (hash ^ reinterpret_cast<uintptr_t>(pointer)) * 1'099'511'628'211ULL;
+	};
+	for (size_t i = 0; i < depth; ++i) {
+		const ShadowStack::Frame& frame = stack.At(i);
+		frames[i] = {frame.cls.load(memory_order_relaxed), frame.method.load(memory_order_relaxed),
+					 frame.statement.load(memory_order_relaxed)};
+		mix(frames[i].method);
+		mix(frames[i].statement);
+	}
+	hash = max<uint64_t>(hash, 1);  // zero marks a free slot
+
+	const auto same_stack = [&](const Slot& slot) {
+		if (slot.depth != depth) {
+			return false;
+		}
+		for (size_t i = 0; i < depth; ++i) {
+			if (slot.frames[i].method != frames[i].method || slot.frames[i].statement != frames[i].statement) {
+				return false;
+			}
+		}
+		return true;
+	};
+	for (size_t probe = 0; probe < TABLE_SIZE; ++probe) {
+		Slot& slot = slots_[(hash + probe) % TABLE_SIZE];
+		uint64_t slot_hash = slot.hash.load(memory_order_acquire);
+		if (slot_hash == 0) {
+			if (!slot.hash.compare_exchange_strong(slot_hash, hash, memory_order_acq_rel)) {
+				--probe;  // taken by another thread meanwhile, look at it again
+				continue;
+			}
+			slot.depth = depth;
+			copy(frames.begin(), frames.begin() + depth, slot.frames.begin());
+			slot.count.store(1, memory_order_relaxed);
+			slot.ready.store(true, memory_order_release);
+			return;
+		}
+		if (slot_hash == hash) {
+			if (!slot.ready.load(memory_order_acquire)) {
+				break;  // being filled by another thread
+			}
+			if (same_stack(slot)) {
+				slot.count.fetch_add(1, memory_order_relaxed);
+				return;
+			}
+		}
+	}
+	missed_.fetch_add(1, memory_order_relaxed);
+}
+
+void SamplingProfiler::Report(ostream& out, const ast::SourceMap& source_map) const {
+	map<string, uint64_t> stacks;
+	for (size_t i = 0; i < TABLE_SIZE; ++i) {
+		const Slot& slot = slots_[i];
+		if (!slot.ready.load(memory_order_acquire)) {
+			continue;
+		}
+		string stack;
+		for (size_t j = 0; j < slot.depth; ++j) {
+			const SampleFrame& frame = slot.frames[j];
+			if (j == 0) {
+				stack += "<module>"s;
+			} else {
+				stack += ';';
+				stack += DefiningClass(*frame.cls, *frame.method).GetName() + "."s + frame.method->name;
+			}
+			stack += LineOf(frame.statement, source_map);
+		}
+		// Stacks differing in the statements without known lines are merged
+		stacks[stack] += slot.count.load(memory_order_relaxed);
+	}
+	for (const auto& [stack, count] : stacks) {
+		out << stack << ' ' << count << '\n';
+	}
+}
+
+}  // namespace runtime
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <signal.h>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ast {
+class SourceMap;
+}
+
+namespace runtime {
+
+class Class;
+class Executable;
+struct Method;
+
+// Instrumenting profiler: counts calls and measures inclusive and exclusive time of the methods
+// and of the source lines of a program. The interpreter reports to the profiler installed for
+// the current thread; with none installed the hooks cost a single check per block and per call.
+// Inclusive time of recursive methods and lines is taken from their outermost activation only
+class Profiler {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Installs the profiler for the current thread until the guard is destroyed
+	class Activation {
+	public:
+		explicit Activation(Profiler& profiler);
+		Activation(const Activation&) = delete;
+		Activation& operator=(const Activation&) = delete;
+		~Activation();
+	private:
+		Profiler* previous_;
+	};
+
+	class MethodScope {
+	public:
+		MethodScope(Profiler& profiler, const Class& cls, const Method& method)
+			: profiler_(profiler) {
+			profiler_.EnterMethod(cls, method);
+		}
+		MethodScope(const MethodScope&) = delete;
+		MethodScope& operator=(const MethodScope&) = delete;
+		~MethodScope() {
+			profiler_.LeaveMethod();
+		}
+	private:
+		Profiler& profiler_;
+	};
+
+	class StatementScope {
+	public:
+		StatementScope(Profiler& profiler, const Executable& statement)
+			: profiler_(profiler) {
+			profiler_.EnterStatement(statement);
+		}
+		StatementScope(const StatementScope&) = delete;
+		StatementScope& operator=(const StatementScope&) = delete;
+		~StatementScope() {
+			profiler_.LeaveStatement();
+		}
+	private:
+		Profiler& profiler_;
+	};
+
+	[[nodiscard]] static Profiler* Current();
+
+	Profiler();
+
+	void EnterMethod(const Class& cls, const Method& method);
+	void LeaveMethod();
+	// A tail call: the callee takes over the frame of the method being left
+	void ReplaceMethod(const Class& cls, const Method& method);
+	void EnterStatement(const Executable& statement);
+	void LeaveStatement();
+
+	// Methods and lines ordered by exclusive time; statements the map does not know are skipped
+	void ReportFlat(std::ostream& out, const ast::SourceMap& source_map) const;
+	// One line per call path of methods with its exclusive time in microseconds, the input
+	// format of flame graph tools
+	void ReportCollapsed(std::ostream& out) const;
+
+private:
+	struct Stats {
+		uint64_t count = 0;
+		Clock::duration inclusive{};
+		Clock::duration exclusive{};
+		uint32_t active = 0;
+	};
+
+	struct MethodStats : Stats {
+		std::string name;
+	};
+
+	// Call paths form a tree, the root is the code outside of any method
+	struct PathNode {
+		size_t parent;
+		const Method* method;
+		Clock::duration exclusive{};
+		std::unordered_map<const Method*, size_t> children;
+	};
+
+	struct Frame {
+		Stats* stats;
+		Clock::time_point start;
+		Clock::duration children{};
+		size_t path_node = 0;
+	};
+
+	void Enter(std::vector<Frame>& stack, Stats& stats, size_t path_node);
+	// Returns the exclusive time of the frame
+	Clock::duration Leave(std::vector<Frame>& stack);
+	MethodStats& StatsOf(const Class& cls, const Method& method);
+	size_t ChildPath(size_t parent, const Method& method);
+
+	std::unordered_map<const Method*, MethodStats> methods_;
+	std::unordered_map<const Executable*, Stats> statements_;
+	std::vector<PathNode> paths_;
+	std::vector<Frame> method_stack_;
+	std::vector<Frame> statement_stack_;
+	Clock::time_point started_;
+	Clock::duration total_{};      // time spent under activations
+	Clock::duration top_level_{};  // time spent in the outermost method calls
+};
+
+// The Mython calls being executed by the current thread, kept by the interpreter while a shadow
+// stack is installed. Every frame holds the class and the method called and the statement it
+// executes; the bottom frame is the code outside of any method. Frames are updated with relaxed
+// atomics, so a signal handler interrupting the thread always sees whole values
+class ShadowStack {
+public:
+	static constexpr size_t CAPACITY = 256;
+
+	struct Frame {
+		std::atomic<const Class*> cls{nullptr};
+		std::atomic<const Method*> method{nullptr};
+		std::atomic<const Executable*> statement{nullptr};
+	};
+
+	// Installs the stack for the current thread until the guard is destroyed
+	class Activation {
+	public:
+		explicit Activation(ShadowStack& stack);
+		Activation(const Activation&) = delete;
+		Activation& operator=(const Activation&) = delete;
+		~Activation();
+	private:
+		ShadowStack* previous_;
+	};
+
+	class CallScope {
+	public:
+		CallScope(ShadowStack& stack, const Class& cls, const Method& method)
+			: stack_(stack) {
+			stack_.Push(cls, method);
+		}
+		CallScope(const CallScope&) = delete;
+		CallScope& operator=(const CallScope&) = delete;
+		~CallScope() {
+			stack_.Pop();
+		}
+	private:
+		ShadowStack& stack_;
+	};
+
+	[[nodiscard]] static ShadowStack* Current();
+
+	// Calls deeper than the capacity are counted but not recorded
+	void Push(const Class& cls, const Method& method);
+	void Pop();
+	// A tail call: the callee takes over the top frame
+	void Replace(const Class& cls, const Method& method);
+	void SetStatement(const Executable& statement) {
+		Top().statement.store(&statement, std::memory_order_relaxed);
+	}
+
+	// The number of recorded frames, the module frame included
+	[[nodiscard]] size_t Depth() const;
+	[[nodiscard]] const Frame& At(size_t index) const;
+
+private:
+	Frame& Top() {
+		const size_t depth = depth_.load(std::memory_order_relaxed);
+		return frames_[depth <= CAPACITY ? depth - 1 : CAPACITY - 1];
+	}
+
+	std::array<Frame, CAPACITY> frames_;
+	std::atomic<size_t> depth_{1};
+};
+
+// Statistical profiler for long running programs: a SIGPROF timer periodically interrupts the
+// process and the handler adds the shadow stack of the interrupted thread to a fixed hash table
+// of call stacks. The handler neither allocates nor locks, the interpreter only keeps the shadow
+// stack, so the profiler can stay on in production. One sampler runs in a process at a time
+class SamplingProfiler {
+public:
+	static constexpr size_t MAX_SAMPLE_DEPTH = 32;
+	static constexpr size_t TABLE_SIZE = 2048;
+
+	explicit SamplingProfiler(std::chrono::microseconds interval = std::chrono::milliseconds(10));
+	SamplingProfiler(const SamplingProfiler&) = delete;
+	SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+	~SamplingProfiler();
+
+	// Throws when another sampler runs or the timer cannot be set up
+	void Start();
+	void Stop();
+
+	[[nodiscard]] uint64_t GetSampleCount() const;
+	// Samples lost because no shadow stack was installed or the table was full
+	[[nodiscard]] uint64_t GetMissedCount() const;
+
+	// Collapsed stacks, "<module>:line;Class.method:line count" per line; frames deeper than
+	// MAX_SAMPLE_DEPTH are cut off. Can be called while the sampler runs
+	void Report(std::ostream& out, const ast::SourceMap& source_map) const;
+
+private:
+	struct SampleFrame {
+		const Class* cls;
+		const Method* method;
+		const Executable* statement;
+	};
+
+	struct Slot {
+		std::atomic<uint64_t> hash{0};
+		std::atomic<bool> ready{false};
+		std::atomic<uint64_t> count{0};
+		size_t depth = 0;
+		std::array<SampleFrame, MAX_SAMPLE_DEPTH> frames;
+	};
+
+	static void HandleSignal(int signal);
+	void Record(const ShadowStack& stack);
+
+	std::chrono::microseconds interval_;
+	std::unique_ptr<Slot[]> slots_;
+	std::atomic<uint64_t> samples_{0};
+	std::atomic<uint64_t> missed_{0};
+	bool running_ = false;
+	struct sigaction previous_action_{};
+};
+
+}  // namespace runtime
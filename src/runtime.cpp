@@ -1,6 +1,11 @@
 #include "runtime.h"
 
+#include "memo.h"
+#include "profiler.h"
+
 #include <cassert>
+#include <charconv>
+#include <limits>
 #include <optional>
 #include <sstream>
 
@@ -11,16 +16,49 @@ using namespace std;
 
 namespace runtime {
 
-ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
-	: data_(std::move(data)) {
+void Context::SetLimits(const ExecutionLimits& limits) {
+	limits_ = limits;
+	// Wraps around to the maximum for the largest budget, which is as good as unbounded
+	steps_left_ = limits.max_steps == 0 ? numeric_limits<uint64_t>::max() : limits.max_steps + 1;
+	max_call_depth_ = limits.max_call_depth == 0 ? numeric_limits<size_t>::max() : limits.max_call_depth;
+}
+
+void Context::OnStepLimit() {
+	throw LimitExceeded("Step limit of "s + to_string(limits_.max_steps) + " statements exceeded"s);
+}
+
+void Context::OnCallDepthLimit() {
+	throw LimitExceeded("Call depth limit of "s + to_string(limits_.max_call_depth) + " exceeded"s);
+}
+
+void Context::OnCancelled() const {
+	if (cancellation_->GetReason() == CancelReason::Deadline) {
+		throw Cancelled("Deadline exceeded"s);
+	}
+	throw Cancelled("Execution cancelled"s);
 }
 
 void ObjectHolder::AssertIsValid() const {
-	assert(data_ != nullptr);
+	assert(Get() != nullptr);
+}
+
+void* Object::operator new(std::size_t size) {
+	Heap::Current().OnAllocate(size);
+	return ::operator new(size);
+}
+
+void Object::operator delete(void* ptr, std::size_t size) noexcept {
+	Heap::Current().OnDeallocate(size);
+	::operator delete(ptr);
 }
 
 ObjectHolder ObjectHolder::Share(Object& object) {
-	return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+	if (object.type_ == ObjectType::Number) {
+		return FromNumber(static_cast<Number&>(object).GetValue());
+	}
+	ObjectHolder result(&object);
+	result.Retain();
+	return result;
 }
 
 ObjectHolder ObjectHolder::None() {
@@ -37,14 +75,6 @@ Object* ObjectHolder::operator->() const {
 	return Get();
 }
 
-Object* ObjectHolder::Get() const {
-	return data_.get();
-}
-
-ObjectHolder::operator bool() const {
-	return Get() != nullptr;
-}
-
 inline bool StringToBool(std::string_view str_v) {
 	using namespace std::literals;
 	return str_v == "True"sv ? true : false;
@@ -58,18 +88,23 @@ inline ClassInstance* ConvertNumsAdressToPointer(std::stringstream& stream) {
 }
 
 bool IsTrue(const ObjectHolder& object) {
-	using namespace std::literals;
-	std::stringstream string_stream;
-	SimpleContext SC(std::cout);
-	if (object) {
-		(object.Get())->Print(string_stream, SC);
-		if (object.TryAs<String>()) {
-			return !string_stream.str().empty() ? true : false;
-		} else if (object.TryAs<Number>()) {
-			return std::stoi(string_stream.str()) != 0 ? true : false;
-		} else if (object.TryAs<Bool>()) {
-			return string_stream.str() == "True"sv ? true : false;
-		}
+	if (const auto* boolean = object.TryAs<Bool>()) {
+		return boolean->GetValue();
+	}
+	if (const auto number = object.TryAsNumber()) {
+		return *number != 0;
+	}
+	if (const auto* str = object.TryAs<String>()) {
+		return !str->GetValue().empty();
+	}
+	if (object.TryAs<BigNumber>()) {
+		return true;
+	}
+	if (const auto* list = object.TryAs<List>()) {
+		return list->Size() != 0;
+	}
+	if (const auto* dict = object.TryAs<Dict>()) {
+		return dict->Size() != 0;
 	}
 	return false;
 }
@@ -78,7 +113,7 @@ void ClassInstance::Print(std::ostream& os, Context& context) {
 	if (cls_.GetMethod("__str__") != nullptr) {
 		std::ostringstream str_stream;
 		ObjectHolder result = Call("__str__", {}, context);
-		result.Get()->Print(os, context);
+		PrintValue(result, os, context);
 	} else {
 		os << this;
 	}
@@ -92,24 +127,462 @@ bool ClassInstance::HasMethod(const std::string& method, size_t argument_count)
 Closure& ClassInstance::Fields() { return glosure_; }
 const Closure& ClassInstance::Fields() const { return glosure_; }
 
-ClassInstance::ClassInstance(const Class& cls) : cls_(cls) { }
+const Class& ClassInstance::GetClass() const { return cls_; }
+
+void ClassInstance::VisitReferences(ReferenceVisitor& visitor) {
+	for (const auto& [name, field] : glosure_) {
+		visitor.Visit(field);
+	}
+}
+
+void ClassInstance::ClearReferences() {
+	glosure_.clear();
+}
+
+ClassInstance::ClassInstance(const Class& cls) : Object(ObjectType::ClassInstance), cls_(cls) {
+	EnableCycleTracking();
+}
+
+const Method& ClassInstance::FindMethod(const std::string& method, size_t argument_count) const {
+	const Method* method_ptr = cls_.GetMethod(method);
+	if (method_ptr == nullptr || method_ptr->formal_params.size() != argument_count) {
+		throw std::runtime_error("Not implemented_"s);
+	}
+	return *method_ptr;
+}
+
+void ClassInstance::BindArguments(const Method& method, ObjectHolder self,
+								  ArgumentList actual_args, Closure& closure) {
+	closure.insert({"self", std::move(self)});
+	for (size_t i = 0; i < actual_args.size(); ++i) {
+		closure[method.formal_params[i]] = actual_args[i];
+	}
+}
+
+ObjectHolder Executable::Call(const Method& method, ObjectHolder self,
+							  ArgumentList actual_args, Context& context) {
+	Closure closure;
+	ClassInstance::BindArguments(method, std::move(self), actual_args, closure);
+	return Execute(closure, context);
+}
 
 ObjectHolder ClassInstance::Call(const std::string& method,
-								 const std::vector<ObjectHolder>& actual_args,
+								 ArgumentList actual_args,
 								 Context& context) {
-	if (HasMethod(method, actual_args.size())) {
-		const Method* method_ptr = cls_.GetMethod(method);
-		Closure glosure;
-		glosure.insert({"self", ObjectHolder::Share(*this)});
-		for (size_t i = 0; i < actual_args.size(); ++i) {
-			glosure[method_ptr->formal_params[i]] = actual_args[i];
+	return Call(FindMethod(method, actual_args.size()), actual_args, context);
+}
+
+ObjectHolder ClassInstance::Call(const Method& method_ref, ArgumentList actual_args, Context& context) {
+	MYTHON_COUNT(method_calls);
+	context.CheckCancelled();
+	Context::CallScope call_scope(context);
+	// Both engines keep the shadow stack, the sampler sees the calls as they run in production
+	optional<ShadowStack::CallScope> sampled;
+	if (ShadowStack* shadow_stack = ShadowStack::Current()) {
+		sampled.emplace(*shadow_stack, cls_, method_ref);
+	}
+	Profiler* profiler = Profiler::Current();
+	if (profiler == nullptr) {
+		if (MemoCache* memoization = context.GetMemoization()) {
+			return memoization->Call(*this, method_ref, actual_args, context);
+		}
+		return method_ref.body->Call(method_ref, ObjectHolder::Share(*this), actual_args, context);
+	}
+	// The instrumenting profiler follows the statements of the syntax trees
+	Closure glosure;
+	BindArguments(method_ref, ObjectHolder::Share(*this), actual_args, glosure);
+	Profiler::MethodScope profiled(*profiler, cls_, method_ref);
+	return method_ref.body->Execute(glosure, context);
+}
+
+namespace {
+
+size_t MixHash(size_t hash) {
+	uint64_t h = hash;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return static_cast<size_t>(h);
+}
+
+size_t HashKey(const ObjectHolder& key, Context& context) {
+	if (const auto number = key.TryAsNumber()) {
+		return MixHash(std::hash<int64_t>{}(*number));
+	}
+	if (const auto* big_number = key.TryAs<BigNumber>()) {
+		return MixHash(big_number->GetValue().Hash());
+	}
+	if (const auto* str = key.TryAs<String>()) {
+		return std::hash<std::string_view>{}(str->GetValue());
+	}
+	if (const auto* boolean = key.TryAs<Bool>()) {
+		return MixHash(boolean->GetValue() ? 1U : 0U);
+	}
+	if (auto* instance = key.TryAs<ClassInstance>()) {
+		if (instance->HasMethod("__hash__"s, 0U)) {
+			ObjectHolder hash = instance->Call("__hash__"s, {}, context);
+			if (const auto number = hash.TryAsNumber()) {
+				return MixHash(std::hash<int64_t>{}(*number));
+			}
+			throw std::runtime_error("__hash__ must return a number"s);
+		}
+		return MixHash(std::hash<const void*>{}(instance));
+	}
+	throw std::runtime_error("Unhashable dictionary key"s);
+}
+
+// Equality of keys and list items: values of different built-in types are never equal
+bool SameValue(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+	if (const auto number = lhs.TryAsNumber()) {
+		return number == rhs.TryAsNumber();
+	}
+	if (const auto* big_number = lhs.TryAs<BigNumber>()) {
+		const auto* other = rhs.TryAs<BigNumber>();
+		return other != nullptr && big_number->GetValue() == other->GetValue();
+	}
+	if (const auto* str = lhs.TryAs<String>()) {
+		const auto* other = rhs.TryAs<String>();
+		return other != nullptr && str->GetValue() == other->GetValue();
+	}
+	if (const auto* boolean = lhs.TryAs<Bool>()) {
+		const auto* other = rhs.TryAs<Bool>();
+		return other != nullptr && boolean->GetValue() == other->GetValue();
+	}
+	if (auto* instance = lhs.TryAs<ClassInstance>(); instance != nullptr && instance->HasMethod("__eq__"s, 1U)) {
+		return IsTrue(instance->Call("__eq__"s, {rhs}, context));
+	}
+	// Get() is nullptr for None and Numbers alike
+	return !rhs.TryAsNumber() && lhs.Get() == rhs.Get();
+}
+
+}  // namespace
+
+List::List() : Object(ObjectType::List) {
+	EnableCycleTracking();
+}
+
+List::List(std::vector<ObjectHolder> items) : Object(ObjectType::List), items_(std::move(items)) {
+	EnableCycleTracking();
+}
+
+void List::Print(std::ostream& os, Context& context) {
+	os << '[';
+	for (size_t i = 0; i < items_.size(); ++i) {
+		if (i != 0) {
+			os << ", "sv;
+		}
+		PrintValue(items_[i], os, context);
+	}
+	os << ']';
+}
+
+ObjectHolder List::Call(const std::string& method, ArgumentList actual_args) {
+	if (method == "append"sv && actual_args.size() == 1) {
+		items_.push_back(actual_args.front());
+		return ObjectHolder::None();
+	}
+	if (method == "pop"sv && actual_args.empty()) {
+		if (items_.empty()) {
+			throw std::runtime_error("pop from empty list"s);
+		}
+		ObjectHolder result = std::move(items_.back());
+		items_.pop_back();
+		return result;
+	}
+	throw std::runtime_error("List has no method "s + method);
+}
+
+size_t List::Size() const {
+	return items_.size();
+}
+
+ObjectHolder& List::At(const ObjectHolder& index) {
+	const auto number = index.TryAsNumber();
+	if (!number) {
+		throw std::runtime_error("List indices must be numbers"s);
+	}
+	const long long size = static_cast<long long>(items_.size());
+	long long position = *number;
+	if (position < 0) {
+		position += size;
+	}
+	if (position < 0 || position >= size) {
+		throw std::runtime_error("List index out of range"s);
+	}
+	return items_[static_cast<size_t>(position)];
+}
+
+std::vector<ObjectHolder>& List::Items() {
+	return items_;
+}
+
+const std::vector<ObjectHolder>& List::Items() const {
+	return items_;
+}
+
+void List::VisitReferences(ReferenceVisitor& visitor) {
+	for (const auto& item : items_) {
+		visitor.Visit(item);
+	}
+}
+
+void List::ClearReferences() {
+	items_.clear();
+}
+
+Dict::Dict() : Object(ObjectType::Dict) {
+	EnableCycleTracking();
+}
+
+void Dict::Print(std::ostream& os, Context& context) {
+	os << '{';
+	bool first = true;
+	for (const Entry& entry : entries_) {
+		if (!entry.key) {
+			continue;
+		}
+		if (!first) {
+			os << ", "sv;
+		}
+		first = false;
+		PrintValue(entry.key, os, context);
+		os << ": "sv;
+		PrintValue(entry.value, os, context);
+	}
+	os << '}';
+}
+
+ObjectHolder Dict::Call(const std::string& method, ArgumentList actual_args, Context& context) {
+	if (method == "get"sv && actual_args.size() == 1) {
+		ObjectHolder* value = Find(actual_args.front(), context);
+		return value != nullptr ? *value : ObjectHolder::None();
+	}
+	if (method == "pop"sv && actual_args.size() == 1) {
+		ObjectHolder result = At(actual_args.front(), context);
+		Erase(actual_args.front(), context);
+		return result;
+	}
+	if (method == "keys"sv && actual_args.empty()) {
+		return ObjectHolder::Own(List(Keys()));
+	}
+	if (method == "values"sv && actual_args.empty()) {
+		return ObjectHolder::Own(List(Values()));
+	}
+	throw std::runtime_error("Dict has no method "s + method);
+}
+
+size_t Dict::Size() const {
+	return size_;
+}
+
+size_t Dict::FindSlot(const ObjectHolder& key, size_t hash, Context& context) const {
+	const uint64_t generation = generation_;
+	const size_t mask = index_.size() - 1;
+	std::optional<size_t> first_erased;
+	for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+		const int32_t entry_id = index_[slot];
+		if (entry_id == EMPTY_SLOT) {
+			return first_erased.value_or(slot);
+		}
+		if (entry_id == ERASED_SLOT) {
+			if (!first_erased) {
+				first_erased = slot;
+			}
+			continue;
+		}
+		const Entry& entry = entries_[static_cast<size_t>(entry_id)];
+		if (entry.hash != hash) {
+			continue;
+		}
+		// __eq__ may change the dictionary, the key is held while it runs
+		const ObjectHolder entry_key = entry.key;
+		const bool same = SameValue(entry_key, key, context);
+		if (generation_ != generation) {
+			return FindSlot(key, hash, context);
+		}
+		if (same) {
+			return slot;
+		}
+	}
+}
+
+ObjectHolder* Dict::Find(const ObjectHolder& key, Context& context) {
+	if (size_ == 0) {
+		return nullptr;
+	}
+	const size_t slot = FindSlot(key, HashKey(key, context), context);
+	if (index_[slot] < 0) {
+		return nullptr;
+	}
+	return &entries_[static_cast<size_t>(index_[slot])].value;
+}
+
+ObjectHolder& Dict::At(const ObjectHolder& key, Context& context) {
+	ObjectHolder* value = Find(key, context);
+	if (value == nullptr) {
+		throw std::runtime_error("Key not found in the dictionary"s);
+	}
+	return *value;
+}
+
+ObjectHolder& Dict::Emplace(const ObjectHolder& key, Context& context) {
+	if (!key) {
+		throw std::runtime_error("None can not be a dictionary key"s);
+	}
+	const size_t hash = HashKey(key, context);
+	size_t slot = 0;
+	for (;;) {
+		// Keeps at least a third of the slots empty, so that probe sequences stay short
+		if (3 * (entries_.size() + 1) > 2 * index_.size()) {
+			Rebuild(std::max<size_t>(8, 4 * (size_ + 1)));
 		}
-		return cls_.GetMethod(method)->body->Execute(glosure, context);
+		const uint64_t generation = generation_;
+		slot = FindSlot(key, hash, context);
+		// The keys inserted by __eq__ may have taken the room kept for this one
+		if (generation_ == generation) {
+			break;
+		}
+	}
+	if (index_[slot] >= 0) {
+		return entries_[static_cast<size_t>(index_[slot])].value;
+	}
+	index_[slot] = static_cast<int32_t>(entries_.size());
+	entries_.push_back({hash, key, ObjectHolder::None()});
+	++size_;
+	++generation_;
+	return entries_.back().value;
+}
+
+bool Dict::Erase(const ObjectHolder& key, Context& context) {
+	if (size_ == 0) {
+		return false;
+	}
+	const size_t slot = FindSlot(key, HashKey(key, context), context);
+	if (index_[slot] < 0) {
+		return false;
 	}
-	throw std::runtime_error("Not implemented_"s);
+	Entry& entry = entries_[static_cast<size_t>(index_[slot])];
+	entry.key = ObjectHolder::None();
+	entry.value = ObjectHolder::None();
+	index_[slot] = ERASED_SLOT;
+	--size_;
+	++generation_;
+	return true;
 }
 
-Class::Class(std::string name, std::vector<Method> methods, const Class* parent) : name_(name), methods_(std::move(methods)), parent_(parent) {
+void Dict::Rebuild(size_t capacity) {
+	++generation_;
+	size_t power_of_two = 8;
+	while (power_of_two < capacity) {
+		power_of_two *= 2;
+	}
+	// Drops the erased entries, the order of the rest is kept
+	auto erased = std::remove_if(entries_.begin(), entries_.end(), [](const Entry& entry) {
+		return !entry.key;
+	});
+	entries_.erase(erased, entries_.end());
+
+	index_.assign(power_of_two, EMPTY_SLOT);
+	const size_t mask = power_of_two - 1;
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		size_t slot = entries_[i].hash & mask;
+		while (index_[slot] != EMPTY_SLOT) {
+			slot = (slot + 1) & mask;
+		}
+		index_[slot] = static_cast<int32_t>(i);
+	}
+}
+
+std::vector<ObjectHolder> Dict::Keys() const {
+	std::vector<ObjectHolder> result;
+	result.reserve(size_);
+	for (const Entry& entry : entries_) {
+		if (entry.key) {
+			result.push_back(entry.key);
+		}
+	}
+	return result;
+}
+
+std::vector<ObjectHolder> Dict::Values() const {
+	std::vector<ObjectHolder> result;
+	result.reserve(size_);
+	for (const Entry& entry : entries_) {
+		if (entry.key) {
+			result.push_back(entry.value);
+		}
+	}
+	return result;
+}
+
+void Dict::VisitReferences(ReferenceVisitor& visitor) {
+	for (const Entry& entry : entries_) {
+		visitor.Visit(entry.key);
+		visitor.Visit(entry.value);
+	}
+}
+
+void Dict::ClearReferences() {
+	entries_.clear();
+	index_.clear();
+	size_ = 0;
+	++generation_;
+}
+
+ObjectHolder ConvertToString(const ObjectHolder& object, Context& context) {
+	// No holder owns them, so sharing them across threads touches no counter
+	static String& true_string = String::Intern("True"s);
+	static String& false_string = String::Intern("False"s);
+	static String& none_string = String::Intern("None"s);
+
+	if (!object) {
+		return ObjectHolder::Share(none_string);
+	}
+	if (object.TryAs<String>()) {
+		return object;
+	}
+	if (const auto number = object.TryAsNumber()) {
+		char buffer[24];
+		const auto result = std::to_chars(std::begin(buffer), std::end(buffer), *number);
+		return ObjectHolder::Own(String(std::string(buffer, result.ptr)));
+	}
+	if (const auto* boolean = object.TryAs<Bool>()) {
+		return ObjectHolder::Share(boolean->GetValue() ? true_string : false_string);
+	}
+	if (const auto* big_number = object.TryAs<BigNumber>()) {
+		return ObjectHolder::Own(String(big_number->GetValue().ToString()));
+	}
+	if (auto* instance = object.TryAs<ClassInstance>(); instance != nullptr && instance->HasMethod("__str__"s, 0U)) {
+		return ConvertToString(instance->Call("__str__"s, {}, context), context);
+	}
+	std::ostringstream stream;
+	object->Print(stream, context);
+	return ObjectHolder::Own(String(stream.str()));
+}
+
+void PrintValue(const ObjectHolder& object, std::ostream& os, Context& context) {
+	if (const auto number = object.TryAsNumber()) {
+		os << *number;
+	} else if (object) {
+		object->Print(os, context);
+	} else {
+		os << "None"sv;
+	}
+}
+
+bool Contains(const ObjectHolder& item, const ObjectHolder& container, Context& context) {
+	if (auto* dict = container.TryAs<Dict>()) {
+		return dict->Find(item, context) != nullptr;
+	}
+	if (const auto* list = container.TryAs<List>()) {
+		return std::any_of(list->Items().begin(), list->Items().end(), [&item, &context](const ObjectHolder& element) {
+			return SameValue(element, item, context);
+		});
+	}
+	throw std::runtime_error("Object does not support the in operator"s);
+}
+
+Class::Class(std::string name, std::vector<Method> methods, const Class* parent) : Object(ObjectType::Class), name_(name), methods_(std::move(methods)), parent_(parent) {
 }
 
 const Method* Class::GetMethod(const std::string& name) const {
@@ -127,14 +600,256 @@ const Method* Class::GetMethod(const std::string& name) const {
 	return name_;
 }
 
+const Class* Class::GetParent() const {
+	return parent_;
+}
+
 void Class::Print(ostream& os, [[maybe_unused]]  Context& context) {
 	os << "Class " +  GetName();
 }
 
+// The characters shared by strings; their memory is accounted by the heap. The buffer is
+// deleted with the last string releasing it
+class String::Buffer {
+public:
+	explicit Buffer(std::string chars)
+		: chars_(std::move(chars)), accounted_(chars_.capacity()) {
+		Heap::Current().OnExternalAllocate(accounted_);
+	}
+	Buffer(const Buffer&) = delete;
+	Buffer& operator=(const Buffer&) = delete;
+	~Buffer() {
+		Heap::Current().OnExternalDeallocate(accounted_);
+	}
+
+	void Retain() {
+		++strings_;
+	}
+	void Release() {
+		if (--strings_ == 0) {
+			delete this;
+		}
+	}
+	[[nodiscard]] bool IsShared() const {
+		return strings_ > 1;
+	}
+
+	[[nodiscard]] const std::string& Chars() const {
+		return chars_;
+	}
+
+	// Drops the characters past the first length, the capacity stays
+	void Truncate(size_t length) {
+		chars_.resize(length);
+	}
+
+	void Append(std::string_view chars) {
+		if (chars_.size() + chars.size() > chars_.capacity()) {
+			// Accounted before growing, so a refused growth leaves the buffer intact
+			const size_t grown = std::max(chars_.size() + chars.size(), 2 * chars_.capacity());
+			Heap::Current().OnExternalAllocate(grown - accounted_);
+			accounted_ = grown;
+			chars_.reserve(grown);
+		}
+		chars_.append(chars);
+	}
+
+private:
+	std::string chars_;
+	size_t accounted_;  // the capacity as told to the heap
+	uint32_t strings_ = 1;
+};
+
+String::String(std::string value)
+	: Object(ObjectType::String), buffer_(new Buffer(std::move(value))), length_(buffer_->Chars().size()) {
+}
+
+String::String(Buffer* buffer, size_t length)
+	: Object(ObjectType::String), buffer_(buffer), length_(length) {
+}
+
+String::String(const String& other) noexcept
+	: Object(other), buffer_(other.buffer_), length_(other.length_) {
+	buffer_->Retain();
+}
+
+String::String(String&& other) noexcept
+	: Object(other), buffer_(std::exchange(other.buffer_, nullptr)), length_(other.length_) {
+}
+
+String& String::operator=(const String& other) noexcept {
+	if (this != &other) {
+		other.buffer_->Retain();
+		if (buffer_ != nullptr) {
+			buffer_->Release();
+		}
+		buffer_ = other.buffer_;
+		length_ = other.length_;
+	}
+	return *this;
+}
+
+String& String::operator=(String&& other) noexcept {
+	if (this != &other) {
+		if (buffer_ != nullptr) {
+			buffer_->Release();
+		}
+		buffer_ = std::exchange(other.buffer_, nullptr);
+		length_ = other.length_;
+	}
+	return *this;
+}
+
+String::~String() {
+	if (buffer_ != nullptr) {
+		buffer_->Release();
+	}
+}
+
+String& String::Intern(std::string value) {
+	auto& interned = *::new String(std::move(value));
+	interned.buffer_->Retain();
+	return interned;
+}
+
+void String::Print(std::ostream& os, [[maybe_unused]] Context& context) {
+	os << GetValue();
+}
+
+std::string_view String::GetValue() const {
+	return {buffer_->Chars().data(), length_};
+}
+
+String String::Concat(const String& lhs, std::string_view rhs) {
+	if (lhs.buffer_->IsShared()) {
+		// Appending would grow the buffer of the other strings too
+		std::string result;
+		result.reserve(lhs.length_ + rhs.size());
+		result.append(lhs.GetValue()).append(rhs);
+		return String(std::move(result));
+	}
+	Buffer& buffer = *lhs.buffer_;
+	// The characters past lhs were appended for strings that are gone
+	buffer.Truncate(lhs.length_);
+	const std::string& chars = buffer.Chars();
+	if (rhs.data() >= chars.data() && rhs.data() < chars.data() + chars.size()) {
+		// s + s: the growing buffer may move its characters away from under rhs
+		const std::string copy(rhs);
+		buffer.Append(copy);
+	} else {
+		buffer.Append(rhs);
+	}
+	buffer.Retain();
+	return String(&buffer, chars.size());
+}
+
 void Bool::Print(std::ostream& os, [[maybe_unused]] Context& context) {
 	os << (GetValue() ? "True"sv : "False"sv);
 }
 
+namespace {
+
+BigInt ToBigInt(const ObjectHolder& object) {
+	if (const auto number = object.TryAsNumber()) {
+		return *number;
+	}
+	if (const auto* big_number = object.TryAs<BigNumber>()) {
+		return big_number->GetValue();
+	}
+	throw std::runtime_error("One or both objects are not numbers"s);
+}
+
+ObjectHolder MakeNumber(const BigInt& value) {
+	if (auto small = value.ToInt64()) {
+		return ObjectHolder::FromNumber(*small);
+	}
+	return ObjectHolder::Own(BigNumber(value));
+}
+
+// checked stores the 64-bit result and returns true on overflow, wide is the BigInt fallback
+template <typename Checked, typename Wide>
+ObjectHolder NumericOperation(const ObjectHolder& lhs, const ObjectHolder& rhs, Checked checked, Wide wide) {
+	const auto lhs_number = lhs.TryAsNumber();
+	const auto rhs_number = rhs.TryAsNumber();
+	if (lhs_number && rhs_number) {
+		int64_t result = 0;
+		if (!checked(*lhs_number, *rhs_number, &result)) {
+			return ObjectHolder::FromNumber(result);
+		}
+	}
+	return MakeNumber(wide(ToBigInt(lhs), ToBigInt(rhs)));
+}
+
+// Returns a negative number, zero or a positive number like strcmp
+int CompareNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	const auto lhs_number = lhs.TryAsNumber();
+	const auto rhs_number = rhs.TryAsNumber();
+	if (lhs_number && rhs_number) {
+		return *lhs_number < *rhs_number ? -1 : *lhs_number > *rhs_number;
+	}
+	const BigInt lhs_value = ToBigInt(lhs);
+	const BigInt rhs_value = ToBigInt(rhs);
+	return lhs_value < rhs_value ? -1 : rhs_value < lhs_value;
+}
+
+}  // namespace
+
+bool IsNumber(const ObjectHolder& object) {
+	return object.TryAsNumber() || object.TryAs<BigNumber>() != nullptr;
+}
+
+ObjectHolder AddNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	return NumericOperation(
+		lhs, rhs,
+		[](int64_t a, int64_t b, int64_t* result) {
+			return __builtin_add_overflow(a, b, result);
+		},
+		[](const BigInt& a, const BigInt& b) {
+			return a + b;
+		});
+}
+
+ObjectHolder SubtractNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	return NumericOperation(
+		lhs, rhs,
+		[](int64_t a, int64_t b, int64_t* result) {
+			return __builtin_sub_overflow(a, b, result);
+		},
+		[](const BigInt& a, const BigInt& b) {
+			return a - b;
+		});
+}
+
+ObjectHolder MultiplyNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	return NumericOperation(
+		lhs, rhs,
+		[](int64_t a, int64_t b, int64_t* result) {
+			return __builtin_mul_overflow(a, b, result);
+		},
+		[](const BigInt& a, const BigInt& b) {
+			return a * b;
+		});
+}
+
+ObjectHolder DivideNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	return NumericOperation(
+		lhs, rhs,
+		[](int64_t a, int64_t b, int64_t* result) {
+			if (b == 0) {
+				throw std::runtime_error("Division by zero"s);
+			}
+			// The only quotient out of range
+			if (a == std::numeric_limits<int64_t>::min() && b == -1) {
+				return true;
+			}
+			*result = a / b;
+			return false;
+		},
+		[](const BigInt& a, const BigInt& b) {
+			return a / b;
+		});
+}
+
 bool ComparisonClassInstance(std::string method, const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
 	std::stringstream lhs_stream, resulting_stream, context_stream;
 	SimpleContext simple_context(context_stream);
@@ -158,16 +873,18 @@ bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
 }
 
 bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-	std::stringstream lhs_stream, rhs_stream, context_stream;
 	if (lhs && rhs) {
-		SimpleContext simple_context(context_stream);
-		(lhs.Get())->Print(lhs_stream, simple_context);
-		(rhs.Get())->Print(rhs_stream, simple_context);
 		if (lhs.TryAs<String>() && rhs.TryAs<String>()) {
-			return lhs_stream.str() < rhs_stream.str() ? true : false;
-		} else if (lhs.TryAs<Number>() && rhs.TryAs<Number>()) {
-			return std::stoi(lhs_stream.str()) < std::stoi(rhs_stream.str()) ? true : false;
-		} else if (lhs.TryAs<Bool>() && rhs.TryAs<Bool>()) {
+			return lhs.TryAs<String>()->GetValue() < rhs.TryAs<String>()->GetValue();
+		}
+		if (IsNumber(lhs) && IsNumber(rhs)) {
+			return CompareNumbers(lhs, rhs) < 0;
+		}
+		if (lhs.TryAs<Bool>() && rhs.TryAs<Bool>()) {
+			std::stringstream lhs_stream, rhs_stream, context_stream;
+			SimpleContext simple_context(context_stream);
+			PrintValue(lhs, lhs_stream, simple_context);
+			PrintValue(rhs, rhs_stream, simple_context);
 			return StringToBool(lhs_stream.str()) < StringToBool(rhs_stream.str()) ? true : false;
 		} else if (lhs.TryAs<ClassInstance>() ) {
 			return ComparisonClassInstance("__lt__", lhs, rhs, context);
@@ -1,61 +1,411 @@
 #pragma once
 
+#include "bigint.h"
+#include "cancellation.h"
+#include "heap.h"
+#include "metrics.h"
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace runtime {
 
 
+class Executable;
+class MemoCache;
+struct Method;
+
+// Non-local transfers of control made by return, break and continue
+enum class ControlFlow : uint8_t {
+	Normal,
+	Return,
+	Break,
+	Continue,
+};
+
+// How the bodies of methods run
+enum class Engine : uint8_t {
+	Bytecode,  // compiled on the first call to register bytecode (vm.h), unless the Profiler runs
+	Tree,      // by walking their syntax trees
+};
+
+// Bounds of one run of a program, zero means unbounded
+struct ExecutionLimits {
+	uint64_t max_steps = 0;       // statements executed
+	size_t max_heap_bytes = 0;    // growth of the live objects and string contents of the heap
+	size_t max_call_depth = 0;    // nested method calls, tail calls reuse the frame of the caller
+};
+
+// Raised when a run goes beyond one of its ExecutionLimits
+class LimitExceeded : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+// Raised when the CancellationToken of the context fires
+class Cancelled : public LimitExceeded {
+public:
+	using LimitExceeded::LimitExceeded;
+};
+
 class Context {
 public:
 	virtual std::ostream& GetOutputStream() = 0;
 
+	void SetLimits(const ExecutionLimits& limits);
+	[[nodiscard]] const ExecutionLimits& GetLimits() const {
+		return limits_;
+	}
+	// Called before every statement; throws LimitExceeded when the step budget is spent
+	void CountStep() {
+		if (--steps_left_ == 0) {
+			OnStepLimit();
+		}
+	}
+
+	void SetEngine(Engine engine) {
+		engine_ = engine;
+	}
+	[[nodiscard]] Engine GetEngine() const {
+		return engine_;
+	}
+
+	// The runs stop with Cancelled once the token fires; the token has to outlive them
+	void SetCancellation(const CancellationToken& token) {
+		cancellation_ = &token;
+	}
+	// Called at method entries and loop iterations
+	void CheckCancelled() const {
+		if (cancellation_->IsCancelled()) {
+			OnCancelled();
+		}
+	}
+
+	// The calls of pure methods go through the cache, which has to outlive the runs; nullptr
+	// turns memoization off again
+	void SetMemoization(MemoCache* cache) {
+		memoization_ = cache;
+	}
+	[[nodiscard]] MemoCache* GetMemoization() const {
+		return memoization_;
+	}
+
+	// Keeps the depth of a method call, throws LimitExceeded when the call goes too deep
+	class CallScope {
+	public:
+		explicit CallScope(Context& context)
+			: context_(context) {
+			if (++context_.call_depth_ > context_.max_call_depth_) {
+				--context_.call_depth_;
+				context_.OnCallDepthLimit();
+			}
+		}
+		CallScope(const CallScope&) = delete;
+		CallScope& operator=(const CallScope&) = delete;
+		~CallScope() {
+			--context_.call_depth_;
+		}
+	private:
+		Context& context_;
+	};
+
+	// Transfers do not unwind the C++ stack with exceptions: a statement requests one here and
+	// the enclosing blocks stop executing until the loop or the method body it targets takes it
+	[[nodiscard]] ControlFlow GetControlFlow() const {
+		return control_flow_;
+	}
+	void RequestTransfer(ControlFlow control_flow) {
+		control_flow_ = control_flow;
+	}
+	// The returned expression is evaluated by the method body taking the transfer
+	void RequestReturn(Executable& returned) {
+		control_flow_ = ControlFlow::Return;
+		returned_ = &returned;
+	}
+	// Completes the pending transfer; gives the returned expression, if any
+	Executable* TakeTransfer() {
+		control_flow_ = ControlFlow::Normal;
+		return std::exchange(returned_, nullptr);
+	}
+
 protected:
 	~Context() = default;
+
+private:
+	[[noreturn]] void OnStepLimit();
+	[[noreturn]] void OnCallDepthLimit();
+	[[noreturn]] void OnCancelled() const;
+
+	ControlFlow control_flow_ = ControlFlow::Normal;
+	Executable* returned_ = nullptr;
+	ExecutionLimits limits_;
+	// Counts down to zero at the statement beyond the budget
+	uint64_t steps_left_ = std::numeric_limits<uint64_t>::max();
+	size_t call_depth_ = 0;
+	size_t max_call_depth_ = std::numeric_limits<size_t>::max();
+	const CancellationToken* cancellation_ = &CancellationToken::Never();
+	MemoCache* memoization_ = nullptr;
+	Engine engine_ = Engine::Bytecode;
+};
+
+class ObjectHolder;
+
+class ReferenceVisitor {
+public:
+	virtual void Visit(const ObjectHolder& reference) = 0;
+
+protected:
+	~ReferenceVisitor() = default;
+};
+
+template <typename T>
+class ValueObject;
+class String;
+class Bool;
+class Class;
+class ClassInstance;
+class List;
+class Dict;
+
+// The built-in types carry a tag in the object header, so ObjectHolder::TryAs tests them by
+// comparing it instead of a dynamic_cast. Objects of other types are Other and keep dynamic_cast
+enum class ObjectType : uint8_t {
+	Other,
+	Number,
+	BigNumber,
+	BoolValue,  // a ValueObject<bool> that is not a Bool
+	Bool,
+	String,
+	Class,
+	ClassInstance,
+	List,
+	Dict,
+};
+
+template <typename T>
+struct ObjectTypeOf {
+	static constexpr ObjectType TYPE = ObjectType::Other;
 };
 
+#define MYTHON_OBJECT_TYPE(type, tag)                           \
+	template <>                                                 \
+	struct ObjectTypeOf<type> {                                 \
+		static constexpr ObjectType TYPE = ObjectType::tag;     \
+	}
+
+MYTHON_OBJECT_TYPE(ValueObject<int64_t>, Number);
+MYTHON_OBJECT_TYPE(ValueObject<BigInt>, BigNumber);
+MYTHON_OBJECT_TYPE(ValueObject<bool>, BoolValue);
+MYTHON_OBJECT_TYPE(Bool, Bool);
+MYTHON_OBJECT_TYPE(String, String);
+MYTHON_OBJECT_TYPE(Class, Class);
+MYTHON_OBJECT_TYPE(ClassInstance, ClassInstance);
+MYTHON_OBJECT_TYPE(List, List);
+MYTHON_OBJECT_TYPE(Dict, Dict);
+
+#undef MYTHON_OBJECT_TYPE
+
 class Object {
 public:
+	Object() noexcept
+		: Object(ObjectType::Other) {
+	}
+	// The reference counter belongs to the particular allocation, so copies start unowned
+	Object(const Object& other) noexcept
+		: Object(other.type_) {
+		cycle_tracked_ = other.cycle_tracked_;
+	}
+	Object& operator=(const Object& /*other*/) noexcept {
+		return *this;
+	}
 	virtual ~Object() = default;
 	virtual void Print(std::ostream& os, Context& context) = 0;
+
+	// Objects that hold references to other objects report them to the cycle collector
+	virtual void VisitReferences(ReferenceVisitor& /*visitor*/) {
+	}
+	// Drops the held references so that the collector can break a garbage cycle
+	virtual void ClearReferences() {
+	}
+
+	static void* operator new(std::size_t size);
+	static void operator delete(void* ptr, std::size_t size) noexcept;
+
+	[[nodiscard]] ObjectType GetType() const {
+		return type_;
+	}
+
+protected:
+	// The built-in types pass their tag
+	explicit Object(ObjectType type) noexcept
+		: type_(type), gc_buffered_(false), cycle_tracked_(false), heap_allocated_(false) {
+	}
+
+	// Must be called by the constructors of objects able to form reference cycles
+	void EnableCycleTracking() {
+		cycle_tracked_ = true;
+	}
+
+private:
+	friend class ObjectHolder;
+	friend class Heap;
+
+	// Objects never leave the interpreter thread, so the counter is not atomic.
+	// Zero means that no holder owns the object (stack objects, AST constants)
+	uint32_t ref_count_ = 0;
+	GcColor gc_color_ = GcColor::Black;
+	ObjectType type_;
+	// Bit-fields keep the header at 16 bytes with the tag
+	bool gc_buffered_ : 1;
+	bool cycle_tracked_ : 1;
+	bool heap_allocated_ : 1;
 };
 
+// A holder refers to an object, holds nothing for None or keeps a Number itself. Numbers in
+// the range of 63 bits are shifted left by one and get the lowest bit set, which addresses of
+// objects never have, so arithmetic does not allocate. Wider values are BigNumbers, so a Number
+// object never lives on the heap, and True and False are two shared objects
 class ObjectHolder {
 public:
 	ObjectHolder() = default;
+	ObjectHolder(const ObjectHolder& other) noexcept;
+	ObjectHolder(ObjectHolder&& other) noexcept;
+	ObjectHolder& operator=(const ObjectHolder& other) noexcept;
+	ObjectHolder& operator=(ObjectHolder&& other) noexcept;
+	~ObjectHolder();
 
 	template <typename T>
 	[[nodiscard]] static ObjectHolder Own(T&& object) {
-		return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+		using Type = std::decay_t<T>;
+		if constexpr (ObjectTypeOf<Type>::TYPE == ObjectType::Number) {
+			return FromNumber(object.GetValue());
+		} else if constexpr (ObjectTypeOf<Type>::TYPE == ObjectType::Bool) {
+			return FromBool(object.GetValue());
+		} else {
+			Object* data = new Type(std::forward<T>(object));
+			data->ref_count_ = 1;
+			data->heap_allocated_ = true;
+			MYTHON_COUNT(allocations);
+			return ObjectHolder(data);
+		}
 	}
 
+	// Shares an object owned by other holders or, if nobody owns it, refers to it without owning.
+	// A Number object is copied into the holder
 	[[nodiscard]] static ObjectHolder Share(Object& object);
 	[[nodiscard]] static ObjectHolder None();
+	[[nodiscard]] static ObjectHolder FromNumber(int64_t value);
+	[[nodiscard]] static ObjectHolder FromBool(bool value);
+	// Numbers are no objects, dereference holders of objects only
 	Object& operator*() const;
 	Object* operator->() const;
+	// The object referred to, nullptr for None and Numbers
 	[[nodiscard]] Object* Get() const;
 
+	// BigNumbers are not Numbers
+	[[nodiscard]] std::optional<int64_t> TryAsNumber() const {
+		if (!HoldsNumber()) {
+			return std::nullopt;
+		}
+		return static_cast<int64_t>(reinterpret_cast<uintptr_t>(data_)) >> 1;
+	}
+
 	template <typename T>
 	[[nodiscard]] T* TryAs() const {
-		return dynamic_cast<T*>(this->Get());
+		constexpr ObjectType type = ObjectTypeOf<std::remove_const_t<T>>::TYPE;
+		static_assert(type != ObjectType::Number, "Numbers are kept in holders, use TryAsNumber");
+		Object* object = Get();
+		if constexpr (type == ObjectType::Other) {
+			return dynamic_cast<T*>(object);
+		} else if constexpr (type == ObjectType::BoolValue) {
+			// Bool derives from ValueObject<bool>
+			return object != nullptr && (object->type_ == type || object->type_ == ObjectType::Bool)
+					   ? static_cast<T*>(object)
+					   : nullptr;
+		} else {
+			return object != nullptr && object->type_ == type ? static_cast<T*>(object) : nullptr;
+		}
 	}
 
 	explicit operator bool() const;
 private:
-	explicit ObjectHolder(std::shared_ptr<Object> data);
+	static constexpr int64_t MIN_NUMBER = std::numeric_limits<int64_t>::min() / 2;
+	static constexpr int64_t MAX_NUMBER = std::numeric_limits<int64_t>::max() / 2;
+
+	explicit ObjectHolder(Object* data) noexcept;
+	[[nodiscard]] bool HoldsNumber() const {
+		return (reinterpret_cast<uintptr_t>(data_) & 1U) != 0;
+	}
 	void AssertIsValid() const;
+	void Retain() const noexcept;
+	void Release() noexcept;
 
-	std::shared_ptr<Object> data_;
+	Object* data_ = nullptr;
+};
+
+// The arguments of a call: a view of holders in a vector, in a frame or in a braced list, which
+// lives until the end of the call expression
+class ArgumentList {
+public:
+	ArgumentList() = default;
+	ArgumentList(const ObjectHolder* data, size_t size) noexcept
+		: data_(data), size_(size) {
+	}
+	ArgumentList(const std::vector<ObjectHolder>& args) noexcept  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+		: data_(args.data()), size_(args.size()) {
+	}
+	// The list lives as long as the argument of a call does, which is all the view needs
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winit-list-lifetime"
+#endif
+	ArgumentList(std::initializer_list<ObjectHolder> args) noexcept  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+		: data_(args.begin()), size_(args.size()) {
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+	[[nodiscard]] size_t size() const noexcept {
+		return size_;
+	}
+	[[nodiscard]] bool empty() const noexcept {
+		return size_ == 0;
+	}
+	[[nodiscard]] const ObjectHolder& operator[](size_t index) const noexcept {
+		return data_[index];
+	}
+	[[nodiscard]] const ObjectHolder& front() const noexcept {
+		return data_[0];
+	}
+	[[nodiscard]] const ObjectHolder* begin() const noexcept {
+		return data_;
+	}
+	[[nodiscard]] const ObjectHolder* end() const noexcept {
+		return data_ + size_;
+	}
+
+private:
+	const ObjectHolder* data_ = nullptr;
+	size_t size_ = 0;
 };
 
 template <typename T>
 class ValueObject : public Object {
 public:
 	ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-		: value_(v) {
+		: Object(ObjectTypeOf<ValueObject>::TYPE), value_(v) {
 	}
 
 	void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
@@ -66,6 +416,11 @@ public:
 		return value_;
 	}
 
+protected:
+	ValueObject(T v, ObjectType type)
+		: Object(type), value_(v) {
+	}
+
 private:
 	T value_;
 };
@@ -73,20 +428,74 @@ private:
 
 using Closure = std::unordered_map<std::string, ObjectHolder>;
 
+// The truth of conditions and of the operands of not, and, or: False, None, zero, empty
+// strings, lists and dictionaries, classes and class instances are false
 bool IsTrue(const ObjectHolder& object);
 
+// What running the body of a method may do besides computing its result
+struct MethodEffects {
+	// The body reads only its parameters and constants, neither reads nor assigns fields, prints
+	// nothing and creates no objects, apart from the calls of self_calls
+	bool pure = false;
+	// The methods the body calls on self: their names and numbers of arguments
+	std::vector<std::pair<std::string, size_t>> self_calls;
+};
+
 class Executable {
 public:
 	virtual ~Executable() = default;
 	virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
+	// Runs the executable as the body of method called on self. By default the arguments are
+	// bound in a new closure, method bodies able to do without one override it
+	virtual ObjectHolder Call(const Method& method, ObjectHolder self,
+							  ArgumentList actual_args, Context& context);
+	// The effects of the executable as the body of method; nullptr when they are not known
+	[[nodiscard]] virtual const MethodEffects* GetEffects(const Method& method) {
+		return nullptr;
+	}
+};
+
+// Strings share a growable buffer and see its first length_ characters. A concatenation whose
+// left operand is the only string of its buffer appends to it in place, so building a string
+// piece by piece takes linear time; extending a string whose buffer is shared, with the result
+// of an earlier concatenation, a constant or an interned string, copies it first
+class String : public Object {
+public:
+	String(std::string value);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+	String(const String& other) noexcept;
+	String(String&& other) noexcept;
+	String& operator=(const String& other) noexcept;
+	String& operator=(String&& other) noexcept;
+	~String() override;
+
+	void Print(std::ostream& os, Context& context) override;
+
+	[[nodiscard]] std::string_view GetValue() const;
+	[[nodiscard]] static String Concat(const String& lhs, std::string_view rhs);
+	// A string for all threads, never destroyed as holders in static storage may outlive it.
+	// Its buffer counts one string more, so no concatenation appends to it in place
+	[[nodiscard]] static String& Intern(std::string value);
+
+private:
+	class Buffer;
+
+	// Takes over a reference to the buffer
+	String(Buffer* buffer, size_t length);
+
+	// Counts its strings without atomics, as objects count their holders
+	Buffer* buffer_;
+	size_t length_;
 };
 
-using String = ValueObject<std::string>;
-using Number = ValueObject<int>;
+using Number = ValueObject<int64_t>;
+// Integers out of the 63-bit range of Numbers kept in holders; smaller values are always Numbers
+using BigNumber = ValueObject<BigInt>;
 
 class Bool : public ValueObject<bool> {
 public:
-	using ValueObject<bool>::ValueObject;
+	Bool(bool value)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+		: ValueObject<bool>(value, ObjectType::Bool) {
+	}
 	void Print(std::ostream& os, Context& context) override;
 };
 
@@ -102,6 +511,7 @@ public:
 
 	[[nodiscard]] const Method* GetMethod(const std::string& name) const;
 	[[nodiscard]] const std::string& GetName() const;
+	[[nodiscard]] const Class* GetParent() const;
 	void Print(std::ostream& os, [[maybe_unused]]  Context& context) override;
 private:
 	std::string name_;
@@ -114,15 +524,188 @@ public:
 	explicit ClassInstance(const Class& cls);
 
 	void Print(std::ostream& os, Context& context) override;
-	ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args, Context& context);
+	ObjectHolder Call(const std::string& method, ArgumentList actual_args, Context& context);
+	// Calls a method already resolved for the class of the instance
+	ObjectHolder Call(const Method& method, ArgumentList actual_args, Context& context);
 	[[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
+	// Returns the method to be invoked by a call with argument_count arguments or throws
+	[[nodiscard]] const Method& FindMethod(const std::string& method, size_t argument_count) const;
+	// Makes the local scope of a call of method on self
+	static void BindArguments(const Method& method, ObjectHolder self,
+							  ArgumentList actual_args, Closure& closure);
 	[[nodiscard]] Closure& Fields();
 	[[nodiscard]] const Closure& Fields() const;
+	[[nodiscard]] const Class& GetClass() const;
+
+	void VisitReferences(ReferenceVisitor& visitor) override;
+	void ClearReferences() override;
 private:
 	const Class& cls_;
 	Closure glosure_;
 };
 
+// Built-in list, the items are stored contiguously
+class List : public Object {
+public:
+	List();
+	explicit List(std::vector<ObjectHolder> items);
+
+	void Print(std::ostream& os, Context& context) override;
+	// Built-in methods: append(item) and pop()
+	ObjectHolder Call(const std::string& method, ArgumentList actual_args);
+
+	[[nodiscard]] size_t Size() const;
+	// Negative indices count from the end; throws when the index is out of range
+	[[nodiscard]] ObjectHolder& At(const ObjectHolder& index);
+	[[nodiscard]] std::vector<ObjectHolder>& Items();
+	[[nodiscard]] const std::vector<ObjectHolder>& Items() const;
+
+	void VisitReferences(ReferenceVisitor& visitor) override;
+	void ClearReferences() override;
+private:
+	std::vector<ObjectHolder> items_;
+};
+
+// Built-in dictionary: an open addressing index over entries kept in the insertion order.
+// Number, String and Bool keys are hashed and compared directly, class instances delegate
+// to their __hash__ and __eq__ methods and fall back to the identity without them
+class Dict : public Object {
+public:
+	Dict();
+
+	void Print(std::ostream& os, Context& context) override;
+	// Built-in methods: get(key), pop(key), keys() and values()
+	ObjectHolder Call(const std::string& method, ArgumentList actual_args, Context& context);
+
+	[[nodiscard]] size_t Size() const;
+	// Returns the value stored under the key or nullptr
+	[[nodiscard]] ObjectHolder* Find(const ObjectHolder& key, Context& context);
+	// Throws when there is no such key
+	[[nodiscard]] ObjectHolder& At(const ObjectHolder& key, Context& context);
+	// Returns the value stored under the key, inserting None when there is no such key
+	ObjectHolder& Emplace(const ObjectHolder& key, Context& context);
+	bool Erase(const ObjectHolder& key, Context& context);
+	[[nodiscard]] std::vector<ObjectHolder> Keys() const;
+	[[nodiscard]] std::vector<ObjectHolder> Values() const;
+
+	void VisitReferences(ReferenceVisitor& visitor) override;
+	void ClearReferences() override;
+private:
+	struct Entry {
+		size_t hash;
+		ObjectHolder key;  // None marks an erased entry
+		ObjectHolder value;
+	};
+
+	static constexpr int32_t EMPTY_SLOT = -1;
+	static constexpr int32_t ERASED_SLOT = -2;
+
+	// Returns the slot of the index holding the key or, if there is none, the slot to insert it to
+	size_t FindSlot(const ObjectHolder& key, size_t hash, Context& context) const;
+	void Rebuild(size_t capacity);
+
+	std::vector<Entry> entries_;
+	std::vector<int32_t> index_;
+	size_t size_ = 0;
+	// Changes with every insertion, erasure and rebuild, so that a probe which called __eq__
+	// finds out that the table moved under it
+	uint64_t generation_ = 0;
+};
+
+// Python's str(object): numbers are formatted directly, strings are returned as they are,
+// True, False and None share preallocated strings, class instances make one call of __str__
+ObjectHolder ConvertToString(const ObjectHolder& object, Context& context);
+
+// Prints None for the empty holder
+void PrintValue(const ObjectHolder& object, std::ostream& os, Context& context);
+
+// Python's "item in container" for lists and dictionaries
+bool Contains(const ObjectHolder& item, const ObjectHolder& container, Context& context);
+
+inline ObjectHolder::ObjectHolder(Object* data) noexcept
+	: data_(data) {
+}
+
+inline ObjectHolder::ObjectHolder(const ObjectHolder& other) noexcept
+	: data_(other.data_) {
+	Retain();
+}
+
+inline ObjectHolder::ObjectHolder(ObjectHolder&& other) noexcept
+	: data_(other.data_) {
+	other.data_ = nullptr;
+}
+
+inline ObjectHolder& ObjectHolder::operator=(const ObjectHolder& other) noexcept {
+	other.Retain();
+	Release();
+	data_ = other.data_;
+	return *this;
+}
+
+inline ObjectHolder& ObjectHolder::operator=(ObjectHolder&& other) noexcept {
+	if (this != &other) {
+		Release();
+		data_ = other.data_;
+		other.data_ = nullptr;
+	}
+	return *this;
+}
+
+inline ObjectHolder::~ObjectHolder() {
+	Release();
+}
+
+inline ObjectHolder ObjectHolder::FromNumber(int64_t value) {
+	if (value < MIN_NUMBER || value > MAX_NUMBER) {
+		return Own(BigNumber(value));
+	}
+	return ObjectHolder(reinterpret_cast<Object*>((static_cast<uintptr_t>(value) << 1U) | 1U));  // NOLINT
+}
+
+inline ObjectHolder ObjectHolder::FromBool(bool value) {
+	// Never destroyed, holders in static storage may outlive them otherwise
+	static Bool& true_object = *::new Bool(true);
+	static Bool& false_object = *::new Bool(false);
+	return ObjectHolder(value ? &true_object : &false_object);
+}
+
+inline void ObjectHolder::Retain() const noexcept {
+	Object* object = Get();
+	if (object != nullptr && object->ref_count_ != 0) {
+		++object->ref_count_;
+	}
+}
+
+inline void ObjectHolder::Release() noexcept {
+	Object* object = Get();
+	if (object == nullptr || object->ref_count_ == 0) {
+		return;
+	}
+	if (--object->ref_count_ == 0) {
+		Heap::Current().ReleaseLast(object);
+	} else if (object->cycle_tracked_) {
+		Heap::Current().AddPossibleRoot(object);
+	}
+}
+
+inline Object* ObjectHolder::Get() const {
+	return HoldsNumber() ? nullptr : data_;
+}
+
+inline ObjectHolder::operator bool() const {
+	return data_ != nullptr;
+}
+
+// Integer arithmetic over Numbers and BigNumbers. The 64-bit fast path checks for overflow and
+// promotes the result to a BigNumber when it does not fit; results that fit are Numbers again.
+// Division rounds toward zero. All of them throw unless both operands are numbers
+bool IsNumber(const ObjectHolder& object);
+ObjectHolder AddNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs);
+ObjectHolder SubtractNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs);
+ObjectHolder MultiplyNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs);
+ObjectHolder DivideNumbers(const ObjectHolder& lhs, const ObjectHolder& rhs);
+
 bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
@@ -1,6 +1,9 @@
+#include "frame_stack.h"
 #include "runtime.h"
 
+#include <limits>
 #include <functional>
+#include <thread>
 
 #include "test_runner_p.h"
 
@@ -20,7 +23,7 @@ public:
 	}
 
 	Logger(const Logger& rhs)
-		: id_(rhs.id_)  //
+		: Object(rhs), id_(rhs.id_)  //
 	{
 		++instance_count;
 	}
@@ -63,6 +66,80 @@ void TestNumber() {
 	ASSERT_EQUAL(num.GetValue(), 127);
 }
 
+void TestBigInt() {
+	const BigInt max = std::numeric_limits<int64_t>::max();
+	const BigInt min = std::numeric_limits<int64_t>::min();
+	ASSERT_EQUAL((max + 1).ToString(), "9223372036854775808"s);
+	ASSERT_EQUAL((min - 1).ToString(), "-9223372036854775809"s);
+	ASSERT_EQUAL((max * max).ToString(), "85070591730234615847396907784232501249"s);
+	ASSERT_EQUAL(((max * max) / max).ToInt64().value(), std::numeric_limits<int64_t>::max());
+	ASSERT_EQUAL((BigInt(-7) / BigInt(2)).ToInt64().value(), -3);
+	ASSERT_EQUAL((min * -1 - 1).ToInt64().value(), std::numeric_limits<int64_t>::max());
+	ASSERT_EQUAL(min.ToInt64().value(), std::numeric_limits<int64_t>::min());
+	ASSERT(!(max + 1).ToInt64());
+	ASSERT((max - max).IsZero());
+	ASSERT(min < max && !(max < min) && (min - 1) < min);
+	ASSERT(BigInt(-1000000000) < BigInt(-999999999));
+	ASSERT_THROWS(max / BigInt(0), runtime_error);
+}
+
+void TestNumberOverflow() {
+	const auto max = ObjectHolder::Own(Number{std::numeric_limits<int64_t>::max()});
+	const auto one = ObjectHolder::Own(Number{1});
+	const auto minus_one = ObjectHolder::Own(Number{-1});
+
+	const ObjectHolder big = AddNumbers(max, one);
+	ASSERT(big.TryAs<BigNumber>());
+	ASSERT(MultiplyNumbers(max, max).TryAs<BigNumber>());
+
+	const ObjectHolder min = SubtractNumbers(MultiplyNumbers(max, minus_one), one);
+	ASSERT(DivideNumbers(min, minus_one).TryAs<BigNumber>());
+	ASSERT_EQUAL(*DivideNumbers(ObjectHolder::Own(Number{7}), ObjectHolder::Own(Number{2})).TryAsNumber(), 3);
+	ASSERT_THROWS(DivideNumbers(one, ObjectHolder::Own(Number{0})), runtime_error);
+	ASSERT_THROWS(AddNumbers(one, ObjectHolder::Own(String{"1"s})), runtime_error);
+
+	DummyContext context;
+	ASSERT(Less(max, big, context));
+	ASSERT(Equal(AddNumbers(max, one), big, context));
+	ASSERT(Equal(SubtractNumbers(big, one), max, context));
+	ASSERT(Equal(DivideNumbers(min, one), min, context));
+	ASSERT(IsTrue(big));
+}
+
+void TestNumbersInHolders() {
+	constexpr int64_t largest = std::numeric_limits<int64_t>::max() / 2;
+	constexpr int64_t smallest = std::numeric_limits<int64_t>::min() / 2;
+
+	// Numbers refer to no object
+	const ObjectHolder one = ObjectHolder::FromNumber(1);
+	ASSERT(one);
+	ASSERT(one.Get() == nullptr);
+	ASSERT_EQUAL(*ObjectHolder::Own(Number{-1}).TryAsNumber(), -1);
+	ASSERT_EQUAL(*ObjectHolder::FromNumber(largest).TryAsNumber(), largest);
+	ASSERT_EQUAL(*ObjectHolder::FromNumber(smallest).TryAsNumber(), smallest);
+	Number five(5);
+	ASSERT_EQUAL(*ObjectHolder::Share(five).TryAsNumber(), 5);
+
+	// Wider values are BigNumbers until they fit again
+	const ObjectHolder wide = AddNumbers(ObjectHolder::FromNumber(largest), one);
+	ASSERT(!wide.TryAsNumber());
+	ASSERT(wide.TryAs<BigNumber>() != nullptr);
+	ASSERT_EQUAL(*SubtractNumbers(wide, one).TryAsNumber(), largest);
+	ASSERT(ObjectHolder::FromNumber(smallest - 1).TryAs<BigNumber>() != nullptr);
+
+	// True and False are shared
+	ASSERT(ObjectHolder::Own(Bool{true}).Get() == ObjectHolder::FromBool(true).Get());
+	ASSERT(!ObjectHolder::FromBool(false).TryAs<Bool>()->GetValue());
+
+	DummyContext context;
+	PrintValue(ObjectHolder::FromNumber(smallest), context.output, context);
+	ASSERT_EQUAL(context.output.str(), std::to_string(smallest));
+	ASSERT_EQUAL(ConvertToString(one, context).TryAs<String>()->GetValue(), "1"sv);
+	// Neither None nor a Number is the same as the other
+	ASSERT(!Contains(ObjectHolder::None(), ObjectHolder::Own(List({one})), context));
+	ASSERT(!Contains(one, ObjectHolder::Own(List({ObjectHolder::None()})), context));
+}
+
 void TestString() {
 	String word("hello!"s);
 
@@ -72,6 +149,60 @@ void TestString() {
 	ASSERT_EQUAL(word.GetValue(), "hello!"s);
 }
 
+void TestStringConcatenation() {
+	const String ab("ab"s);
+	const String abcd = String::Concat(ab, "cd"sv);
+	// ab shares its buffer with abcd, so the buffer is not changed under abcd
+	const String abxy = String::Concat(ab, "xy"sv);
+	const String twice = String::Concat(abcd, abcd.GetValue());
+	const String tail = String::Concat(twice, "!"sv);
+
+	ASSERT_EQUAL(ab.GetValue(), "ab"s);
+	ASSERT_EQUAL(abcd.GetValue(), "abcd"s);
+	ASSERT_EQUAL(abxy.GetValue(), "abxy"s);
+	ASSERT_EQUAL(twice.GetValue(), "abcdabcd"s);
+	ASSERT_EQUAL(tail.GetValue(), "abcdabcd!"s);
+
+	String built(""s);
+	for (int i = 0; i < 1000; ++i) {
+		built = String::Concat(built, "x"sv);
+	}
+	ASSERT_EQUAL(built.GetValue().size(), 1000U);
+
+	// A string built from a long-lived one, like a constant, does not grow the buffer it shares
+	const String constant("c"s);
+	const size_t live_bytes = Heap::Current().GetStats().live_bytes;
+	{
+		String from_constant = String::Concat(constant, "x"sv);
+		for (int i = 0; i < 1000; ++i) {
+			from_constant = String::Concat(from_constant, "x"sv);
+		}
+		ASSERT_EQUAL(from_constant.GetValue().size(), 1002U);
+	}
+	ASSERT_EQUAL(constant.GetValue(), "c"s);
+	ASSERT_EQUAL(Heap::Current().GetStats().live_bytes, live_bytes);
+}
+
+// True, False and None are converted to the same strings on every thread, which nothing extends
+void TestInternedStrings() {
+	DummyContext context;
+	const ObjectHolder none = ConvertToString(ObjectHolder::None(), context);
+	const Object* from_thread = nullptr;
+	thread([&from_thread] {
+		DummyContext thread_context;
+		from_thread = ConvertToString(ObjectHolder::None(), thread_context).Get();
+	}).join();
+	ASSERT_EQUAL(from_thread, none.Get());
+
+	const String& none_string = *none.TryAs<String>();
+	const String exclaimed = String::Concat(none_string, "!"sv);
+	const String asked = String::Concat(none_string, "?"sv);
+	ASSERT_EQUAL(none_string.GetValue(), "None"sv);
+	ASSERT_EQUAL(exclaimed.GetValue(), "None!"sv);
+	ASSERT_EQUAL(asked.GetValue(), "None?"sv);
+	ASSERT_EQUAL(ConvertToString(ObjectHolder::FromBool(true), context).TryAs<String>()->GetValue(), "True"sv);
+}
+
 void TestBool() {
 	Bool t(true);
 	ASSERT_EQUAL(t.GetValue(), true);
@@ -249,6 +380,38 @@ void TestNullptr() {
 	ASSERT(!oh.Get());
 }
 
+void TestTryAs() {
+	const ObjectHolder number = ObjectHolder::Own(Number(1));
+	ASSERT(number.TryAs<BigNumber>() == nullptr);
+	ASSERT(number.TryAs<String>() == nullptr);
+	ASSERT(number.TryAs<Object>() == nullptr);
+
+	// A Bool is a ValueObject<bool>, not the other way round
+	const ObjectHolder boolean = ObjectHolder::Own(Bool(true));
+	ASSERT(boolean.TryAs<Bool>() != nullptr);
+	ASSERT(boolean.TryAs<ValueObject<bool>>() != nullptr);
+	const ObjectHolder bool_value = ObjectHolder::Own(ValueObject<bool>(true));
+	ASSERT(bool_value.TryAs<ValueObject<bool>>() != nullptr);
+	ASSERT(bool_value.TryAs<Bool>() == nullptr);
+
+	Class cls("Empty"s, {}, nullptr);
+	const ObjectHolder instance = ObjectHolder::Own(ClassInstance(cls));
+	ASSERT(instance.TryAs<ClassInstance>() != nullptr);
+	ASSERT(instance.TryAs<Class>() == nullptr);
+	ASSERT(ObjectHolder::Share(cls).TryAs<Class>() == &cls);
+	ASSERT(ObjectHolder::Own(List()).TryAs<List>() != nullptr);
+	ASSERT(ObjectHolder::Own(Dict()).TryAs<List>() == nullptr);
+	ASSERT(ObjectHolder::Own(String("s"s)).TryAs<String>() != nullptr);
+
+	// Types without a tag
+	const ObjectHolder logger = ObjectHolder::Own(Logger(1));
+	ASSERT(logger.TryAs<Logger>() != nullptr);
+	ASSERT(!logger.TryAsNumber());
+	ASSERT(number.TryAs<Logger>() == nullptr);
+	ASSERT(!ObjectHolder().TryAsNumber());
+	ASSERT(ObjectHolder().TryAs<Logger>() == nullptr);
+}
+
 void TestIsTrue() {
 	{
 		ASSERT(!IsTrue(ObjectHolder::Own(Bool{false})));
@@ -496,8 +659,7 @@ void TestClass() {
 	auto result = method->body->Execute(closure, ctx);
 	ASSERT_EQUAL(passed_context, &ctx);
 	ASSERT_EQUAL(passed_closure, &closure);
-	const Number* returned_number = result.TryAs<Number>();
-	ASSERT(returned_number != nullptr && returned_number->GetValue() == 42);
+	ASSERT(result.TryAsNumber() == 42);
 
 	ostringstream out;
 	cls.Print(out, ctx);
@@ -530,17 +692,212 @@ void TestClassInstance() {
 	ASSERT_THROWS(instance.Call("missing_method"s, {}, ctx), runtime_error);
 }
 
+void TestList() {
+	DummyContext context;
+	List list({ObjectHolder::Own(Number{1}), ObjectHolder::None()});
+	list.Call("append"s, {ObjectHolder::Own(String{"x"s})});
+	ASSERT_EQUAL(list.Size(), 3U);
+
+	ostringstream out;
+	list.Print(out, context);
+	ASSERT_EQUAL(out.str(), "[1, None, x]"s);
+
+	ASSERT(list.At(ObjectHolder::Own(Number{-3})).TryAsNumber());
+	ASSERT_THROWS((void)list.At(ObjectHolder::Own(Number{3})), runtime_error);
+	ASSERT_THROWS((void)list.At(ObjectHolder::Own(String{"0"s})), runtime_error);
+	ASSERT_THROWS(list.Call("push"s, {}), runtime_error);
+
+	ASSERT(list.Call("pop"s, {}).TryAs<String>());
+	ASSERT_EQUAL(list.Size(), 2U);
+	ASSERT(IsTrue(ObjectHolder::Share(list)));
+	ASSERT(!IsTrue(ObjectHolder::Own(List{})));
+}
+
+void TestDict() {
+	DummyContext context;
+	Dict dict;
+	dict.Emplace(ObjectHolder::Own(String{"one"s}), context) = ObjectHolder::Own(Number{1});
+	dict.Emplace(ObjectHolder::Own(Number{2}), context) = ObjectHolder::Own(String{"two"s});
+	dict.Emplace(ObjectHolder::Own(Bool{true}), context) = ObjectHolder::None();
+	ASSERT_EQUAL(dict.Size(), 3U);
+
+	ostringstream out;
+	dict.Print(out, context);
+	ASSERT_EQUAL(out.str(), "{one: 1, 2: two, True: None}"s);
+
+	ASSERT(dict.At(ObjectHolder::Own(String{"one"s}), context).TryAsNumber());
+	ASSERT(dict.Find(ObjectHolder::Own(String{"2"s}), context) == nullptr);
+	ASSERT_THROWS((void)dict.At(ObjectHolder::Own(Number{1}), context), runtime_error);
+	ASSERT_THROWS(dict.Emplace(ObjectHolder::None(), context), runtime_error);
+
+	// Erased entries leave the order of the rest as it was, also after rehashing
+	for (int i = 0; i < 100; ++i) {
+		dict.Emplace(ObjectHolder::Own(Number{i + 10}), context) = ObjectHolder::Own(Number{i});
+		ASSERT(dict.Erase(ObjectHolder::Own(Number{i + 10}), context));
+	}
+	ASSERT(dict.Erase(ObjectHolder::Own(Number{2}), context));
+	ASSERT(!dict.Erase(ObjectHolder::Own(Number{2}), context));
+	ASSERT_EQUAL(dict.Size(), 2U);
+	ASSERT_EQUAL(dict.Keys().size(), 2U);
+	ASSERT(dict.Keys().front().TryAs<String>());
+	ASSERT(dict.Call("get"s, {ObjectHolder::Own(Number{2})}, context).Get() == nullptr);
+	ASSERT(dict.Call("pop"s, {ObjectHolder::Own(String{"one"s})}, context).TryAsNumber());
+	ASSERT(IsTrue(ObjectHolder::Share(dict)));
+	ASSERT(!IsTrue(ObjectHolder::Own(Dict{})));
+}
+
+void TestDictInstanceKeys() {
+	DummyContext context;
+	// Keys with the same value are equal even though they are different objects
+	vector<Method> methods;
+	methods.push_back({"__hash__"s, {}, make_unique<TestMethodBody>([](Closure&, Context&) {
+						   return ObjectHolder::Own(Number{7});
+					   })});
+	methods.push_back({"__eq__"s, {"other"s}, make_unique<TestMethodBody>([](Closure& closure, Context&) {
+						   return ObjectHolder::Own(Bool{closure.at("other"s).TryAs<ClassInstance>() != nullptr});
+					   })});
+	Class with_eq{"Key"s, std::move(methods), nullptr};
+	Class without_eq{"Plain"s, {}, nullptr};
+
+	Dict dict;
+	dict.Emplace(ObjectHolder::Own(ClassInstance{with_eq}), context) = ObjectHolder::Own(Number{1});
+	dict.Emplace(ObjectHolder::Own(ClassInstance{with_eq}), context) = ObjectHolder::Own(Number{2});
+	ASSERT_EQUAL(dict.Size(), 1U);
+
+	auto plain = ObjectHolder::Own(ClassInstance{without_eq});
+	dict.Emplace(plain, context) = ObjectHolder::Own(Number{3});
+	dict.Emplace(ObjectHolder::Own(ClassInstance{without_eq}), context) = ObjectHolder::Own(Number{4});
+	ASSERT_EQUAL(dict.Size(), 3U);
+	ASSERT_EQUAL(*dict.At(plain, context).TryAsNumber(), 3);
+
+	List list({ObjectHolder::Own(Number{1}), ObjectHolder::Own(String{"1"s})});
+	ASSERT(Contains(ObjectHolder::Own(String{"1"s}), ObjectHolder::Share(list), context));
+	ASSERT(!Contains(ObjectHolder::Own(Bool{true}), ObjectHolder::Share(list), context));
+	ASSERT(Contains(plain, ObjectHolder::Share(dict), context));
+	ASSERT_THROWS(Contains(plain, plain, context), runtime_error);
+}
+
+void TestFrameStack() {
+	FrameStack stack;
+	ASSERT(stack.IsEmpty());
+	Logger::instance_count = 0;
+	{
+		FrameStack::Scope outer(stack);
+		ObjectHolder* frame = stack.Allocate(3);
+		ASSERT(!frame[0] && !frame[2]);
+		frame[1] = ObjectHolder::Own(Logger(1));
+		{
+			FrameStack::Scope inner(stack);
+			// A frame larger than the rest of the block takes a block of its own
+			ObjectHolder* large = stack.Allocate(10000);
+			large[9999] = ObjectHolder::Own(Logger(2));
+			ASSERT(large != frame + 3);
+			ASSERT_EQUAL(Logger::instance_count, 2);
+		}
+		ASSERT_EQUAL(Logger::instance_count, 1);
+		ASSERT(frame[1].TryAs<Logger>() != nullptr);
+		// The released slots are taken again
+		ASSERT(stack.Allocate(1) == frame + 3);
+	}
+	ASSERT_EQUAL(Logger::instance_count, 0);
+	ASSERT(stack.IsEmpty());
+
+	// Once grown, the stack serves the same frames without allocating
+	size_t capacity = 0;
+	for (int i = 0; i < 3; ++i) {
+		FrameStack::Scope scope(stack);
+		ASSERT(!stack.Allocate(10000)[0]);
+		ASSERT(!stack.Allocate(100)[99]);
+		if (i == 0) {
+			capacity = stack.GetCapacity();
+		}
+	}
+	ASSERT_EQUAL(stack.GetCapacity(), capacity);
+	ASSERT(stack.IsEmpty());
+}
+
+void TestCycleCollection() {
+	Heap& heap = Heap::Current();
+	heap.Collect();
+	const size_t live_objects = heap.GetStats().live_objects;
+	const size_t collections = heap.GetStats().collections;
+
+	Class cls{"Node"s, {}, nullptr};
+	{
+		auto parent = ObjectHolder::Own(ClassInstance{cls});
+		auto child = ObjectHolder::Own(ClassInstance{cls});
+		parent.TryAs<ClassInstance>()->Fields()["child"s] = child;
+		parent.TryAs<ClassInstance>()->Fields()["value"s] = ObjectHolder::Own(String{"1"s});
+		child.TryAs<ClassInstance>()->Fields()["parent"s] = parent;
+		child.TryAs<ClassInstance>()->Fields()["self"s] = child;
+	}
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects + 3);
+
+	auto alive = ObjectHolder::Own(ClassInstance{cls});
+	{
+		auto other = ObjectHolder::Own(ClassInstance{cls});
+		alive.TryAs<ClassInstance>()->Fields()["other"s] = other;
+		other.TryAs<ClassInstance>()->Fields()["other"s] = alive;
+	}
+
+	heap.Collect();
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects + 2);
+	ASSERT_EQUAL(heap.GetStats().collections, collections + 1);
+	ASSERT(heap.GetStats().max_pause >= heap.GetStats().last_pause);
+
+	alive.TryAs<ClassInstance>()->Fields().clear();
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects + 1);
+}
+
+void TestIncrementalCycleCollection() {
+	Heap& heap = Heap::Current();
+	heap.Collect();
+	const CollectorOptions options = heap.GetOptions();
+	const size_t live_objects = heap.GetStats().live_objects;
+
+	Class cls{"Node"s, {}, nullptr};
+	for (int i = 0; i < 10; ++i) {
+		auto node = ObjectHolder::Own(ClassInstance{cls});
+		node.TryAs<ClassInstance>()->Fields()["next"s] = node;
+	}
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects + 10);
+
+	heap.SetOptions({true, 4U, 3U});
+	heap.MaybeCollect();
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects + 7);
+	heap.MaybeCollect();
+	heap.MaybeCollect();
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects + 1);
+	heap.MaybeCollect();
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects + 1);
+
+	heap.SetOptions(options);
+	heap.Collect();
+	ASSERT_EQUAL(heap.GetStats().live_objects, live_objects);
+}
+
 }  // namespace
 
 void RunObjectsTests(TestRunner& tr) {
 	RUN_TEST(tr, runtime::TestNumber);
+	RUN_TEST(tr, runtime::TestBigInt);
+	RUN_TEST(tr, runtime::TestNumberOverflow);
+	RUN_TEST(tr, runtime::TestNumbersInHolders);
 	RUN_TEST(tr, runtime::TestString);
+	RUN_TEST(tr, runtime::TestStringConcatenation);
+	RUN_TEST(tr, runtime::TestInternedStrings);
 	RUN_TEST(tr, runtime::TestBool);
 	RUN_TEST(tr, runtime::TestMethodInvocation);
 	RUN_TEST(tr, runtime::TestIsTrue);
 	RUN_TEST(tr, runtime::TestComparison);
 	RUN_TEST(tr, runtime::TestClass);
 	RUN_TEST(tr, runtime::TestClassInstance);
+	RUN_TEST(tr, runtime::TestList);
+	RUN_TEST(tr, runtime::TestDict);
+	RUN_TEST(tr, runtime::TestDictInstanceKeys);
+	RUN_TEST(tr, runtime::TestFrameStack);
+	RUN_TEST(tr, runtime::TestCycleCollection);
+	RUN_TEST(tr, runtime::TestIncrementalCycleCollection);
 }
 
 void RunObjectHolderTests(TestRunner& tr) {
@@ -548,6 +905,7 @@ void RunObjectHolderTests(TestRunner& tr) {
 	RUN_TEST(tr, runtime::TestOwning);
 	RUN_TEST(tr, runtime::TestMove);
 	RUN_TEST(tr, runtime::TestNullptr);
+	RUN_TEST(tr, runtime::TestTryAs);
 }
 
 }  // namespace runtime
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace parse {
+
+// 1-based position in the program text
+struct SourcePosition {
+	uint32_t line = 1;
+	uint32_t column = 1;
+};
+
+// "line 3, column 14", the prefix of the messages of located errors
+inline std::string ToString(SourcePosition position) {
+	return "line " + std::to_string(position.line) + ", column " + std::to_string(position.column);
+}
+
+}  // namespace parse
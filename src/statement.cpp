@@ -1,5 +1,11 @@
 #include "statement.h"
 
+#include "compiler.h"
+#include "frame_stack.h"
+#include "profiler.h"
+#include "vm.h"
+
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <ostream>
@@ -35,8 +41,10 @@ VariableValue::VariableValue(const std::string& var_name) : ids_chain_({var_name
 VariableValue::VariableValue(std::vector<std::string> dotted_ids) : ids_chain_(std::move(dotted_ids)) { }
 
 ObjectHolder VariableValue::Execute(Closure& closure, Context& /*context*/) {
+	MYTHON_COUNT(variable_lookups);
 	Closure* current_closure = &closure;
 	for (size_t i = 0; i+1 < ids_chain_.size(); ++i) {
+		MYTHON_COUNT(field_lookups);
 		std::string& id = ids_chain_[i];
 		auto iter_object = current_closure->find(id);
 		if (iter_object == current_closure->end()) {
@@ -54,7 +62,7 @@ ObjectHolder VariableValue::Execute(Closure& closure, Context& /*context*/) {
 	if (it != current_closure->end()) {
 		return it->second;
 	}
-	throw std::runtime_error("VariableValue::Execute didn't work!"s);
+	throw std::runtime_error("Name "s + ids_chain_.back() + " not found in the scope"s);
 }
 
 Print::Print(unique_ptr<Statement> argument) {
@@ -74,16 +82,14 @@ ObjectHolder Print::Execute(Closure& closure, Context& context) {
 	using namespace std::literals;
 	for (auto& arg : args_) {
 		ObjectHolder object = arg.get()->Execute(closure, context);
-		if (object) {
-			object->Print(context.GetOutputStream(), context);
-		}  else {
-			context.GetOutputStream() << "None"sv;
-		}
+		runtime::PrintValue(object, context.GetOutputStream(), context);
 		if (arg != args_.back()) {
 			context.GetOutputStream()  << " "sv;
 		}
 	}
 	context.GetOutputStream() << "\n"sv	;
+	// Only the prints whose arguments did not throw are counted
+	MYTHON_COUNT(prints);
 	std::ostringstream stream;
 	stream << context.GetOutputStream().rdbuf();
 	return ObjectHolder::Own(runtime::String(stream.str()));
@@ -96,111 +102,488 @@ MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
 }
 
 ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
-	ObjectHolder obj = object_->Execute(closure, context);
-	std::vector<ObjectHolder> actual_args;
-	for (auto& arg : args_) {
-		actual_args.push_back(arg->Execute(closure, context));
+	runtime::FrameStack::Scope scope(runtime::FrameStack::Current());
+	ObjectHolder obj;
+	const runtime::ArgumentList actual_args = Evaluate(closure, context, obj);
+	return Invoke(obj, actual_args, context);
+}
+
+runtime::ArgumentList MethodCall::Evaluate(Closure& closure, Context& context, ObjectHolder& receiver) {
+	receiver = object_->Execute(closure, context);
+	ObjectHolder* actual_args = runtime::FrameStack::Current().Allocate(args_.size());
+	for (size_t i = 0; i < args_.size(); ++i) {
+		actual_args[i] = args_[i]->Execute(closure, context);
+	}
+	return {actual_args, args_.size()};
+}
+
+ObjectHolder MethodCall::Invoke(const ObjectHolder& receiver, runtime::ArgumentList actual_args,
+								Context& context) const {
+	if (target_ != nullptr) {
+		if (auto* instance = receiver.TryAs<runtime::ClassInstance>()) {
+			return instance->Call(FindMethod(*instance, actual_args.size()), actual_args, context);
+		}
+	}
+	return Invoke(receiver, method_, actual_args, context);
+}
+
+ObjectHolder MethodCall::Invoke(const ObjectHolder& receiver, const std::string& method,
+								runtime::ArgumentList actual_args, Context& context) {
+	if (auto* instance = receiver.TryAs<runtime::ClassInstance>()) {
+		return instance->Call(method, actual_args, context);
+	}
+	if (auto* list = receiver.TryAs<runtime::List>()) {
+		return list->Call(method, actual_args);
+	}
+	if (auto* dict = receiver.TryAs<runtime::Dict>()) {
+		return dict->Call(method, actual_args, context);
 	}
-	return obj.TryAs<runtime::ClassInstance>()->Call(method_, std::move(actual_args), context);
+	throw std::runtime_error("Method "s + method + " is called on an object without methods"s);
+}
+
+const std::string& MethodCall::GetMethodName() const {
+	return method_;
+}
+
+size_t MethodCall::GetArgumentCount() const {
+	return args_.size();
+}
+
+void MethodCall::Bind(const runtime::Method& method, const runtime::Class* receiver_class) {
+	target_ = &method;
+	target_class_ = receiver_class;
+}
+
+bool MethodCall::IsBound() const {
+	return target_ != nullptr;
+}
+
+const runtime::Method& MethodCall::FindMethod(const runtime::ClassInstance& instance, size_t argument_count) const {
+	if (target_ != nullptr && (target_class_ == nullptr || target_class_ == &instance.GetClass())
+		&& target_->formal_params.size() == argument_count) {
+		return *target_;
+	}
+	return instance.FindMethod(method_, argument_count);
 }
 
 ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
+	return runtime::ConvertToString(argument_->Execute(closure, context), context);
+}
+
+ObjectHolder Length::Execute(Closure& closure, Context& context) {
 	auto object = argument_->Execute(closure, context);
-	std::ostringstream stream;
-	if (object) {
-		if (object.TryAs<runtime::Class>()) {
-			auto class_instance_ptr = reinterpret_cast<NewInstance*>(argument_.get());
-			runtime::ObjectHolder class_obj = class_instance_ptr->Execute(closure, context);
-			class_obj.Get()->Print(stream, context);
-		} else {
-			object.Get()->Print(stream, context);
-		}
-	} else {
-		stream << "None";
+	if (const auto* list = object.TryAs<runtime::List>()) {
+		return ObjectHolder::FromNumber(static_cast<int64_t>(list->Size()));
+	}
+	if (const auto* dict = object.TryAs<runtime::Dict>()) {
+		return ObjectHolder::FromNumber(static_cast<int64_t>(dict->Size()));
+	}
+	if (const auto* str = object.TryAs<runtime::String>()) {
+		return ObjectHolder::FromNumber(static_cast<int64_t>(str->GetValue().size()));
 	}
-	runtime::String str(stream.str());
-	return ObjectHolder::Own(std::move(str));
+	throw std::runtime_error("Object has no length"s);
 }
 
-int GetNumberFromObjectHolder(ObjectHolder& object, Context& context) {
-	std::ostringstream stream;
-	object.Get()->Print(stream, context);
-	int num = std::stoi(stream.str());
-	return  num;
+NewList::NewList(std::vector<std::unique_ptr<Statement>> items) : items_(std::move(items)) {
+}
+
+ObjectHolder NewList::Execute(Closure& closure, Context& context) {
+	std::vector<ObjectHolder> items;
+	items.reserve(items_.size());
+	for (auto& item : items_) {
+		items.push_back(item->Execute(closure, context));
+	}
+	return ObjectHolder::Own(runtime::List(std::move(items)));
+}
+
+NewDict::NewDict(std::vector<std::pair<std::unique_ptr<Statement>, std::unique_ptr<Statement>>> items)
+	: items_(std::move(items)) {
+}
+
+ObjectHolder NewDict::Execute(Closure& closure, Context& context) {
+	ObjectHolder result = ObjectHolder::Own(runtime::Dict());
+	auto& dict = static_cast<runtime::Dict&>(*result);
+	for (auto& [key, value] : items_) {
+		ObjectHolder key_object = key->Execute(closure, context);
+		ObjectHolder value_object = value->Execute(closure, context);
+		dict.Emplace(key_object, context) = std::move(value_object);
+	}
+	return result;
+}
+
+Subscript::Subscript(std::unique_ptr<Statement> object, std::unique_ptr<Statement> index)
+	: object_(std::move(object)), index_(std::move(index)) {
+}
+
+ObjectHolder Subscript::Execute(Closure& closure, Context& context) {
+	ObjectHolder object = object_->Execute(closure, context);
+	ObjectHolder index = index_->Execute(closure, context);
+	if (auto* list = object.TryAs<runtime::List>()) {
+		return list->At(index);
+	}
+	if (auto* dict = object.TryAs<runtime::Dict>()) {
+		return dict->At(index, context);
+	}
+	throw std::runtime_error("Object is not subscriptable"s);
+}
+
+SubscriptAssignment::SubscriptAssignment(std::unique_ptr<Statement> object, std::unique_ptr<Statement> index,
+										 std::unique_ptr<Statement> rv)
+	: object_(std::move(object)), index_(std::move(index)), rv_(std::move(rv)) {
+}
+
+ObjectHolder SubscriptAssignment::Execute(Closure& closure, Context& context) {
+	ObjectHolder object = object_->Execute(closure, context);
+	ObjectHolder index = index_->Execute(closure, context);
+	ObjectHolder value = rv_->Execute(closure, context);
+	if (auto* list = object.TryAs<runtime::List>()) {
+		return list->At(index) = std::move(value);
+	}
+	if (auto* dict = object.TryAs<runtime::Dict>()) {
+		return dict->Emplace(index, context) = std::move(value);
+	}
+	throw std::runtime_error("Object does not support item assignment"s);
 }
 
 // ------------ arithmetic binary operations
-ObjectHolder Add::Execute(Closure& closure, Context& context) {
-	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
-	ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
-	std::ostringstream stream;
-	if (lhs_obj.TryAs<runtime::Number>() && rhs_obj.TryAs<runtime::Number>()) {
-		lhs_obj.Get()->Print(stream, context);
-		int lhs_num = std::stoi(stream.str());
-		stream.str("");
-		stream.clear();
-		rhs_obj.Get()->Print(stream, context);
-		int rhs_num = std::stoi(stream.str());
-		runtime::Number result(lhs_num + rhs_num);
-		return  ObjectHolder::Own(std::move(result));
+namespace {
+
+ObjectHolder AddGeneric(const ObjectHolder& lhs_obj, const ObjectHolder& rhs_obj, Context& context) {
+	if (runtime::IsNumber(lhs_obj) && runtime::IsNumber(rhs_obj)) {
+		return runtime::AddNumbers(lhs_obj, rhs_obj);
 	} else if (lhs_obj.TryAs<runtime::String>() && rhs_obj.TryAs<runtime::String>()) {
-		lhs_obj.Get()->Print(stream, context);
-		rhs_obj.Get()->Print(stream, context);
-		runtime::String result(stream.str());
-		return  ObjectHolder::Own(std::move(result));
+		return ObjectHolder::Own(runtime::String::Concat(*lhs_obj.TryAs<runtime::String>(),
+														 rhs_obj.TryAs<runtime::String>()->GetValue()));
 	} else if (lhs_obj.TryAs<runtime::ClassInstance>()) {
 		auto class_ptr = reinterpret_cast<runtime::ClassInstance*>(lhs_obj.Get());
-		return class_ptr->Call("__add__", {rhs_obj}, context);
+		return class_ptr->Call(ADD_METHOD, {rhs_obj}, context);
 	}
 	throw std::runtime_error("Addition is not possible");
 }
 
-ObjectHolder Sub::Execute(Closure& closure, Context& context) {
-	//std::cerr << "Sub - Execute" << std::endl;
+}  // namespace
+
+Add::Specialization Add::Observe(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	if (lhs.TryAsNumber() && rhs.TryAsNumber()) {
+		return Specialization::Numbers;
+	}
+	if (lhs.TryAs<runtime::String>() != nullptr && rhs.TryAs<runtime::String>() != nullptr) {
+		return Specialization::Strings;
+	}
+	if (lhs.TryAs<runtime::ClassInstance>() != nullptr) {
+		return Specialization::Instance;
+	}
+	return Specialization::Generic;
+}
+
+ObjectHolder Add::Execute(Closure& closure, Context& context) {
 	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
 	ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
-	if (!lhs_obj.TryAs<runtime::Number>() || !rhs_obj.TryAs<runtime::Number>() ) {
-		throw std::runtime_error("One or both objects are not numbers");
+	switch (specialization_) {
+		case Specialization::Numbers: {
+			const auto lhs = lhs_obj.TryAsNumber();
+			const auto rhs = rhs_obj.TryAsNumber();
+			if (lhs && rhs) {
+				// Numbers take 63 bits, so the sum fits 64
+				return ObjectHolder::FromNumber(*lhs + *rhs);
+			}
+			break;
+		}
+		case Specialization::Strings: {
+			const auto* lhs = lhs_obj.TryAs<runtime::String>();
+			const auto* rhs = rhs_obj.TryAs<runtime::String>();
+			if (lhs != nullptr && rhs != nullptr) {
+				return ObjectHolder::Own(runtime::String::Concat(*lhs, rhs->GetValue()));
+			}
+			break;
+		}
+		case Specialization::Instance:
+			if (auto* instance = lhs_obj.TryAs<runtime::ClassInstance>()) {
+				return instance->Call(ADD_METHOD, {rhs_obj}, context);
+			}
+			break;
+		case Specialization::Unobserved:
+			specialization_ = Observe(lhs_obj, rhs_obj);
+			return AddGeneric(lhs_obj, rhs_obj, context);
+		case Specialization::Generic:
+			return AddGeneric(lhs_obj, rhs_obj, context);
 	}
-	runtime::Number result(GetNumberFromObjectHolder(lhs_obj, context) - GetNumberFromObjectHolder(rhs_obj, context));
-	return ObjectHolder::Own(std::move(result));
+	// The guard failed
+	specialization_ = Specialization::Generic;
+	return AddGeneric(lhs_obj, rhs_obj, context);
+}
+
+ObjectHolder Sub::Execute(Closure& closure, Context& context) {
+	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
+	ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
+	return runtime::SubtractNumbers(lhs_obj, rhs_obj);
 }
 
 ObjectHolder Mult::Execute(Closure& closure, Context& context) {
 	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
 	ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
-	if (!lhs_obj.TryAs<runtime::Number>() || !rhs_obj.TryAs<runtime::Number>() ) {
-		throw std::runtime_error("One or both objects are not numbers");
-	}
-	runtime::Number result(GetNumberFromObjectHolder(lhs_obj, context) * GetNumberFromObjectHolder(rhs_obj, context));
-	return ObjectHolder::Own(std::move(result));
+	return runtime::MultiplyNumbers(lhs_obj, rhs_obj);
 }
 
 ObjectHolder Div::Execute(Closure& closure, Context& context) {
 	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
 	ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
-	if (!lhs_obj.TryAs<runtime::Number>() || !rhs_obj.TryAs<runtime::Number>() ) {
-		throw std::runtime_error("One or both objects are not numbers");
+	return runtime::DivideNumbers(lhs_obj, rhs_obj);
+}
+
+// ------------ End of operations list
+
+namespace {
+
+thread_local const SourceMap* current_source_map = nullptr;
+
+std::optional<parse::SourcePosition> PositionOf(const Statement* statement) {
+	const SourceMap* source_map = SourceMap::Current();
+	return source_map != nullptr && statement != nullptr ? source_map->Find(statement) : std::nullopt;
+}
+
+template <typename Error>
+[[noreturn]] void Raise(Error located, const std::string* function) {
+	if (function != nullptr) {
+		located.LeaveFunction(*function);
 	}
-	int rhs_num(GetNumberFromObjectHolder(rhs_obj, context));
-	if (rhs_num == 0) {
-		throw std::runtime_error("Division by zero");
+	throw located;
+}
+
+// Raises the error of a statement again as an ExecutionError at its position; the errors
+// of the execution limits keep their kind
+[[noreturn]] void ThrowAt(const std::runtime_error& error, parse::SourcePosition position,
+						  const std::string* function = nullptr) {
+	if (dynamic_cast<const runtime::LimitExceeded*>(&error) != nullptr) {
+		Raise(LimitExceededError(error.what(), position), function);
 	}
-	runtime::Number result(GetNumberFromObjectHolder(lhs_obj, context) / rhs_num);
-	return ObjectHolder::Own(std::move(result));
+	Raise(ExecutionError(error.what(), position), function);
 }
 
-// ------------ End of operations list
+}  // namespace
 
 ObjectHolder Compound::Execute(Closure& closure, Context& context) {
-	for (auto& item : compounds_) {
-		item->Execute(closure, context);
+	size_t current = 0;
+	// Entering a try block costs nothing until something is thrown
+	try {
+		runtime::Profiler* profiler = runtime::Profiler::Current();
+		runtime::ShadowStack* shadow_stack = runtime::ShadowStack::Current();
+		if (profiler != nullptr || shadow_stack != nullptr) {
+			for (; current < compounds_.size(); ++current) {
+				context.CountStep();
+				std::optional<runtime::Profiler::StatementScope> scope;
+				if (profiler != nullptr) {
+					scope.emplace(*profiler, *compounds_[current]);
+				}
+				if (shadow_stack != nullptr) {
+					shadow_stack->SetStatement(*compounds_[current]);
+				}
+				compounds_[current]->Execute(closure, context);
+				if (context.GetControlFlow() != runtime::ControlFlow::Normal) {
+					break;
+				}
+			}
+			return ObjectHolder::None();
+		}
+		for (; current < compounds_.size(); ++current) {
+			context.CountStep();
+			compounds_[current]->Execute(closure, context);
+			if (context.GetControlFlow() != runtime::ControlFlow::Normal) {
+				break;
+			}
+		}
+	} catch (ExecutionError& error) {
+		if (auto position = PositionOf(compounds_[current].get())) {
+			error.PassStatement(*position);
+		}
+		throw;
+	} catch (const std::runtime_error& error) {
+		// The innermost statement with a known position takes the error
+		if (auto position = PositionOf(compounds_[current].get())) {
+			ThrowAt(error, *position);
+		}
+		throw;
+	}
+	return ObjectHolder::None();
+}
+
+void SourceMap::Add(const Statement* node, parse::SourcePosition position) {
+	positions_.emplace(node, position);
+}
+
+std::optional<parse::SourcePosition> SourceMap::Find(const Statement* node) const {
+	if (auto it = positions_.find(node); it != positions_.end()) {
+		return it->second;
+	}
+	return std::nullopt;
+}
+
+const SourceMap* SourceMap::Current() {
+	return current_source_map;
+}
+
+ExecutionError::ExecutionError(const std::string& message, parse::SourcePosition position)
+	: std::runtime_error(parse::ToString(position) + ": "s + message), position_(position),
+	stack_trace_{{position, {}}} {
+	MYTHON_COUNT(errors);
+}
+
+parse::SourcePosition ExecutionError::GetPosition() const {
+	return position_;
+}
+
+const std::vector<ExecutionError::Frame>& ExecutionError::GetStackTrace() const {
+	return stack_trace_;
+}
+
+std::string ExecutionError::FormatStackTrace() const {
+	std::string result = "Traceback (most recent call last):\n"s;
+	for (auto it = stack_trace_.rbegin(); it != stack_trace_.rend(); ++it) {
+		result += "  "s + parse::ToString(it->position) + ", in "s
+				  + (it->function.empty() ? "<unknown>"s : it->function) + "\n"s;
+	}
+	return result;
+}
+
+void ExecutionError::PassStatement(parse::SourcePosition position) {
+	// Blocks nested in one function share its frame
+	if (!stack_trace_.back().function.empty()) {
+		stack_trace_.push_back({position, {}});
+	}
+}
+
+void ExecutionError::LeaveFunction(const std::string& function) {
+	if (stack_trace_.back().function.empty()) {
+		stack_trace_.back().function = function.empty() ? "<method>"s : function;
+	}
+}
+
+void RethrowLocated(const Statement* statement, const std::string& function) {
+	const auto position = PositionOf(statement);
+	try {
+		throw;
+	} catch (ExecutionError& error) {
+		if (position) {
+			error.PassStatement(*position);
+		}
+		error.LeaveFunction(function);
+		throw;
+	} catch (const std::runtime_error& error) {
+		if (position) {
+			ThrowAt(error, *position, &function);
+		}
+		throw;
+	}
+}
+
+Program::Program(std::unique_ptr<Statement> body, SourceMap source_map)
+	: body_(std::move(body)), source_map_(std::move(source_map)) {
+}
+
+ObjectHolder Program::Execute(Closure& closure, Context& context) {
+	struct CurrentMapGuard {
+		const SourceMap* previous;
+		~CurrentMapGuard() {
+			current_source_map = previous;
+		}
+	} guard{std::exchange(current_source_map, &source_map_)};
+
+	// The heap limit bounds what the program allocates, whatever was there before
+	runtime::Heap& heap = runtime::Heap::Current();
+	struct ByteLimitGuard {
+		runtime::Heap& heap;
+		size_t previous;
+		~ByteLimitGuard() {
+			heap.SetByteLimit(previous);
+		}
+	} byte_limit_guard{heap, heap.GetByteLimit()};
+	if (const size_t max_heap_bytes = context.GetLimits().max_heap_bytes; max_heap_bytes != 0) {
+		heap.SetByteLimit(heap.GetStats().live_bytes + max_heap_bytes);
 	}
+
+	try {
+		return body_->Execute(closure, context);
+	} catch (ExecutionError& error) {
+		error.LeaveFunction("<module>"s);
+		throw;
+	}
+}
+
+const SourceMap& Program::GetSourceMap() const {
+	return source_map_;
+}
+
+ObjectHolder Return::Execute(Closure& /*closure*/, Context& context) {
+	context.RequestReturn(*statement_);
+	return ObjectHolder::None();
+}
+
+ObjectHolder Break::Execute(Closure& /*closure*/, Context& context) {
+	context.RequestTransfer(runtime::ControlFlow::Break);
+	return ObjectHolder::None();
+}
+
+ObjectHolder Continue::Execute(Closure& /*closure*/, Context& context) {
+	context.RequestTransfer(runtime::ControlFlow::Continue);
 	return ObjectHolder::None();
 }
 
-ObjectHolder Return::Execute(Closure& /*closure*/, Context& /*context*/) {
-	throw statement_.get();
+While::While(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> body)
+	: condition_(std::move(condition)), body_(std::move(body)) {
+}
+
+// Takes break and continue addressed to the loop, returns true when the loop has to stop
+bool LeaveLoop(Context& context) {
+	switch (context.GetControlFlow()) {
+		case runtime::ControlFlow::Normal:
+			return false;
+		case runtime::ControlFlow::Continue:
+			context.TakeTransfer();
+			return false;
+		case runtime::ControlFlow::Break:
+			context.TakeTransfer();
+			return true;
+		case runtime::ControlFlow::Return:
+			return true;
+	}
+	return true;
+}
+
+ObjectHolder While::Execute(Closure& closure, Context& context) {
+	while (runtime::IsTrue(condition_->Execute(closure, context))) {
+		context.CheckCancelled();
+		body_->Execute(closure, context);
+		if (LeaveLoop(context)) {
+			break;
+		}
+	}
+	return ObjectHolder::None();
+}
+
+ForEach::ForEach(std::string var, std::unique_ptr<Statement> iterable, std::unique_ptr<Statement> body)
+	: var_(std::move(var)), iterable_(std::move(iterable)), body_(std::move(body)) {
+}
+
+ObjectHolder ForEach::Execute(Closure& closure, Context& context) {
+	ObjectHolder iterable = iterable_->Execute(closure, context);
+	// A dictionary is iterated over a snapshot of its keys, so the body may change it freely
+	if (const auto* dict = iterable.TryAs<runtime::Dict>()) {
+		iterable = ObjectHolder::Own(runtime::List(dict->Keys()));
+	}
+	auto* list = iterable.TryAs<runtime::List>();
+	if (list == nullptr) {
+		throw std::runtime_error("Object is not iterable"s);
+	}
+	// The variable is assigned by the iterations only, after an empty loop it stays as it was
+	for (size_t i = 0; i < list->Size(); ++i) {
+		closure[var_] = list->Items()[i];
+		context.CheckCancelled();
+		body_->Execute(closure, context);
+		if (LeaveLoop(context)) {
+			break;
+		}
+	}
+	return ObjectHolder::None();
 }
 
 ClassDefinition::ClassDefinition(ObjectHolder cls) : cls_(cls) {
@@ -216,6 +599,7 @@ FieldAssignment::FieldAssignment(VariableValue object, std::string field_name, s
 								: object_(object), field_name_(field_name), rv_(std::move(rv)) { }
 
 ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) {
+	MYTHON_COUNT(field_assignments);
 	std::stringstream stream;
 	auto object = object_.Execute(closure, context);
 	auto* ptr = object.TryAs<runtime::ClassInstance>();
@@ -232,68 +616,108 @@ IfElse::IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement>
 }
 
 ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
-	ObjectHolder condition_result = condition_.get()->Execute(closure, context);
-	std::stringstream stream;
-	condition_result.Get()->Print(stream, context);
-	if (stream.str() == "True") {
-		return if_body_.get()->Execute(closure, context);
-	} else {
-		return else_body_.get() != nullptr ? else_body_.get()->Execute(closure, context) : ObjectHolder::None();
+	if (runtime::IsTrue(condition_->Execute(closure, context))) {
+		return if_body_->Execute(closure, context);
 	}
+	return else_body_ != nullptr ? else_body_->Execute(closure, context) : ObjectHolder::None();
 }
 
 ObjectHolder Or::Execute(Closure& closure, Context& context) {
-	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
-	std::ostringstream stream;
-	lhs_obj.Get()->Print(stream, context);
-	if (lhs_obj.TryAs<runtime::Bool>()) {
-		if (stream.str() == "True") {
-			return ObjectHolder::Own(runtime::Bool(true));
-		} else {
-			ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
-			stream.str("");
-			stream.clear();
-			rhs_obj.Get()->Print(stream, context);
-			if (stream.str() == "True") {
-				return ObjectHolder::Own(runtime::Bool(true));
-			}
-		}
+	if (runtime::IsTrue(lhs_->Execute(closure, context))) {
+		return ObjectHolder::FromBool(true);
 	}
-	return ObjectHolder::Own(runtime::Bool(false));
+	return ObjectHolder::FromBool(runtime::IsTrue(rhs_->Execute(closure, context)));
 }
 
 ObjectHolder And::Execute(Closure& closure, Context& context) {
-	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
-	std::ostringstream stream;
-	lhs_obj.Get()->Print(stream, context);
-	if (lhs_obj.TryAs<runtime::Bool>()) {
-		if (stream.str() == "True") {
-			ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
-			stream.str("");
-			stream.clear();
-			rhs_obj.Get()->Print(stream, context);
-			if (stream.str() == "True") {
-				return ObjectHolder::Own(runtime::Bool(true));
-			}
-		}
+	if (!runtime::IsTrue(lhs_->Execute(closure, context))) {
+		return ObjectHolder::FromBool(false);
 	}
-	return ObjectHolder::Own(runtime::Bool(false));
+	return ObjectHolder::FromBool(runtime::IsTrue(rhs_->Execute(closure, context)));
 }
 
 ObjectHolder Not::Execute(Closure& closure, Context& context) {
-	ObjectHolder obj = argument_.get()->Execute(closure, context);
-	std::ostringstream stream;
-	obj.Get()->Print(stream, context);
-	return stream.str() == "True" ?  ObjectHolder::Own(runtime::Bool(false)) : ObjectHolder::Own(runtime::Bool(true));
+	return ObjectHolder::FromBool(!runtime::IsTrue(argument_->Execute(closure, context)));
 }
 
 Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
 	: BinaryOperation(std::move(lhs), std::move(rhs)), cmp_(cmp) {
+	using Function = bool (*)(const ObjectHolder&, const ObjectHolder&, Context&);
+	const std::pair<Function, Operator> operators[] = {
+		{runtime::Equal, Operator::Equal},
+		{runtime::NotEqual, Operator::NotEqual},
+		{runtime::Less, Operator::Less},
+		{runtime::Greater, Operator::Greater},
+		{runtime::LessOrEqual, Operator::LessOrEqual},
+		{runtime::GreaterOrEqual, Operator::GreaterOrEqual},
+	};
+	const auto* function = cmp_.target<Function>();
+	const auto it = std::find_if(std::begin(operators), std::end(operators), [function](const auto& entry) {
+		return function != nullptr && *function == entry.first;
+	});
+	if (it != std::end(operators)) {
+		operator_ = it->second;
+	} else {
+		// Nothing is known about other comparators
+		specialization_ = Specialization::Generic;
+	}
+}
+
+template <typename Value>
+bool Comparison::Apply(const Value& lhs, const Value& rhs) const {
+	switch (operator_) {
+		case Operator::Equal:
+			return lhs == rhs;
+		case Operator::NotEqual:
+			return lhs != rhs;
+		case Operator::Less:
+			return lhs < rhs;
+		case Operator::Greater:
+			return lhs > rhs;
+		case Operator::LessOrEqual:
+			return lhs <= rhs;
+		case Operator::GreaterOrEqual:
+			return lhs >= rhs;
+	}
+	return false;
 }
 
 ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
-	auto result = cmp_(lhs_.get()->Execute(closure, context), rhs_.get()->Execute(closure, context), context);
-	return ObjectHolder::Own(runtime::Bool(result));
+	// The left operand is evaluated first, as in the bytecode
+	ObjectHolder lhs_obj = lhs_.get()->Execute(closure, context);
+	ObjectHolder rhs_obj = rhs_.get()->Execute(closure, context);
+	switch (specialization_) {
+		case Specialization::Numbers: {
+			const auto lhs = lhs_obj.TryAsNumber();
+			const auto rhs = rhs_obj.TryAsNumber();
+			if (lhs && rhs) {
+				return ObjectHolder::Own(runtime::Bool(Apply(*lhs, *rhs)));
+			}
+			break;
+		}
+		case Specialization::Strings: {
+			const auto* lhs = lhs_obj.TryAs<runtime::String>();
+			const auto* rhs = rhs_obj.TryAs<runtime::String>();
+			if (lhs != nullptr && rhs != nullptr) {
+				return ObjectHolder::Own(runtime::Bool(Apply(lhs->GetValue(), rhs->GetValue())));
+			}
+			break;
+		}
+		case Specialization::Unobserved:
+			if (lhs_obj.TryAsNumber() && rhs_obj.TryAsNumber()) {
+				specialization_ = Specialization::Numbers;
+			} else if (lhs_obj.TryAs<runtime::String>() != nullptr && rhs_obj.TryAs<runtime::String>() != nullptr) {
+				specialization_ = Specialization::Strings;
+			} else {
+				specialization_ = Specialization::Generic;
+			}
+			return ObjectHolder::Own(runtime::Bool(cmp_(lhs_obj, rhs_obj, context)));
+		case Specialization::Generic:
+			return ObjectHolder::Own(runtime::Bool(cmp_(lhs_obj, rhs_obj, context)));
+	}
+	// The guard failed
+	specialization_ = Specialization::Generic;
+	return ObjectHolder::Own(runtime::Bool(cmp_(lhs_obj, rhs_obj, context)));
 }
 
 // ------------ End of logical operations list
@@ -305,28 +729,125 @@ NewInstance::NewInstance(const runtime::Class& class_, std::vector<std::unique_p
 
 NewInstance::NewInstance(const runtime::Class& class_) : class__(class_) { }
 
+const runtime::Class& NewInstance::GetClass() const {
+	return class__;
+}
+
 ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
+	runtime::Heap::Current().MaybeCollect();
 	auto instance = ObjectHolder::Own(runtime::ClassInstance(class__));
 	const auto* m = class__.GetMethod(INIT_METHOD);
 	if (m != nullptr) {
-		vector<ObjectHolder> actual_args;
-		for (auto& st : args_) {
-			actual_args.push_back(st->Execute(closure, context));
+		runtime::FrameStack& stack = runtime::FrameStack::Current();
+		runtime::FrameStack::Scope scope(stack);
+		ObjectHolder* actual_args = stack.Allocate(args_.size());
+		for (size_t i = 0; i < args_.size(); ++i) {
+			actual_args[i] = args_[i]->Execute(closure, context);
 		}
-		instance.TryAs<runtime::ClassInstance>()->Call(INIT_METHOD, actual_args, context);
+		instance.TryAs<runtime::ClassInstance>()->Call(INIT_METHOD, {actual_args, args_.size()}, context);
 	}
 	return instance;
 }
 
-MethodBody::MethodBody(std::unique_ptr<Statement>&& body) : body_(std::move(body)) { }
+MethodBody::MethodBody(std::unique_ptr<Statement>&& body, std::string name)
+	: body_(std::move(body)), name_(std::move(name)) {
+}
+
+MethodBody::~MethodBody() = default;
 
 ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
+	MethodBody* current = this;
+	Statement* returned = nullptr;
 	try {
-		body_.get()->Execute(closure, context);
-	} catch (Statement* item) {
-		return item->Execute(closure, context);
+		return ExecuteFrom(current, returned, closure, context);
+	} catch (const std::runtime_error&) {
+		// The returned expression is the only code of the method outside of its blocks
+		RethrowLocated(returned, current->name_);
+	}
+}
+
+ObjectHolder MethodBody::Call(const runtime::Method& method, ObjectHolder self,
+							  runtime::ArgumentList actual_args, Context& context) {
+	if (context.GetEngine() == runtime::Engine::Bytecode) {
+		if (const vm::Code* code = GetCode(method)) {
+			return vm::Execute(*code, std::move(self), actual_args, context);
+		}
+	}
+	return Statement::Call(method, std::move(self), actual_args, context);
+}
+
+const std::string& MethodBody::GetName() const {
+	return name_;
+}
+
+const vm::Code* MethodBody::GetCode(const runtime::Method& method) {
+	if (!compiled_) {
+		compiled_ = true;
+		code_ = vm::Compile(*this, method.formal_params);
+	}
+	return code_.get();
+}
+
+const runtime::MethodEffects* MethodBody::GetEffects(const runtime::Method& method) {
+	if (!effects_) {
+		const vm::Code* code = GetCode(method);
+		if (code == nullptr) {
+			return nullptr;
+		}
+		effects_ = vm::AnalyzeEffects(*code);
+	}
+	return &*effects_;
+}
+
+ObjectHolder MethodBody::ExecuteFrom(MethodBody*& current, Statement*& returned,
+									 Closure& closure, Context& context) {
+	while (true) {
+		returned = nullptr;
+		current->body_.get()->Execute(closure, context);
+		returned = context.TakeTransfer();
+		if (returned == nullptr) {
+			return ObjectHolder::None();
+		}
+		// The returned expression is evaluated here, after its statement has finished
+		runtime::Profiler* profiler = runtime::Profiler::Current();
+		std::optional<runtime::Profiler::StatementScope> returned_scope;
+		if (profiler != nullptr) {
+			returned_scope.emplace(*profiler, *returned);
+		}
+		runtime::ShadowStack* shadow_stack = runtime::ShadowStack::Current();
+		if (shadow_stack != nullptr) {
+			shadow_stack->SetStatement(*returned);
+		}
+		auto* tail_call = dynamic_cast<MethodCall*>(returned);
+		if (tail_call == nullptr) {
+			return returned->Execute(closure, context);
+		}
+
+		runtime::FrameStack::Scope scope(runtime::FrameStack::Current());
+		ObjectHolder receiver;
+		const runtime::ArgumentList actual_args = tail_call->Evaluate(closure, context, receiver);
+		auto* instance = receiver.TryAs<runtime::ClassInstance>();
+		if (instance == nullptr) {
+			return tail_call->Invoke(receiver, actual_args, context);
+		}
+		const runtime::Method& method = tail_call->FindMethod(*instance, actual_args.size());
+		auto* callee = dynamic_cast<MethodBody*>(method.body.get());
+		if (callee == nullptr) {
+			return instance->Call(method, actual_args, context);
+		}
+		context.CheckCancelled();
+		if (profiler != nullptr) {
+			profiler->ReplaceMethod(instance->GetClass(), method);
+		}
+		if (shadow_stack != nullptr) {
+			shadow_stack->Replace(instance->GetClass(), method);
+		}
+		MYTHON_COUNT(method_calls);
+		// Everything the callee needs is evaluated, so the caller's frame can be reused
+		closure.clear();
+		runtime::ClassInstance::BindArguments(method, std::move(receiver), actual_args, closure);
+		current = callee;
 	}
-	return ObjectHolder::None();
 }
 
 }  // namespace ast
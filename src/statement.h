@@ -1,9 +1,16 @@
 #pragma once
 
 #include "runtime.h"
+#include "source_position.h"
 
 #include <functional>
 #include <iostream>
+#include <optional>
+
+namespace vm {
+class Compiler;
+struct Code;
+}  // namespace vm
 
 namespace ast {
 
@@ -13,15 +20,18 @@ template <typename T>
 class ValueStatement : public Statement {
 public:
 	explicit ValueStatement(T v)
-		: value_(std::move(v)) {
+		: value_(runtime::ObjectHolder::Own(std::move(v))) {
 	}
 
 	runtime::ObjectHolder Execute(runtime::Closure& /*closure*/, runtime::Context& /*context*/) override {
-		return runtime::ObjectHolder::Share(value_);
+		return value_;
 	}
 
 private:
-	T value_;
+	friend class vm::Compiler;
+
+	// Owned, so that the constant outlives the AST in the objects it was stored to
+	runtime::ObjectHolder value_;
 };
 
 using NumericConst = ValueStatement<runtime::Number>;
@@ -35,6 +45,8 @@ public:
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
+	friend class vm::Compiler;
+
 	std::vector<std::string> ids_chain_;
 };
 
@@ -44,6 +56,8 @@ public:
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
+	friend class vm::Compiler;
+
 	std::string var_;
 	std::unique_ptr<Statement> rv_;
 };
@@ -54,6 +68,8 @@ public:
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
+	friend class vm::Compiler;
+
 	VariableValue object_;
 	std::string field_name_;
 	std::unique_ptr<Statement> rv_;
@@ -76,6 +92,8 @@ public:
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
+	friend class vm::Compiler;
+
 	std::vector<std::unique_ptr<Statement>> args_;
 
 };
@@ -86,10 +104,37 @@ public:
 			   std::vector<std::unique_ptr<Statement>> args);
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	// Evaluates the receiver and the arguments, leaving the invocation to the caller. The arguments
+	// are kept on the frame stack until the scope of the caller ends
+	runtime::ArgumentList Evaluate(runtime::Closure& closure, runtime::Context& context,
+								   runtime::ObjectHolder& receiver);
+	// Calls the method of an evaluated receiver: a class instance or a built-in object
+	runtime::ObjectHolder Invoke(const runtime::ObjectHolder& receiver,
+								 runtime::ArgumentList actual_args,
+								 runtime::Context& context) const;
+	static runtime::ObjectHolder Invoke(const runtime::ObjectHolder& receiver, const std::string& method,
+										runtime::ArgumentList actual_args,
+										runtime::Context& context);
+	[[nodiscard]] const std::string& GetMethodName() const;
+	[[nodiscard]] size_t GetArgumentCount() const;
+
+	// Binds the call to method, which the receiver resolves the name to whenever it is an instance
+	// of receiver_class, or of any class if it is nullptr. The parser binds the calls once all
+	// classes are known, so they skip the search of the method by name
+	void Bind(const runtime::Method& method, const runtime::Class* receiver_class);
+	[[nodiscard]] bool IsBound() const;
+	// The method the call invokes on instance or throws, as ClassInstance::FindMethod does
+	[[nodiscard]] const runtime::Method& FindMethod(const runtime::ClassInstance& instance,
+												   size_t argument_count) const;
 private:
+	friend class vm::Compiler;
+
 	std::unique_ptr<Statement> object_;
 	std::string method_;
 	std::vector<std::unique_ptr<Statement>> args_;
+	const runtime::Method* target_ = nullptr;
+	const runtime::Class* target_class_ = nullptr;
 };
 
 class NewInstance : public Statement {
@@ -98,13 +143,68 @@ public:
 	NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+	[[nodiscard]] const runtime::Class& GetClass() const;
 
 private:
+	friend class vm::Compiler;
+
 	const runtime::Class& class__;
 	std::vector<std::unique_ptr<Statement>> args_;
 
 };
 
+// [item, ...]
+class NewList : public Statement {
+public:
+	explicit NewList(std::vector<std::unique_ptr<Statement>> items);
+
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+private:
+	friend class vm::Compiler;
+
+	std::vector<std::unique_ptr<Statement>> items_;
+};
+
+// {key: value, ...}
+class NewDict : public Statement {
+public:
+	explicit NewDict(std::vector<std::pair<std::unique_ptr<Statement>, std::unique_ptr<Statement>>> items);
+
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+private:
+	friend class vm::Compiler;
+
+	std::vector<std::pair<std::unique_ptr<Statement>, std::unique_ptr<Statement>>> items_;
+};
+
+// object[index]
+class Subscript : public Statement {
+public:
+	Subscript(std::unique_ptr<Statement> object, std::unique_ptr<Statement> index);
+
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+private:
+	friend class vm::Compiler;
+
+	std::unique_ptr<Statement> object_;
+	std::unique_ptr<Statement> index_;
+};
+
+// object[index] = rv
+class SubscriptAssignment : public Statement {
+public:
+	SubscriptAssignment(std::unique_ptr<Statement> object, std::unique_ptr<Statement> index,
+						std::unique_ptr<Statement> rv);
+
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+private:
+	friend class vm::Compiler;
+
+	std::unique_ptr<Statement> object_;
+	std::unique_ptr<Statement> index_;
+	std::unique_ptr<Statement> rv_;
+};
+
 class UnaryOperation : public Statement {
 public:
 	explicit UnaryOperation(std::unique_ptr<Statement> argument) :  argument_(std::move(argument)) {
@@ -119,6 +219,13 @@ public:
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 };
 
+// len(object) of a list, a dictionary or a string
+class Length : public UnaryOperation {
+public:
+	using UnaryOperation::UnaryOperation;
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+};
+
 // ------------ arithmetic and logical binary operations
 class BinaryOperation : public Statement {
 public:
@@ -129,10 +236,25 @@ public:
 	std::unique_ptr<Statement> rhs_;
 };
 
+// Specializes itself to the operand types of its first execution (quickening): two numbers, two
+// strings or a class instance on the left. A specialized node checks the types with a guard and
+// on a miss goes back to the generic addition for good. The node changes while the program
+// runs, see Program for threads
 class Add : public BinaryOperation {
 public:
+	enum class Specialization : uint8_t { Unobserved, Numbers, Strings, Instance, Generic };
+
 	using BinaryOperation::BinaryOperation;
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	[[nodiscard]] Specialization GetSpecialization() const {
+		return specialization_;
+	}
+
+private:
+	static Specialization Observe(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs);
+
+	Specialization specialization_ = Specialization::Unobserved;
 };
 
 class Sub : public BinaryOperation {
@@ -191,17 +313,112 @@ public:
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
+	friend class vm::Compiler;
+
 	std::vector<std::unique_ptr<Statement>> compounds_;
 };
 
 
+// Source positions of the nodes made by the parser. They are kept apart from the nodes, so that
+// the nodes executed on hot paths do not grow; only error reporting and profiling look them up
+class SourceMap {
+public:
+	// The first position given to a node is kept: the parser reports the innermost one first
+	void Add(const Statement* node, parse::SourcePosition position);
+	[[nodiscard]] std::optional<parse::SourcePosition> Find(const Statement* node) const;
+
+	// The map of the program being executed by the current thread, if any
+	[[nodiscard]] static const SourceMap* Current();
+private:
+	std::unordered_map<const Statement*, parse::SourcePosition> positions_;
+};
+
+// A runtime error raised by a statement at a known position of the program. While unwinding it
+// collects the Mython call stack: a frame per method it leaves, with the position reached there
+class ExecutionError : public std::runtime_error {
+public:
+	struct Frame {
+		parse::SourcePosition position;
+		std::string function;  // "Class.method" or "<module>", empty until the frame is left
+	};
+
+	ExecutionError(const std::string& message, parse::SourcePosition position);
+
+	[[nodiscard]] parse::SourcePosition GetPosition() const;
+	// The innermost frame first
+	[[nodiscard]] const std::vector<Frame>& GetStackTrace() const;
+	// "Traceback (most recent call last):" and a line per frame, the outermost first
+	[[nodiscard]] std::string FormatStackTrace() const;
+
+	// The error passes a statement of an enclosing block; it starts a frame after a call
+	void PassStatement(parse::SourcePosition position);
+	// The error leaves the code of function
+	void LeaveFunction(const std::string& function);
+private:
+	parse::SourcePosition position_;
+	std::vector<Frame> stack_trace_;
+};
+
+// The run went beyond one of the runtime::ExecutionLimits of its context
+class LimitExceededError : public ExecutionError {
+public:
+	using ExecutionError::ExecutionError;
+};
+
+// Called by the handler of a runtime error raised by the code of statement in function. An
+// ExecutionError passes the statement and leaves the function, other runtime errors are raised
+// again as ExecutionErrors at the statement. Errors of statements without a position are
+// rethrown as they are
+[[noreturn]] void RethrowLocated(const Statement* statement, const std::string& function);
+
+// The root of a parsed program together with the source positions of its nodes. A program
+// runs on one thread at a time: executing changes its nodes (quickened operations, bytecode
+// compiled on the first call) and the counters of its constants, which are not atomic. Threads
+// running at once parse programs of their own, as they keep heaps and frame stacks of their own
+class Program : public Statement {
+public:
+	Program(std::unique_ptr<Statement> body, SourceMap source_map);
+
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+	[[nodiscard]] const SourceMap& GetSourceMap() const;
+private:
+	std::unique_ptr<Statement> body_;
+	SourceMap source_map_;
+};
+
+// Returning a method call executes the callee in the frame of the caller,
+// so tail recursion, including the mutual one, runs in constant stack space
 class MethodBody : public Statement {
 public:
-	explicit MethodBody(std::unique_ptr<Statement>&& body);
+	// The name, "Class.method", appears in stack traces
+	explicit MethodBody(std::unique_ptr<Statement>&& body, std::string name = {});
+	~MethodBody() override;
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+	// Runs the bytecode of the method, unless the context asks for the tree walking engine
+	runtime::ObjectHolder Call(const runtime::Method& method, runtime::ObjectHolder self,
+							   runtime::ArgumentList actual_args,
+							   runtime::Context& context) override;
+
+	[[nodiscard]] const std::string& GetName() const;
+	// The bytecode of the method, compiled on the first request; nullptr if the body uses
+	// statements the compiler does not support
+	[[nodiscard]] const vm::Code* GetCode(const runtime::Method& method);
+	// Read off the bytecode; unknown for the methods without one
+	[[nodiscard]] const runtime::MethodEffects* GetEffects(const runtime::Method& method) override;
 private:
+	friend class vm::Compiler;
+
+	// Runs the bodies of current and its tail callees; keeps current and the expression being
+	// returned up to date for the error handling
+	static runtime::ObjectHolder ExecuteFrom(MethodBody*& current, Statement*& returned,
+											 runtime::Closure& closure, runtime::Context& context);
+
 	std::unique_ptr<Statement> body_;
+	std::string name_;
+	std::unique_ptr<vm::Code> code_;
+	bool compiled_ = false;
+	std::optional<runtime::MethodEffects> effects_;
 };
 
 class Return : public Statement {
@@ -211,9 +428,48 @@ public:
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
+	friend class vm::Compiler;
+
 	std::unique_ptr<Statement> statement_;
 };
 
+class Break : public Statement {
+public:
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+class Continue : public Statement {
+public:
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// The body runs in the scope of the enclosing statement, so iterations allocate no frames
+class While : public Statement {
+public:
+	While(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> body);
+
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+private:
+	friend class vm::Compiler;
+
+	std::unique_ptr<Statement> condition_;
+	std::unique_ptr<Statement> body_;
+};
+
+// for var in iterable: body
+class ForEach : public Statement {
+public:
+	ForEach(std::string var, std::unique_ptr<Statement> iterable, std::unique_ptr<Statement> body);
+
+	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+private:
+	friend class vm::Compiler;
+
+	std::string var_;
+	std::unique_ptr<Statement> iterable_;
+	std::unique_ptr<Statement> body_;
+};
+
 
 class ClassDefinition : public Statement {
 public:
@@ -232,21 +488,41 @@ public:
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
+	friend class vm::Compiler;
+
 	std::unique_ptr<Statement> condition_;
 	std::unique_ptr<Statement> if_body_;
 	std::unique_ptr<Statement> else_body_;
 };
 
+// Quickened like Add when cmp is one of the comparisons of the runtime: after two numbers or two
+// strings it compares their values directly, skipping the generic comparison
 class Comparison : public BinaryOperation {
 public:
 	using Comparator = std::function<bool(const runtime::ObjectHolder&,
 										  const runtime::ObjectHolder&, runtime::Context&)>;
 
+	enum class Specialization : uint8_t { Unobserved, Numbers, Strings, Generic };
+
 	Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
 
 	runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+	[[nodiscard]] Specialization GetSpecialization() const {
+		return specialization_;
+	}
+
 private:
+	friend class vm::Compiler;
+
+	enum class Operator : uint8_t { Equal, NotEqual, Less, Greater, LessOrEqual, GreaterOrEqual };
+
+	template <typename Value>
+	[[nodiscard]] bool Apply(const Value& lhs, const Value& rhs) const;
+
 	Comparator cmp_;
+	Operator operator_ = Operator::Equal;
+	Specialization specialization_ = Specialization::Unobserved;
 };
 
 }  // namespace ast
@@ -2,6 +2,8 @@
 
 #include "test_runner_p.h"
 
+#include <limits>
+
 
 using namespace std;
 
@@ -16,7 +18,7 @@ template <typename T>
 void AssertObjectValueEqual(const ObjectHolder& obj, const T& expected, const string& msg) {
 	ostringstream one;
 	runtime::DummyContext context;
-	obj->Print(one, context);
+	runtime::PrintValue(obj, one, context);
 
 	ostringstream two;
 	two << expected;
@@ -44,7 +46,7 @@ void TestNumericConst() {
     ASSERT(empty.empty());
 
     ostringstream os;
-    o->Print(os, context);
+    runtime::PrintValue(o, os, context);
     ASSERT_EQUAL(os.str(), "57"s);
 
     ASSERT(context.output.str().empty());
@@ -74,7 +76,7 @@ void TestVariable() {
     runtime::String word("Hello"s);
 
     Closure closure = {{"x"s, ObjectHolder::Share(num)}, {"w"s, ObjectHolder::Share(word)}};
-    ASSERT(VariableValue("x"s).Execute(closure, context).Get() == &num);
+    ASSERT(VariableValue("x"s).Execute(closure, context).TryAsNumber() == 42);
     ASSERT(VariableValue("w"s).Execute(closure, context).Get() == &word);
     ASSERT_THROWS(VariableValue("unknown"s).Execute(closure, context), std::runtime_error);
 
@@ -213,6 +215,28 @@ void TestStringify() {
         Stringify str(make_unique<None>());
         ASSERT_OBJECT_VALUE_EQUAL(str.Execute(empty, context), "None"s);
     }
+    {
+        auto result = Stringify(make_unique<BoolConst>(runtime::Bool(true))).Execute(empty, context);
+        ASSERT_OBJECT_VALUE_EQUAL(result, "True"s);
+        ASSERT(result.TryAs<runtime::String>());
+    }
+    {
+        auto result = Stringify(make_unique<NumericConst>(-9223372036854775807 - 1)).Execute(empty, context);
+        ASSERT_OBJECT_VALUE_EQUAL(result, "-9223372036854775808"s);
+    }
+    {
+        // The argument is evaluated once
+        vector<runtime::Method> methods;
+        methods.push_back({"__str__"s, {}, make_unique<StringConst>("boxed"s)});
+        runtime::Class cls("BoxedValue"s, std::move(methods), nullptr);
+        Closure closure{{"BoxedValue"s, ObjectHolder::Share(cls)}};
+
+        ASSERT_OBJECT_VALUE_EQUAL(Stringify(make_unique<VariableValue>("BoxedValue"s)).Execute(closure, context),
+                                  "Class BoxedValue"s);
+        const size_t allocations = runtime::Heap::Current().GetStats().total_allocations;
+        ASSERT_OBJECT_VALUE_EQUAL(Stringify(make_unique<NewInstance>(cls)).Execute(empty, context), "boxed"s);
+        ASSERT_EQUAL(runtime::Heap::Current().GetStats().total_allocations, allocations + 1);
+    }
 
     ASSERT(context.output.str().empty());
 }
@@ -289,6 +313,72 @@ void TestClassInstanceAddWithoutMethod() {
     ASSERT(context.output.str().empty());
 }
 
+void TestAddQuickening() {
+    runtime::DummyContext context;
+
+    Closure closure;
+    closure["x"s] = ObjectHolder::Own(runtime::Number(40));
+    closure["y"s] = ObjectHolder::Own(runtime::Number(2));
+    Add sum(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    ASSERT(sum.GetSpecialization() == Add::Specialization::Unobserved);
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 42);
+    ASSERT(sum.GetSpecialization() == Add::Specialization::Numbers);
+
+    // A sum too wide for a Number leaves the operands numbers
+    closure["x"s] = ObjectHolder::Own(runtime::Number(numeric_limits<int64_t>::max() / 2));
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "4611686018427387905"s);
+    ASSERT(sum.GetSpecialization() == Add::Specialization::Numbers);
+
+    closure["x"s] = ObjectHolder::Own(runtime::String("4"s));
+    closure["y"s] = ObjectHolder::Own(runtime::String("2"s));
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "42"s);
+    ASSERT(sum.GetSpecialization() == Add::Specialization::Generic);
+    closure["y"s] = ObjectHolder::Own(runtime::Number(2));
+    ASSERT_THROWS(sum.Execute(closure, context), std::runtime_error);
+
+    Add concatenation(make_unique<StringConst>("4"s), make_unique<VariableValue>("y"s));
+    closure["y"s] = ObjectHolder::Own(runtime::String("2"s));
+    ASSERT_OBJECT_VALUE_EQUAL(concatenation.Execute(closure, context), "42"s);
+    ASSERT(concatenation.GetSpecialization() == Add::Specialization::Strings);
+    closure["y"s] = ObjectHolder::Own(runtime::Number(2));
+    ASSERT_THROWS(concatenation.Execute(closure, context), std::runtime_error);
+    ASSERT(concatenation.GetSpecialization() == Add::Specialization::Generic);
+
+    ASSERT(context.output.str().empty());
+}
+
+void TestComparisonQuickening() {
+    runtime::DummyContext context;
+
+    Closure closure;
+    closure["x"s] = ObjectHolder::Own(runtime::Number(1));
+    closure["y"s] = ObjectHolder::Own(runtime::Number(2));
+    Comparison less(runtime::Less, make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "True"s);
+    ASSERT(less.GetSpecialization() == Comparison::Specialization::Numbers);
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "True"s);
+
+    closure["x"s] = ObjectHolder::Own(runtime::String("b"s));
+    closure["y"s] = ObjectHolder::Own(runtime::String("a"s));
+    ASSERT_OBJECT_VALUE_EQUAL(less.Execute(closure, context), "False"s);
+    ASSERT(less.GetSpecialization() == Comparison::Specialization::Generic);
+
+    Comparison greater_or_equal(runtime::GreaterOrEqual, make_unique<StringConst>("b"s),
+                                make_unique<StringConst>("b"s));
+    ASSERT_OBJECT_VALUE_EQUAL(greater_or_equal.Execute(closure, context), "True"s);
+    ASSERT(greater_or_equal.GetSpecialization() == Comparison::Specialization::Strings);
+    ASSERT_OBJECT_VALUE_EQUAL(greater_or_equal.Execute(closure, context), "True"s);
+
+    // Other comparators stay generic
+    Comparison custom(
+        [](const ObjectHolder&, const ObjectHolder&, runtime::Context&) {
+            return true;
+        },
+        make_unique<NumericConst>(2), make_unique<NumericConst>(1));
+    ASSERT(custom.GetSpecialization() == Comparison::Specialization::Generic);
+    ASSERT_OBJECT_VALUE_EQUAL(custom.Execute(closure, context), "True"s);
+}
+
 void TestCompound() {
     runtime::DummyContext context;
 
@@ -337,9 +427,9 @@ void TestFields() {
     for (int i = 1, expected = 0; i < 10; expected += i, ++i) {
 
         auto fv = inst.Call("value"s, {}, context);
-        auto* obj = fv.TryAs<runtime::Number>();
-        ASSERT(obj);
-        ASSERT_EQUAL(obj->GetValue(), expected);
+        const auto value = fv.TryAsNumber();
+        ASSERT(value);
+        ASSERT_EQUAL(*value, expected);
 
         inst.Call("add"s, {ObjectHolder::Own(runtime::Number(i))}, context);
     }
@@ -472,6 +562,8 @@ void RunUnitTests(TestRunner& tr) {
 	RUN_TEST(tr, ast::TestBadAddition);
 	RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd);
 	RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
+	RUN_TEST(tr, ast::TestAddQuickening);
+	RUN_TEST(tr, ast::TestComparisonQuickening);
 	RUN_TEST(tr, ast::TestCompound);
 	RUN_TEST(tr, ast::TestFields);
 	RUN_TEST(tr, ast::TestBaseClass);
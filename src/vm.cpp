@@ -0,0 +1,678 @@
+#include "vm.h"
+
+#include "frame_stack.h"
+#include "profiler.h"
+#include "statement.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+// Threaded dispatch: each handler jumps straight to the next one through a table of label
+// addresses. Compilers without the extension get a switch in a loop
+#if defined(__GNUC__) || defined(__clang__)
+#define MYTHON_VM_COMPUTED_GOTO
+#endif
+
+namespace vm {
+
+using runtime::ArgumentList;
+using runtime::ClassInstance;
+using runtime::Context;
+using runtime::FrameStack;
+using runtime::ObjectHolder;
+
+namespace {
+
+const string INIT_METHOD = "__init__"s;
+
+const char* const OPCODE_NAMES[] = {
+#define MYTHON_VM_OPCODE_NAME(name) #name,
+	MYTHON_VM_OPCODES(MYTHON_VM_OPCODE_NAME)
+#undef MYTHON_VM_OPCODE_NAME
+};
+
+// Locals refer to it until they are assigned. No holder owns it, so sharing it is free
+runtime::Object& UnboundMarker() {
+	static runtime::Bool marker(false);
+	return marker;
+}
+
+using Comparator = bool (*)(const ObjectHolder&, const ObjectHolder&, Context&);
+
+const Comparator COMPARATORS[] = {
+	runtime::Equal, runtime::NotEqual, runtime::Less,
+	runtime::Greater, runtime::LessOrEqual, runtime::GreaterOrEqual,
+};
+
+template <typename Value>
+bool Apply(Comparison comparison, const Value& lhs, const Value& rhs) {
+	switch (comparison) {
+		case Comparison::Equal:
+			return lhs == rhs;
+		case Comparison::NotEqual:
+			return lhs != rhs;
+		case Comparison::Less:
+			return lhs < rhs;
+		case Comparison::Greater:
+			return lhs > rhs;
+		case Comparison::LessOrEqual:
+			return lhs <= rhs;
+		case Comparison::GreaterOrEqual:
+			return lhs >= rhs;
+	}
+	return false;
+}
+
+// Numbers and strings are compared directly, the runtime comparators handle the rest
+bool Compare(uint8_t flags, const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+	const auto comparison = static_cast<Comparison>(flags & COMPARISON_MASK);
+	if (const auto lhs_number = lhs.TryAsNumber()) {
+		if (const auto rhs_number = rhs.TryAsNumber()) {
+			return Apply(comparison, *lhs_number, *rhs_number);
+		}
+	} else if (const auto* lhs_string = lhs.TryAs<runtime::String>()) {
+		if (const auto* rhs_string = rhs.TryAs<runtime::String>()) {
+			return Apply(comparison, lhs_string->GetValue(), rhs_string->GetValue());
+		}
+	}
+	return COMPARATORS[static_cast<size_t>(comparison)](lhs, rhs, context);
+}
+
+// The semantics of ast::Add with a fast path for Numbers
+ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+	if (const auto lhs_number = lhs.TryAsNumber()) {
+		if (const auto rhs_number = rhs.TryAsNumber()) {
+			// Numbers take 63 bits, so the sum fits 64
+			return ObjectHolder::FromNumber(*lhs_number + *rhs_number);
+		}
+	}
+	if (runtime::IsNumber(lhs) && runtime::IsNumber(rhs)) {
+		return runtime::AddNumbers(lhs, rhs);
+	}
+	if (const auto* lhs_string = lhs.TryAs<runtime::String>()) {
+		if (const auto* rhs_string = rhs.TryAs<runtime::String>()) {
+			return ObjectHolder::Own(runtime::String::Concat(*lhs_string, rhs_string->GetValue()));
+		}
+	}
+	if (auto* instance = lhs.TryAs<ClassInstance>()) {
+		return instance->Call("__add__"s, {rhs}, context);
+	}
+	throw runtime_error("Addition is not possible"s);
+}
+
+ObjectHolder Subtract(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+	if (const auto lhs_number = lhs.TryAsNumber()) {
+		if (const auto rhs_number = rhs.TryAsNumber()) {
+			return ObjectHolder::FromNumber(*lhs_number - *rhs_number);
+		}
+	}
+	return runtime::SubtractNumbers(lhs, rhs);
+}
+
+ObjectHolder Length(const ObjectHolder& object) {
+	if (const auto* list = object.TryAs<runtime::List>()) {
+		return ObjectHolder::FromNumber(static_cast<int64_t>(list->Size()));
+	}
+	if (const auto* dict = object.TryAs<runtime::Dict>()) {
+		return ObjectHolder::FromNumber(static_cast<int64_t>(dict->Size()));
+	}
+	if (const auto* str = object.TryAs<runtime::String>()) {
+		return ObjectHolder::FromNumber(static_cast<int64_t>(str->GetValue().size()));
+	}
+	throw runtime_error("Object has no length"s);
+}
+
+ClassInstance& FieldOwner(const ObjectHolder& object) {
+	auto* instance = object.TryAs<ClassInstance>();
+	if (instance == nullptr) {
+		throw runtime_error("There is no such field"s);
+	}
+	return *instance;
+}
+
+vector<ObjectHolder> Gather(const ObjectHolder* registers, const uint16_t* operands, size_t count) {
+	vector<ObjectHolder> items;
+	items.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		items.push_back(registers[operands[i]]);
+	}
+	return items;
+}
+
+// Copies the registers to the top of the frame stack, where they live until the scope ends
+ArgumentList Push(FrameStack& stack, const ObjectHolder* registers, const uint16_t* operands, size_t count) {
+	ObjectHolder* slots = stack.Allocate(count);
+	for (size_t i = 0; i < count; ++i) {
+		slots[i] = registers[operands[i]];
+	}
+	return {slots, count};
+}
+
+// The registers of a frame and after them the loop counters
+size_t FrameSize(const Code& code) {
+	return code.register_count + code.counter_count;
+}
+
+void Bind(const Code& code, ObjectHolder self, ArgumentList actual_args, ObjectHolder* registers) {
+	registers[0] = std::move(self);
+	for (size_t i = 0; i < actual_args.size(); ++i) {
+		registers[code.parameters[i]] = actual_args[i];
+	}
+	const ObjectHolder unbound = ObjectHolder::Share(UnboundMarker());
+	for (size_t i = code.first_local; i < code.first_temporary; ++i) {
+		registers[i] = unbound;
+	}
+}
+
+// The handlers below run outside of Execute to keep its frame small, it is taken by every call
+
+[[noreturn]] void Fail(const string& message) {
+	throw runtime_error(message);
+}
+
+ObjectHolder GetField(const ObjectHolder& object, const string& name, bool last) {
+	auto* instance = object.TryAs<ClassInstance>();
+	if (instance == nullptr) {
+		throw runtime_error("Cant access fields"s);
+	}
+	MYTHON_COUNT(field_lookups);
+	const auto& fields = instance->Fields();
+	const auto it = fields.find(name);
+	if (it == fields.end()) {
+		throw runtime_error(last ? "Name "s + name + " not found in the scope"s : "Name not found in the scope"s);
+	}
+	return it->second;
+}
+
+void AddToField(const ObjectHolder& object, const string& name, const ObjectHolder& increment, Context& context) {
+	MYTHON_COUNT(field_assignments);
+	MYTHON_COUNT(field_lookups);
+	auto& fields = FieldOwner(object).Fields();
+	const auto it = fields.find(name);
+	if (it == fields.end()) {
+		throw runtime_error("Name "s + name + " not found in the scope"s);
+	}
+	const auto value = it->second.TryAsNumber();
+	const auto step = increment.TryAsNumber();
+	if (value && step) {
+		it->second = ObjectHolder::FromNumber(*value + *step);
+	} else {
+		// __add__ may change the fields, so the slot is looked up again
+		ObjectHolder result = Add(it->second, increment, context);
+		fields[name] = std::move(result);
+	}
+}
+
+ObjectHolder NewInstance(const runtime::Class& cls, const ObjectHolder* registers, const uint16_t* operands,
+						 size_t count, Context& context) {
+	runtime::Heap::Current().MaybeCollect();
+	ObjectHolder instance = ObjectHolder::Own(ClassInstance(cls));
+	if (cls.GetMethod(INIT_METHOD) != nullptr) {
+		FrameStack& stack = FrameStack::Current();
+		FrameStack::Scope scope(stack);
+		static_cast<ClassInstance&>(*instance).Call(INIT_METHOD, Push(stack, registers, operands, count), context);
+	}
+	return instance;
+}
+
+ObjectHolder GetItem(const ObjectHolder& object, const ObjectHolder& index, Context& context) {
+	if (auto* list = object.TryAs<runtime::List>()) {
+		return list->At(index);
+	}
+	if (auto* dict = object.TryAs<runtime::Dict>()) {
+		return dict->At(index, context);
+	}
+	throw runtime_error("Object is not subscriptable"s);
+}
+
+void SetItem(const ObjectHolder& object, const ObjectHolder& index, const ObjectHolder& value, Context& context) {
+	if (auto* list = object.TryAs<runtime::List>()) {
+		list->At(index) = value;
+	} else if (auto* dict = object.TryAs<runtime::Dict>()) {
+		dict->Emplace(index, context) = value;
+	} else {
+		throw runtime_error("Object does not support item assignment"s);
+	}
+}
+
+void Print(const ObjectHolder* registers, const uint16_t* operands, size_t count, Context& context) {
+	ostream& out = context.GetOutputStream();
+	for (size_t i = 0; i < count; ++i) {
+		if (i != 0) {
+			out << ' ';
+		}
+		runtime::PrintValue(registers[operands[i]], out, context);
+	}
+	out << '\n';
+	MYTHON_COUNT(prints);
+}
+
+// The list for iterates over: the list itself or a snapshot of the keys of a dictionary, so
+// the body may change the dictionary freely
+ObjectHolder Iterated(const ObjectHolder& iterable) {
+	if (const auto* dict = iterable.TryAs<runtime::Dict>()) {
+		return ObjectHolder::Own(runtime::List(dict->Keys()));
+	}
+	if (iterable.TryAs<runtime::List>() == nullptr) {
+		throw runtime_error("Object is not iterable"s);
+	}
+	return iterable;
+}
+
+// operands[0] is the receiver, the arguments follow
+ObjectHolder Call(const ObjectHolder* registers, const uint16_t* operands, size_t count, const string& method_name,
+				  Context& context) {
+	FrameStack& stack = FrameStack::Current();
+	FrameStack::Scope scope(stack);
+	return ast::MethodCall::Invoke(registers[operands[0]], method_name, Push(stack, registers, operands + 1, count),
+								   context);
+}
+
+// Calls through a call site bound to its method, the receiver is operands[0]
+ObjectHolder CallDirect(const ObjectHolder* registers, const uint16_t* operands, size_t count,
+						const ast::MethodCall& call, Context& context) {
+	FrameStack& stack = FrameStack::Current();
+	FrameStack::Scope scope(stack);
+	return call.Invoke(registers[operands[0]], Push(stack, registers, operands + 1, count), context);
+}
+
+// Calls the method of a tail call unless it runs as bytecode, which is returned to reuse the frame.
+// The method is found by name unless the call site is bound
+const Code* TailCall(const ObjectHolder* registers, const uint16_t* operands, size_t count, const string& method_name,
+					 const ast::MethodCall* bound, ObjectHolder& result, Context& context) {
+	if (auto* instance = registers[operands[0]].TryAs<ClassInstance>()) {
+		const runtime::Method& method = bound != nullptr ? bound->FindMethod(*instance, count)
+														  : instance->FindMethod(method_name, count);
+		auto* callee = dynamic_cast<ast::MethodBody*>(method.body.get());
+		if (const Code* callee_code = callee != nullptr ? callee->GetCode(method) : nullptr) {
+			context.CheckCancelled();
+			if (runtime::ShadowStack* shadow_stack = runtime::ShadowStack::Current()) {
+				shadow_stack->Replace(instance->GetClass(), method);
+			}
+			MYTHON_COUNT(method_calls);
+			return callee_code;
+		}
+	}
+	result = bound != nullptr ? CallDirect(registers, operands, count, *bound, context)
+							  : Call(registers, operands, count, method_name, context);
+	return nullptr;
+}
+
+// Binds the receiver and the arguments of a tail call in the frame of the caller, if the callee
+// fits in it, or else in a larger frame on top of it; the old one stays until Execute returns
+ObjectHolder* Rebind(FrameStack& stack, const Code& callee, ObjectHolder* registers, size_t& frame_size,
+					 const uint16_t* operands, size_t count) {
+	ObjectHolder* frame = registers;
+	if (FrameSize(callee) > frame_size) {
+		frame = stack.Allocate(FrameSize(callee));
+	}
+	FrameStack::Scope scope(stack);
+	// An argument may be passed twice, so they are copied rather than moved
+	const ArgumentList moved = Push(stack, registers, operands, count + 1);
+	fill(registers, registers + frame_size, ObjectHolder());
+	frame_size = max(frame_size, FrameSize(callee));
+	Bind(callee, moved[0], {moved.begin() + 1, count}, frame);
+	return frame;
+}
+
+}  // namespace
+
+ObjectHolder Execute(const Code& entry, ObjectHolder self, ArgumentList actual_args, Context& context) {
+	const Code* code = &entry;
+	FrameStack& stack = FrameStack::Current();
+	FrameStack::Scope scope(stack);
+	size_t frame_size = FrameSize(*code);
+	ObjectHolder* r = stack.Allocate(frame_size);
+	Bind(*code, std::move(self), actual_args, r);
+	// The calls push their frames in ClassInstance::Call, the steps update the statement of the top
+	runtime::ShadowStack* const shadow_stack = runtime::ShadowStack::Current();
+
+	const Instruction* base = code->instructions.data();
+	const Instruction* ip = base;
+
+	// A computed goto leaves the case without destroying its objects, so the cases create them
+	// in blocks ending before the dispatch
+#ifdef MYTHON_VM_COMPUTED_GOTO
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto* DISPATCH_TABLE[static_cast<size_t>(ip->op)]
+#else
+#define VM_CASE(name) case Opcode::name:
+#define VM_DISPATCH() continue
+#endif
+#define VM_NEXT() \
+	++ip;         \
+	VM_DISPATCH()
+#define VM_JUMP(target)     \
+	ip = base + (target); \
+	VM_DISPATCH()
+
+	try {
+#ifdef MYTHON_VM_COMPUTED_GOTO
+		static const void* const DISPATCH_TABLE[] = {
+#define MYTHON_VM_OPCODE_LABEL(name) &&op_##name,
+			MYTHON_VM_OPCODES(MYTHON_VM_OPCODE_LABEL)
+#undef MYTHON_VM_OPCODE_LABEL
+		};
+		VM_DISPATCH();
+#else
+		for (;;) {
+			switch (ip->op) {
+#endif
+		VM_CASE(Step) {
+			context.CountStep();
+			if (shadow_stack != nullptr) {
+				shadow_stack->SetStatement(*code->statements[ip - base]);
+			}
+			VM_NEXT();
+		}
+		VM_CASE(CheckCancelled) {
+			context.CheckCancelled();
+			VM_NEXT();
+		}
+		VM_CASE(Jump) {
+			VM_JUMP(ip->d);
+		}
+		VM_CASE(JumpIfFalse) {
+			if (!runtime::IsTrue(r[ip->a])) {
+				VM_JUMP(ip->d);
+			}
+			VM_NEXT();
+		}
+		VM_CASE(JumpIfTrue) {
+			if (runtime::IsTrue(r[ip->a])) {
+				VM_JUMP(ip->d);
+			}
+			VM_NEXT();
+		}
+		VM_CASE(JumpCompare) {
+			if (Compare(ip->flags, r[ip->a], r[ip->b], context) == ((ip->flags & JUMP_WHEN_TRUE) != 0)) {
+				VM_JUMP(ip->d);
+			}
+			VM_NEXT();
+		}
+		VM_CASE(JumpCompareConst) {
+			if (Compare(ip->flags, r[ip->a], code->constants[ip->b], context)
+				== ((ip->flags & JUMP_WHEN_TRUE) != 0)) {
+				VM_JUMP(ip->d);
+			}
+			VM_NEXT();
+		}
+		VM_CASE(Return) {
+			return r[ip->a];
+		}
+		VM_CASE(ReturnNone) {
+			return ObjectHolder::None();
+		}
+		VM_CASE(TailCall) {
+			{
+				const uint16_t* operands = &code->operands[ip->d];
+				ObjectHolder result;
+				const Code* callee = TailCall(r, operands, ip->c, code->names[ip->b], nullptr, result, context);
+				if (callee == nullptr) {
+					return result;
+				}
+				// Everything the callee needs is evaluated, so the frame can be reused
+				r = Rebind(stack, *callee, r, frame_size, operands, ip->c);
+				code = callee;
+			}
+			base = code->instructions.data();
+			VM_JUMP(0);
+		}
+		VM_CASE(TailCallDirect) {
+			{
+				const uint16_t* operands = &code->operands[ip->d];
+				const ast::MethodCall& call = *code->calls[ip->b];
+				ObjectHolder result;
+				const Code* callee = TailCall(r, operands, ip->c, call.GetMethodName(), &call, result, context);
+				if (callee == nullptr) {
+					return result;
+				}
+				r = Rebind(stack, *callee, r, frame_size, operands, ip->c);
+				code = callee;
+			}
+			base = code->instructions.data();
+			VM_JUMP(0);
+		}
+		VM_CASE(Move) {
+			r[ip->a] = r[ip->b];
+			VM_NEXT();
+		}
+		VM_CASE(LoadConst) {
+			r[ip->a] = code->constants[ip->b];
+			VM_NEXT();
+		}
+		VM_CASE(LoadNone) {
+			r[ip->a] = ObjectHolder::None();
+			VM_NEXT();
+		}
+		VM_CASE(CheckBound) {
+			if (r[ip->a].Get() == &UnboundMarker()) {
+				Fail(code->names[ip->b]);
+			}
+			VM_NEXT();
+		}
+		VM_CASE(Throw) {
+			Fail(code->names[ip->b]);
+		}
+		VM_CASE(GetField) {
+			r[ip->a] = GetField(r[ip->b], code->names[ip->c], (ip->flags & LAST_FIELD) != 0);
+			VM_NEXT();
+		}
+		VM_CASE(CheckFieldTarget) {
+			FieldOwner(r[ip->a]);
+			VM_NEXT();
+		}
+		VM_CASE(SetField) {
+			MYTHON_COUNT(field_assignments);
+			FieldOwner(r[ip->a]).Fields()[code->names[ip->b]] = r[ip->c];
+			VM_NEXT();
+		}
+		VM_CASE(FieldAddConst) {
+			AddToField(r[ip->a], code->names[ip->b], code->constants[ip->c], context);
+			VM_NEXT();
+		}
+		VM_CASE(Add) {
+			r[ip->a] = Add(r[ip->b], r[ip->c], context);
+			VM_NEXT();
+		}
+		VM_CASE(AddConst) {
+			r[ip->a] = Add(r[ip->b], code->constants[ip->c], context);
+			VM_NEXT();
+		}
+		VM_CASE(Sub) {
+			r[ip->a] = Subtract(r[ip->b], r[ip->c]);
+			VM_NEXT();
+		}
+		VM_CASE(SubConst) {
+			r[ip->a] = Subtract(r[ip->b], code->constants[ip->c]);
+			VM_NEXT();
+		}
+		VM_CASE(Mult) {
+			r[ip->a] = runtime::MultiplyNumbers(r[ip->b], r[ip->c]);
+			VM_NEXT();
+		}
+		VM_CASE(Div) {
+			r[ip->a] = runtime::DivideNumbers(r[ip->b], r[ip->c]);
+			VM_NEXT();
+		}
+		VM_CASE(Compare) {
+			r[ip->a] = ObjectHolder::FromBool(Compare(ip->flags, r[ip->b], r[ip->c], context));
+			VM_NEXT();
+		}
+		VM_CASE(CompareConst) {
+			r[ip->a] = ObjectHolder::FromBool(Compare(ip->flags, r[ip->b], code->constants[ip->c], context));
+			VM_NEXT();
+		}
+		VM_CASE(Not) {
+			r[ip->a] = ObjectHolder::FromBool(!runtime::IsTrue(r[ip->b]));
+			VM_NEXT();
+		}
+		VM_CASE(Stringify) {
+			r[ip->a] = runtime::ConvertToString(r[ip->b], context);
+			VM_NEXT();
+		}
+		VM_CASE(Length) {
+			r[ip->a] = Length(r[ip->b]);
+			VM_NEXT();
+		}
+		VM_CASE(Call) {
+			r[ip->a] = Call(r, &code->operands[ip->d], ip->c, code->names[ip->b], context);
+			VM_NEXT();
+		}
+		VM_CASE(CallDirect) {
+			r[ip->a] = CallDirect(r, &code->operands[ip->d], ip->c, *code->calls[ip->b], context);
+			VM_NEXT();
+		}
+		VM_CASE(NewInstance) {
+			r[ip->a] = NewInstance(*code->classes[ip->b], r, &code->operands[ip->d], ip->c, context);
+			VM_NEXT();
+		}
+		VM_CASE(NewList) {
+			r[ip->a] = ObjectHolder::Own(runtime::List(Gather(r, &code->operands[ip->d], ip->c)));
+			VM_NEXT();
+		}
+		VM_CASE(NewDict) {
+			r[ip->a] = ObjectHolder::Own(runtime::Dict());
+			VM_NEXT();
+		}
+		VM_CASE(DictInsert) {
+			static_cast<runtime::Dict&>(*r[ip->a]).Emplace(r[ip->b], context) = r[ip->c];
+			VM_NEXT();
+		}
+		VM_CASE(GetItem) {
+			r[ip->a] = GetItem(r[ip->b], r[ip->c], context);
+			VM_NEXT();
+		}
+		VM_CASE(SetItem) {
+			SetItem(r[ip->a], r[ip->b], r[ip->c], context);
+			VM_NEXT();
+		}
+		VM_CASE(Print) {
+			Print(r, &code->operands[ip->d], ip->c, context);
+			VM_NEXT();
+		}
+		VM_CASE(ForPrepare) {
+			r[ip->a] = Iterated(r[ip->a]);
+			r[code->register_count + ip->b] = ObjectHolder::FromNumber(0);
+			VM_NEXT();
+		}
+		VM_CASE(ForNext) {
+			auto& list = static_cast<runtime::List&>(*r[ip->a]);
+			ObjectHolder& counter = r[code->register_count + ip->b];
+			const auto index = static_cast<size_t>(*counter.TryAsNumber());
+			if (index >= list.Size()) {
+				VM_JUMP(ip->d);
+			}
+			r[ip->c] = list.Items()[index];
+			counter = ObjectHolder::FromNumber(static_cast<int64_t>(index + 1));
+			VM_NEXT();
+		}
+#ifndef MYTHON_VM_COMPUTED_GOTO
+			}
+		}
+#endif
+	} catch (const runtime_error&) {
+		ast::RethrowLocated(code->statements[ip - base], code->name);
+	}
+
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_JUMP
+}
+
+namespace {
+
+// A call on self with no self among the arguments, noted in effects
+bool AddSelfCall(const Code& code, const Instruction& instruction, runtime::MethodEffects& effects) {
+	const uint16_t* operands = &code.operands[instruction.d];
+	if (operands[0] != 0 || find(operands + 1, operands + 1 + instruction.c, 0) != operands + 1 + instruction.c) {
+		return false;
+	}
+	const bool bound = instruction.op == Opcode::CallDirect || instruction.op == Opcode::TailCallDirect;
+	effects.self_calls.emplace_back(bound ? code.calls[instruction.b]->GetMethodName() : code.names[instruction.b],
+									instruction.c);
+	return true;
+}
+
+}  // namespace
+
+runtime::MethodEffects AnalyzeEffects(const Code& code) {
+	runtime::MethodEffects effects;
+	for (const Instruction& instruction : code.instructions) {
+		// Register 0 is self
+		const bool a = instruction.a != 0;
+		const bool b = instruction.b != 0;
+		const bool c = instruction.c != 0;
+		bool pure = false;
+		switch (instruction.op) {
+			case Opcode::Step:
+			case Opcode::CheckCancelled:
+			case Opcode::Jump:
+			case Opcode::ReturnNone:
+			case Opcode::Throw:
+				pure = true;
+				break;
+			case Opcode::JumpIfFalse:
+			case Opcode::JumpIfTrue:
+			case Opcode::JumpCompareConst:
+			case Opcode::Return:
+			case Opcode::LoadConst:
+			case Opcode::LoadNone:
+			case Opcode::CheckBound:
+				pure = a;
+				break;
+			case Opcode::JumpCompare:
+			case Opcode::Move:
+			case Opcode::AddConst:
+			case Opcode::SubConst:
+			case Opcode::CompareConst:
+			case Opcode::Not:
+			case Opcode::Stringify:
+			case Opcode::Length:
+				pure = a && b;
+				break;
+			case Opcode::Add:
+			case Opcode::Sub:
+			case Opcode::Mult:
+			case Opcode::Div:
+			case Opcode::Compare:
+				pure = a && b && c;
+				break;
+			case Opcode::Call:
+			case Opcode::CallDirect:
+				pure = a && AddSelfCall(code, instruction, effects);
+				break;
+			case Opcode::TailCall:
+			case Opcode::TailCallDirect:
+				pure = AddSelfCall(code, instruction, effects);
+				break;
+			default:
+				break;
+		}
+		if (!pure) {
+			return {};
+		}
+	}
+	effects.pure = true;
+	return effects;
+}
+
+void Disassemble(const Code& code, ostream& out) {
+	const char fill = out.fill('0');
+	for (size_t i = 0; i < code.instructions.size(); ++i) {
+		const Instruction& instruction = code.instructions[i];
+		out << setw(4) << i << ' ' << OPCODE_NAMES[static_cast<size_t>(instruction.op)]
+			<< ' ' << instruction.a << ' ' << instruction.b << ' ' << instruction.c << ' ' << instruction.d;
+		if (instruction.flags != 0) {
+			out << " flags="sv << static_cast<int>(instruction.flags);
+		}
+		out << '\n';
+	}
+	out.fill(fill);
+}
+
+}  // namespace vm
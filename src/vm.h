@@ -0,0 +1,128 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ast {
+class MethodCall;
+}
+
+namespace vm {
+
+// Register bytecode of method bodies. A frame keeps self, the parameters, the local variables
+// and the temporaries of a method in an array of registers, so running the code looks no names
+// up in closures. Operands: a, b and c are registers unless noted, K is the constant table and
+// N the name table; calls, lists and prints take their registers from the operand table at d.
+// The superinstructions fuse the idioms the parser produces most: field increments, comparisons
+// with constants that branch and the calls made by return
+#define MYTHON_VM_OPCODES(X)                                                                       \
+	X(Step)              /* counts a statement against the step limit                           */ \
+	X(CheckCancelled)    /* polls the cancellation token at a loop iteration                    */ \
+	X(Jump)              /* goto d                                                              */ \
+	X(JumpIfFalse)       /* goto d unless a is true in the sense of runtime::IsTrue             */ \
+	X(JumpIfTrue)        /* goto d if a is true in the sense of runtime::IsTrue                 */ \
+	X(JumpCompare)       /* goto d if (a <cmp> b) == JUMP_WHEN_TRUE, cmp and the bit in flags   */ \
+	X(JumpCompareConst)  /* goto d if (a <cmp> K[b]) == JUMP_WHEN_TRUE                          */ \
+	X(Return)            /* returns a                                                           */ \
+	X(ReturnNone)        /*                                                                     */ \
+	X(TailCall)          /* returns N[b] called on operands[d] with c arguments, in this frame  */ \
+	X(TailCallDirect)    /* TailCall through the call site calls[b] bound to its method         */ \
+	X(Move)              /* a = b                                                               */ \
+	X(LoadConst)         /* a = K[b]                                                            */ \
+	X(LoadNone)          /* a = None                                                            */ \
+	X(CheckBound)        /* throws the message N[b] if the local a was never assigned           */ \
+	X(Throw)             /* throws the message N[b]                                             */ \
+	X(GetField)          /* a = b.N[c]; flags is LAST_FIELD for the end of a dotted name        */ \
+	X(CheckFieldTarget)  /* throws unless a is a class instance, before a field assignment      */ \
+	X(SetField)          /* a.N[b] = c                                                          */ \
+	X(FieldAddConst)     /* a.N[b] = a.N[b] + K[c]                                              */ \
+	X(Add)               /* a = b + c                                                           */ \
+	X(AddConst)          /* a = b + K[c]                                                        */ \
+	X(Sub)               /* a = b - c                                                           */ \
+	X(SubConst)          /* a = b - K[c]                                                        */ \
+	X(Mult)              /* a = b * c                                                           */ \
+	X(Div)               /* a = b / c                                                           */ \
+	X(Compare)           /* a = b <cmp> c, cmp in flags                                         */ \
+	X(CompareConst)      /* a = b <cmp> K[c]                                                    */ \
+	X(Not)               /* a = not b                                                           */ \
+	X(Stringify)         /* a = str(b)                                                          */ \
+	X(Length)            /* a = len(b)                                                          */ \
+	X(Call)              /* a = N[b] called on operands[d] with c arguments                     */ \
+	X(CallDirect)        /* Call through the call site calls[b] bound to its method             */ \
+	X(NewInstance)       /* a = new instance of classes[b], __init__ takes c operands from d    */ \
+	X(NewList)           /* a = list of c operands from d                                       */ \
+	X(NewDict)           /* a = {}                                                              */ \
+	X(DictInsert)        /* a[b] = c on a dictionary being built                                */ \
+	X(GetItem)           /* a = b[c]                                                            */ \
+	X(SetItem)           /* a[b] = c                                                            */ \
+	X(Print)             /* prints c operands from d                                            */ \
+	X(ForPrepare)        /* a = the list iterated over a or the keys of the dictionary a        */ \
+	X(ForNext)           /* c = a[counters[b]++] or goto d when the list a is exhausted         */
+
+enum class Opcode : uint8_t {
+#define MYTHON_VM_OPCODE_ENUM(name) name,
+	MYTHON_VM_OPCODES(MYTHON_VM_OPCODE_ENUM)
+#undef MYTHON_VM_OPCODE_ENUM
+};
+
+enum class Comparison : uint8_t {
+	Equal,
+	NotEqual,
+	Less,
+	Greater,
+	LessOrEqual,
+	GreaterOrEqual,
+};
+
+constexpr uint8_t JUMP_WHEN_TRUE = 0x80;
+constexpr uint8_t COMPARISON_MASK = 0x0f;
+constexpr uint8_t LAST_FIELD = 1;
+
+struct Instruction {
+	Opcode op;
+	uint8_t flags = 0;
+	uint16_t a = 0;
+	uint16_t b = 0;
+	uint16_t c = 0;
+	uint32_t d = 0;
+};
+
+struct Code {
+	std::string name;  // "Class.method", for stack traces
+	std::vector<Instruction> instructions;
+	// The statement each instruction executes for, errors are reported at its position
+	std::vector<const runtime::Executable*> statements;
+	std::vector<runtime::ObjectHolder> constants;
+	std::vector<std::string> names;
+	std::vector<const runtime::Class*> classes;
+	// The call sites the parser bound to the methods they invoke
+	std::vector<const ast::MethodCall*> calls;
+	std::vector<uint16_t> operands;
+	// Register 0 is self, parameters[i] takes the i-th argument; the locals from first_local
+	// start unassigned, the temporaries from first_temporary start as None
+	std::vector<uint16_t> parameters;
+	uint16_t first_local = 1;
+	uint16_t first_temporary = 1;
+	uint16_t register_count = 1;
+	uint16_t counter_count = 0;  // loop counters of for, Numbers in the slots after the registers
+};
+
+// Runs code as the body of a method called on self. The frame is taken from the frame stack of
+// the thread, tail calls of methods with bytecode reuse it; errors become ast::ExecutionErrors
+// located at the statements raising them
+runtime::ObjectHolder Execute(const Code& code, runtime::ObjectHolder self,
+							  runtime::ArgumentList actual_args, runtime::Context& context);
+
+// Finds what the code may do besides computing its result. Only the operations on values, the
+// jumps and the calls on self taking no self as an argument leave the code pure; any other use
+// of self, fields, prints, object creation and iteration do not
+runtime::MethodEffects AnalyzeEffects(const Code& code);
+
+// A line per instruction: its index, opcode and operands
+void Disassemble(const Code& code, std::ostream& out);
+
+}  // namespace vm
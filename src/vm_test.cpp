@@ -0,0 +1,632 @@
+#include "frame_stack.h"
+#include "lexer.h"
+#include "memo.h"
+#include "parse.h"
+#include "profiler.h"
+#include "statement.h"
+#include "test_runner_p.h"
+#include "vm.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace vm {
+
+namespace {
+
+// The output of the program and the stack trace and message of the error it stops with
+string Run(const string& program, runtime::Engine engine, runtime::MemoCache* memoization = nullptr) {
+	istringstream input(program);
+	parse::Lexer lexer(input);
+	auto tree = ParseProgram(lexer);
+
+	runtime::DummyContext context;
+	context.SetEngine(engine);
+	context.SetMemoization(memoization);
+	runtime::Closure closure;
+	try {
+		tree->Execute(closure, context);
+	} catch (const ast::ExecutionError& error) {
+		context.output << error.FormatStackTrace() << error.what() << '\n';
+	}
+	return context.output.str();
+}
+
+// Runs the program with both engines, they have to agree
+string RunBoth(const string& program) {
+	const string result = Run(program, runtime::Engine::Bytecode);
+	ASSERT_EQUAL(result, Run(program, runtime::Engine::Tree));
+	return result;
+}
+
+// The bytecode of a method of a class the program defines
+string DisassembleMethod(const string& program, const string& class_name, const string& method_name) {
+	istringstream input(program);
+	parse::Lexer lexer(input);
+	auto tree = ParseProgram(lexer);
+
+	runtime::DummyContext context;
+	runtime::Closure closure;
+	tree->Execute(closure, context);
+	const auto* cls = closure.at(class_name).TryAs<runtime::Class>();
+	ASSERT(cls != nullptr);
+	const runtime::Method* method = cls->GetMethod(method_name);
+	ASSERT(method != nullptr);
+	auto* body = dynamic_cast<ast::MethodBody*>(method->body.get());
+	ASSERT(body != nullptr);
+	const Code* code = body->GetCode(*method);
+	if (code == nullptr) {
+		return {};
+	}
+	ostringstream out;
+	Disassemble(*code, out);
+	return out.str();
+}
+
+void TestLoopsAndCalls() {
+	const string program = R"(
+class Math:
+  def gcd(a, b):
+    if b == 0:
+      return a
+    return self.gcd(b, a - a / b * b)
+
+  def sum(n):
+    total = 0
+    i = 0
+    while i < n:
+      i = i + 1
+      if i == 3:
+        continue
+      if i > 8:
+        break
+      total = total + i
+    return total
+
+  def keys(d):
+    result = []
+    for k in d:
+      result.append(k)
+    return result
+
+  def squares(items):
+    result = {}
+    for x in items:
+      result[x] = x * x
+    return result
+
+m = Math()
+print m.gcd(1071, 462), m.sum(100)
+print m.keys({'b': 1, 'a': 2}), m.squares([1, 2, 3])
+)"s;
+	ASSERT_EQUAL(RunBoth(program), "21 33\n[b, a] {1: 1, 2: 4, 3: 9}\n"s);
+}
+
+void TestLogicalOperations() {
+	const string program = R"(
+class Logic:
+  def check(x, y):
+    if x and y:
+      print 'and'
+    if x or y:
+      print 'or'
+    if not x:
+      print 'not'
+    return [x and y, x or y, not x]
+
+  def loop(x):
+    n = 0
+    while x:
+      x = x - 1
+      n = n + 1
+    return n
+
+l = Logic()
+print l.check(True, False)
+print l.check(1, True)
+print l.check(False, 'True')
+print l.loop(3)
+)"s;
+	ASSERT_EQUAL(RunBoth(program), "or\n[False, True, False]\nand\nor\n[True, True, False]\nor\nnot\n"
+								   "[False, True, True]\n3\n"s);
+}
+
+// Every condition takes runtime::IsTrue: zero, empty strings and collections and None are false
+void TestTruth() {
+	const string program = R"(
+class Truth:
+  def check(x):
+    r = ''
+    if x:
+      r = r + 'if '
+    if not x:
+      r = r + 'not '
+    if x and 1:
+      r = r + 'and '
+    if 0 or x:
+      r = r + 'or '
+    y = x
+    while y:
+      r = r + 'while '
+      y = 0
+    return r + str([not x, x and 1, 0 or x])
+
+t = Truth()
+print t.check(0)
+print t.check(7)
+print t.check('')
+print t.check('False')
+print t.check([])
+print t.check([0])
+print t.check({})
+print t.check({1: 2})
+print t.check(None)
+print t.check(True)
+)"s;
+	const string falsy = "not [True, False, False]\n"s;
+	const string truthy = "if and or while [False, True, True]\n"s;
+	ASSERT_EQUAL(RunBoth(program), falsy + truthy + falsy + truthy + falsy + truthy + falsy + truthy + falsy + truthy);
+}
+
+void TestFields() {
+	const string program = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def add(n):
+    self.value = self.value + n
+    self.value = self.value + 1
+    self.next = self
+    return self.next.next.value
+
+c = Counter()
+print c.add(2), c.add(3), c.value
+)"s;
+	ASSERT_EQUAL(RunBoth(program), "3 7 7\n"s);
+	const string code = DisassembleMethod(program, "Counter"s, "add"s);
+	ASSERT(code.find("FieldAddConst"s) != string::npos);
+}
+
+void TestErrors() {
+	ASSERT_EQUAL(RunBoth(R"(
+class A:
+  def f(x):
+    if x:
+      y = 1
+    return y
+
+a = A()
+print a.f(True)
+print a.f(False)
+)"s), "1\nTraceback (most recent call last):\n  line 10, column 1, in <module>\n"
+					  "  line 6, column 12, in A.f\nline 6, column 12: Name y not found in the scope\n"s);
+
+	RunBoth(R"(
+class A:
+  def f():
+    return z.w
+a = A()
+print a.f()
+)"s);
+
+	RunBoth(R"(
+class A:
+  def f(n):
+    if n == 0:
+      return 1 / n
+    return self.g(n - 1)
+
+  def g(n):
+    x = self.f(n)
+    return x
+
+a = A()
+print a.f(3)
+)"s);
+
+	RunBoth(R"(
+class A:
+  def f(x):
+    x.v = self.g()
+
+  def g():
+    print 'evaluated'
+    return 1
+
+a = A()
+a.f(5)
+)"s);
+}
+
+// After a loop the variable is bound only if an iteration ran, in both engines
+void TestEmptyLoop() {
+	ASSERT_EQUAL(RunBoth(R"(
+class A:
+  def last(xs):
+    for x in xs:
+      x = x + 1
+    return x
+
+a = A()
+print a.last([1, 2])
+print a.last([])
+)"s), "3\nTraceback (most recent call last):\n  line 10, column 1, in <module>\n"
+		  "  line 6, column 12, in A.last\nline 6, column 12: Name x not found in the scope\n"s);
+}
+
+// A key whose __eq__ grows the dictionary it is compared in, which moves the table under the probe
+void TestDictChangedByEq() {
+	ASSERT_EQUAL(RunBoth(R"(
+class K:
+  def __init__(id, d):
+    self.id = id
+    self.d = d
+    self.grow = False
+
+  def __hash__():
+    return 7
+
+  def __eq__(other):
+    if self.grow:
+      self.grow = False
+      i = 0
+      while i < 200:
+        self.d[i + 1000] = i
+        i = i + 1
+    return self.id == other.id
+
+d = {}
+a = K(1, d)
+b = K(2, d)
+d[a] = 1
+a.grow = True
+d[b] = 2
+print d[b], d[a], len(d)
+)"s), "2 1 202\n"s);
+}
+
+// A method of native code recording the shadow stack as "Class.method:line", the module first
+class StackProbe : public runtime::Executable {
+public:
+	explicit StackProbe(vector<string>& frames)
+		: frames_(frames) {
+	}
+
+	runtime::ObjectHolder Execute(runtime::Closure& /*closure*/, runtime::Context& /*context*/) override {
+		const runtime::ShadowStack& stack = *runtime::ShadowStack::Current();
+		for (size_t i = 0; i < stack.Depth(); ++i) {
+			const runtime::ShadowStack::Frame& frame = stack.At(i);
+			const runtime::Class* cls = frame.cls.load();
+			string name = cls != nullptr ? cls->GetName() + '.' + frame.method.load()->name : "<module>"s;
+			const auto* statement = dynamic_cast<const ast::Statement*>(frame.statement.load());
+			if (statement != nullptr) {
+				name += ':' + to_string(ast::SourceMap::Current()->Find(statement)->line);
+			}
+			frames_.push_back(std::move(name));
+		}
+		return runtime::ObjectHolder::None();
+	}
+
+private:
+	vector<string>& frames_;
+};
+
+// The frames of the sampler are kept by the bytecode as by the tree walker, tail calls included
+void TestShadowStack() {
+	const string program = R"(
+class A:
+  def f(p):
+    x = 1
+    return self.g(p, x)
+
+  def g(p, x):
+    y = x + 1
+    p.probe()
+    return y
+
+a = A()
+a.f(probe)
+)"s;
+	for (const auto engine : {runtime::Engine::Bytecode, runtime::Engine::Tree}) {
+		vector<string> frames;
+		vector<runtime::Method> methods;
+		methods.push_back({"probe"s, {}, make_unique<StackProbe>(frames)});
+		runtime::Class probe_class("Probe"s, std::move(methods), nullptr);
+
+		istringstream input(program);
+		parse::Lexer lexer(input);
+		auto tree = ParseProgram(lexer);
+		runtime::DummyContext context;
+		context.SetEngine(engine);
+		runtime::Closure closure;
+		closure["probe"s] = runtime::ObjectHolder::Own(runtime::ClassInstance(probe_class));
+		runtime::ShadowStack shadow_stack;
+		{
+			runtime::ShadowStack::Activation activation(shadow_stack);
+			tree->Execute(closure, context);
+		}
+		ASSERT_EQUAL(frames, (vector<string>{"<module>:13"s, "A.g:9"s, "Probe.probe"s}));
+		ASSERT_EQUAL(shadow_stack.Depth(), 1U);
+	}
+}
+
+void TestSuperinstructions() {
+	const string program = R"(
+class Math:
+  def down(n):
+    if n < 1:
+      return 0
+    return self.down(n - 1)
+)"s;
+	const string code = DisassembleMethod(program, "Math"s, "down"s);
+	ASSERT(code.find("JumpCompareConst"s) != string::npos);
+	ASSERT(code.find("SubConst"s) != string::npos);
+	ASSERT(code.find("TailCall"s) != string::npos);
+	ASSERT(code.find("Return "s) != string::npos);
+}
+
+void TestRecursion() {
+	const string program = R"(
+class A:
+  def f(n):
+    if n == 0:
+      return 0
+    return 1 + self.f(n - 1)
+
+a = A()
+print a.f(100)
+)"s;
+	ASSERT_EQUAL(RunBoth(program), "100\n"s);
+}
+
+// Tail calls between methods with frames of different sizes
+void TestFrames() {
+	const string program = R"(
+class Walk:
+  def small(n, total):
+    if n == 0:
+      return total
+    return self.large(n - 1, total, 1)
+
+  def large(n, total, step):
+    sum = total + step
+    for x in [1, 2]:
+      sum = sum + x
+    return self.small(n, sum)
+
+w = Walk()
+print w.small(N, 0)
+)"s;
+	const auto with = [&program](int n) {
+		string result = program;
+		result.replace(result.find('N'), 1, to_string(n));
+		return result;
+	};
+	ASSERT_EQUAL(RunBoth(with(10)), "40\n"s);
+
+	// Frames are released when the calls return and the tail calls take no more of them
+	runtime::FrameStack& stack = runtime::FrameStack::Current();
+	ASSERT(stack.IsEmpty());
+	Run(with(100), runtime::Engine::Bytecode);
+	const size_t capacity = stack.GetCapacity();
+	ASSERT_EQUAL(Run(with(20000), runtime::Engine::Bytecode), "80000\n"s);
+	ASSERT_EQUAL(stack.GetCapacity(), capacity);
+	ASSERT(stack.IsEmpty());
+}
+
+void TestMemoization() {
+	const string fibonacci = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+fib = Fib()
+print fib.calc(25)
+)"s;
+	for (const auto engine : {runtime::Engine::Bytecode, runtime::Engine::Tree}) {
+		runtime::MemoCache cache;
+		ASSERT_EQUAL(Run(fibonacci, engine, &cache), "75025\n"s);
+		// Every argument from 0 to 25 is computed once
+		ASSERT_EQUAL(cache.GetStats().misses, 26U);
+		ASSERT_EQUAL(cache.GetStats().hits, 23U);
+		ASSERT_EQUAL(cache.GetSize(), 26U);
+	}
+
+	// The least recently used results go first, 1 and True are different arguments; lists are not
+	// values, so their calls always run
+	runtime::MemoCache small(2);
+	ASSERT_EQUAL(Run(R"(
+class Math:
+  def square(x):
+    return x * x
+
+  def same(x):
+    return x
+
+  def size(items):
+    return len(items)
+
+m = Math()
+print m.square(1), m.square(2), m.square(3), m.square(1), m.square(1), m.same(1), m.same(True)
+print m.size([1, 2]), m.size([1, 2])
+)"s, runtime::Engine::Bytecode, &small), "1 4 9 1 1 1 True\n2 2\n"s);
+	ASSERT_EQUAL(small.GetStats().hits, 1U);
+	ASSERT_EQUAL(small.GetStats().misses, 6U);
+	ASSERT_EQUAL(small.GetStats().evictions, 4U);
+	ASSERT_EQUAL(small.GetSize(), 2U);
+}
+
+void TestPurity() {
+	const string program = R"(
+class Base:
+  def __init__():
+    self.side = 2
+
+  def area(n):
+    return self.side * n
+
+  def noisy(n):
+    print 'computing', n
+    return n
+
+  def make(n):
+    return [n]
+
+  def identity():
+    return self
+
+  def value(n):
+    return self.step(n)
+
+  def step(n):
+    return n + 1
+
+  def even(n):
+    if n == 0:
+      return True
+    return self.odd(n - 1)
+
+  def odd(n):
+    if n == 0:
+      return False
+    result = self.check(n - 1)
+    self.noisy(n)
+    return result
+
+  def check(n):
+    return self.even(n)
+
+class Derived(Base):
+  def step(n):
+    return self.noisy(n)
+)"s;
+	istringstream input(program);
+	parse::Lexer lexer(input);
+	auto tree = ParseProgram(lexer);
+	runtime::DummyContext context;
+	runtime::Closure closure;
+	tree->Execute(closure, context);
+	const auto& base = *closure.at("Base"s).TryAs<runtime::Class>();
+	const auto& derived = *closure.at("Derived"s).TryAs<runtime::Class>();
+
+	runtime::MemoCache cache;
+	const auto is_pure = [&cache](const runtime::Class& cls, const string& name) {
+		return cache.IsPure(cls, *cls.GetMethod(name));
+	};
+	ASSERT(!is_pure(base, "area"s));
+	ASSERT(!is_pure(base, "noisy"s));
+	ASSERT(!is_pure(base, "make"s));
+	ASSERT(!is_pure(base, "identity"s));
+	// Purity depends on the methods self resolves to
+	ASSERT(is_pure(base, "value"s));
+	ASSERT(!is_pure(derived, "value"s));
+	// check was taken for pure while odd was analyzed, and odd prints
+	ASSERT(!is_pure(base, "even"s));
+	ASSERT(!is_pure(base, "check"s));
+	ASSERT(!is_pure(base, "odd"s));
+
+	ASSERT_EQUAL(Run(program + R"(
+d = Derived()
+print d.value(1)
+print d.value(1)
+print d.even(2)
+)"s, runtime::Engine::Bytecode, &cache), "computing 1\n1\ncomputing 1\n1\ncomputing 1\nTrue\n"s);
+	ASSERT_EQUAL(cache.GetStats().hits, 0U);
+}
+
+// Calls on receivers of a known class skip the search of the method by name
+void TestDevirtualization() {
+	const string program = R"(
+class Shape:
+  def area():
+    return 0
+
+  def name():
+    return 'shape'
+
+  def describe():
+    return self.name() + ' ' + str(self.area())
+
+class Square(Shape):
+  def __init__(side):
+    self.side = side
+
+  def area():
+    return self.side * self.side
+
+class Builder:
+  def exact(n):
+    square = Square(n)
+    return square.area() + square.area()
+
+  def mixed(n):
+    shape = Square(n)
+    if n > 2:
+      shape = Shape()
+    return shape.area()
+
+  def twice(n):
+    return self.exact(n) * 2
+
+  def last(n):
+    return self.exact(n)
+
+b = Builder()
+s = Square(3)
+t = Shape()
+print s.describe(), t.describe()
+print b.exact(3), b.mixed(2), b.mixed(3), b.twice(1), b.last(2)
+)"s;
+	ASSERT_EQUAL(RunBoth(program), "shape 9 shape 0\n18 4 0 4 8\n"s);
+
+	// area is overridden in Square, name is not
+	const string describe = DisassembleMethod(program, "Shape"s, "describe"s);
+	ASSERT(describe.find(" CallDirect "s) != string::npos);
+	ASSERT(describe.find(" Call "s) != string::npos);
+	ASSERT(DisassembleMethod(program, "Builder"s, "exact"s).find(" Call "s) == string::npos);
+	ASSERT(DisassembleMethod(program, "Builder"s, "mixed"s).find(" CallDirect "s) == string::npos);
+	ASSERT(DisassembleMethod(program, "Builder"s, "twice"s).find(" CallDirect "s) != string::npos);
+	ASSERT(DisassembleMethod(program, "Builder"s, "last"s).find(" TailCallDirect "s) != string::npos);
+
+	// A variable bound before the program runs may hold an instance of another class
+	istringstream input(program + R"(
+print x.area()
+x = Square(2)
+print x.area()
+)"s);
+	parse::Lexer lexer(input);
+	auto tree = ParseProgram(lexer);
+	runtime::DummyContext context;
+	runtime::Closure classes;
+	ASSERT_THROWS(tree->Execute(classes, context), ast::ExecutionError);
+	runtime::Closure closure{{"x"s, runtime::ObjectHolder::Own(runtime::ClassInstance(
+										  *classes.at("Shape"s).TryAs<runtime::Class>()))}};
+	context.output.str({});
+	tree->Execute(closure, context);
+	ASSERT_EQUAL(context.output.str(), "shape 9 shape 0\n18 4 0 4 8\n0\n4\n"s);
+}
+
+}  // namespace
+
+void RunVmTests(TestRunner& tr) {
+	RUN_TEST(tr, TestLoopsAndCalls);
+	RUN_TEST(tr, TestLogicalOperations);
+	RUN_TEST(tr, TestTruth);
+	RUN_TEST(tr, TestFields);
+	RUN_TEST(tr, TestErrors);
+	RUN_TEST(tr, TestEmptyLoop);
+	RUN_TEST(tr, TestDictChangedByEq);
+	RUN_TEST(tr, TestShadowStack);
+	RUN_TEST(tr, TestSuperinstructions);
+	RUN_TEST(tr, TestRecursion);
+	RUN_TEST(tr, TestFrames);
+	RUN_TEST(tr, TestMemoization);
+	RUN_TEST(tr, TestPurity);
+	RUN_TEST(tr, TestDevirtualization);
+}
+
+}  // namespace vm